@@ -1,8 +1,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <pthread.h>
 #include "abr.h"
 
+// dual EWMA half-lives in samples (fast reacts to drops, slow keeps the long-term rate)
+#define EWMA_FAST_HALFLIFE 3.0
+#define EWMA_SLOW_HALFLIFE 8.0
+
+// percentile histogram: log-spaced bins from 2^20 bps (~1 Mbps) to 2^37 bps (~137 Gbps)
+#define PCT_BINS 136
+#define PCT_LOG2_MIN 20.0
+#define PCT_LOG2_MAX 37.0
+
 struct ABR {
     MPDInfo* mpd;
     double threshold;
@@ -11,11 +22,45 @@ struct ABR {
     // circular buffer of recent samples
     size_t *sizes;
     double *times_ms;
+    double *rates_bps;     // per-sample throughput (0 if the sample had no duration)
+    int *bins;             // percentile bin of each sample (-1 if not counted)
     int cap;
     int pos;
     int filled;
+    // fast-start / probing
+    int fast_start;        // 1 if fast-start mode is enabled
+    int fs_min_samples;    // samples required before the first fast-start decision
+    double fs_z;           // confidence multiplier for the lower bound
+    int probe_interval;    // frames between probes (0 = off)
+    int last_probe_frame;
+    double last_bps;       // most recent estimate used for a decision
+    // estimator state, all updated in O(1) per sample
+    AbrEstimator estimator;
+    double percentile;     // 0..1 for ABR_EST_PERCENTILE
+    double ewma_fast, ewma_slow;
+    double ewma_fast_w, ewma_slow_w; // accumulated weights for bias correction
+    double inv_rate_sum;   // sum of 1/rate over the last check_interval samples
+    int inv_rate_n;
+    int pct_hist[PCT_BINS];
+    int pct_n;
+    Logger* logger;
+    // select runs on the downloader thread, update on the main thread
+    pthread_mutex_t lock;
 };
 
+static const char* estimator_names[] = { "window", "ewma", "harmonic", "percentile" };
+
+int abr_parse_estimator(const char* name, AbrEstimator* out) {
+    if (!name || !out) return -1;
+    for (int i = 0; i < (int)(sizeof(estimator_names) / sizeof(estimator_names[0])); i++) {
+        if (!strcmp(name, estimator_names[i])) {
+            *out = (AbrEstimator)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 ABR* abr_init(MPDInfo* mpd, double threshold, int check_interval_frames) {
     ABR* a = calloc(1, sizeof(ABR));
     a->mpd = mpd;
@@ -25,17 +70,107 @@ ABR* abr_init(MPDInfo* mpd, double threshold, int check_interval_frames) {
     a->cap = check_interval_frames * 2 + 10;
     a->sizes = calloc(a->cap, sizeof(size_t));
     a->times_ms = calloc(a->cap, sizeof(double));
+    a->rates_bps = calloc(a->cap, sizeof(double));
+    a->bins = calloc(a->cap, sizeof(int));
     a->pos = 0;
     a->filled = 0;
+    a->fast_start = 0;
+    a->fs_min_samples = 3;
+    a->fs_z = 1.645;
+    a->probe_interval = 0;
+    a->last_probe_frame = 0;
+    a->last_bps = 0.0;
+    a->estimator = ABR_EST_WINDOW;
+    a->percentile = 0.2;
+    a->logger = NULL;
+    pthread_mutex_init(&a->lock, NULL);
     return a;
 }
 
+void abr_set_fast_start(ABR* a, int min_samples, double confidence_z) {
+    if (!a) return;
+    pthread_mutex_lock(&a->lock);
+    a->fast_start = 1;
+    a->fs_min_samples = (min_samples > 1) ? min_samples : 2; // need >= 2 for a variance
+    a->fs_z = (confidence_z >= 0.0) ? confidence_z : 0.0;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void abr_set_probe_interval(ABR* a, int probe_interval_frames) {
+    if (!a) return;
+    pthread_mutex_lock(&a->lock);
+    a->probe_interval = (probe_interval_frames > 0) ? probe_interval_frames : 0;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void abr_set_estimator(ABR* a, AbrEstimator est, double percentile) {
+    if (!a) return;
+    pthread_mutex_lock(&a->lock);
+    a->estimator = est;
+    if (percentile > 0.0 && percentile < 1.0) a->percentile = percentile;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void abr_set_logger(ABR* a, Logger* logger) {
+    if (!a) return;
+    pthread_mutex_lock(&a->lock);
+    a->logger = logger;
+    pthread_mutex_unlock(&a->lock);
+}
+
+static int pct_bin_for(double bps) {
+    if (bps <= 0.0) return -1;
+    double l = log2(bps);
+    int b = (int)((l - PCT_LOG2_MIN) * (double)PCT_BINS / (PCT_LOG2_MAX - PCT_LOG2_MIN));
+    if (b < 0) b = 0;
+    if (b >= PCT_BINS) b = PCT_BINS - 1;
+    return b;
+}
+
+static double pct_bin_center(int b) {
+    double l = PCT_LOG2_MIN + ((double)b + 0.5) * (PCT_LOG2_MAX - PCT_LOG2_MIN) / (double)PCT_BINS;
+    return exp2(l);
+}
+
 void abr_update_stats(ABR* a, size_t bytes, double total_ms) {
     if (!a) return;
+    pthread_mutex_lock(&a->lock);
+    double bps = (total_ms > 0.0) ? ((double)bytes / total_ms) * 1000.0 * 8.0 : 0.0;
+
+    // evict the sample that leaves the check_interval window (still held in the ring since cap > window)
+    int w = a->check_interval;
+    if (w > 0 && a->filled >= w) {
+        int old = (a->pos - w + a->cap) % a->cap;
+        if (a->rates_bps[old] > 0.0) {
+            a->inv_rate_sum -= 1.0 / a->rates_bps[old];
+            a->inv_rate_n--;
+        }
+        if (a->bins[old] >= 0) {
+            a->pct_hist[a->bins[old]]--;
+            a->pct_n--;
+        }
+    }
+
     a->sizes[a->pos] = bytes;
     a->times_ms[a->pos] = total_ms;
+    a->rates_bps[a->pos] = bps;
+    a->bins[a->pos] = pct_bin_for(bps);
+    if (bps > 0.0) {
+        a->inv_rate_sum += 1.0 / bps;
+        a->inv_rate_n++;
+        a->pct_hist[a->bins[a->pos]]++;
+        a->pct_n++;
+
+        double af = 1.0 - pow(0.5, 1.0 / EWMA_FAST_HALFLIFE);
+        double as = 1.0 - pow(0.5, 1.0 / EWMA_SLOW_HALFLIFE);
+        a->ewma_fast = af * bps + (1.0 - af) * a->ewma_fast;
+        a->ewma_slow = as * bps + (1.0 - as) * a->ewma_slow;
+        a->ewma_fast_w = af + (1.0 - af) * a->ewma_fast_w;
+        a->ewma_slow_w = as + (1.0 - as) * a->ewma_slow_w;
+    }
     a->pos = (a->pos + 1) % a->cap;
     if (a->filled < a->cap) a->filled++;
+    pthread_mutex_unlock(&a->lock);
 }
 
 // compute average bandwidth (bytes/ms) over last N samples (or available)
@@ -59,17 +194,147 @@ static double compute_avg_bandwidth(ABR* a, int samples) {
     return (total_bytes / total_ms) * 1000.0 * 8.0;
 }
 
-int abr_select_for_frame(ABR* a, int frame_index, int buffer_count) {
-    if (!a || !a->mpd) return 0;
+// percentile of per-frame throughput over the check_interval window from the bin histogram
+static double compute_percentile_bandwidth(ABR* a) {
+    if (a->pct_n <= 0) return 0.0;
+    int rank = (int)ceil(a->percentile * (double)a->pct_n);
+    if (rank < 1) rank = 1;
+    int seen = 0;
+    for (int b = 0; b < PCT_BINS; b++) {
+        seen += a->pct_hist[b];
+        if (seen >= rank) return pct_bin_center(b);
+    }
+    return pct_bin_center(PCT_BINS - 1);
+}
+
+// throughput estimate (bits/sec) from the selected estimator
+static double estimate_bandwidth(ABR* a) {
+    switch (a->estimator) {
+    case ABR_EST_EWMA: {
+        if (a->ewma_fast_w <= 0.0 || a->ewma_slow_w <= 0.0) return 0.0;
+        double fast = a->ewma_fast / a->ewma_fast_w;
+        double slow = a->ewma_slow / a->ewma_slow_w;
+        return fast < slow ? fast : slow;
+    }
+    case ABR_EST_HARMONIC:
+        if (a->inv_rate_n <= 0 || a->inv_rate_sum <= 0.0) return 0.0;
+        return (double)a->inv_rate_n / a->inv_rate_sum;
+    case ABR_EST_PERCENTILE:
+        return compute_percentile_bandwidth(a);
+    case ABR_EST_WINDOW:
+    default:
+        return compute_avg_bandwidth(a, a->check_interval);
+    }
+}
+
+// lower confidence bound (bits/sec) of the per-frame throughput over all stored samples;
+// also returns the plain mean through *mean_bps
+static double compute_lower_bound_bandwidth(ABR* a, double* mean_bps) {
+    *mean_bps = 0.0;
+    int n = 0;
+    double sum = 0.0, sum_sq = 0.0;
+    int idx = a->pos - 1;
+    if (idx < 0) idx += a->cap;
+    for (int i = 0; i < a->filled; i++) {
+        double bps = a->rates_bps[idx];
+        if (bps > 0.0) {
+            sum += bps;
+            sum_sq += bps * bps;
+            n++;
+        }
+        idx--;
+        if (idx < 0) idx += a->cap;
+    }
+    if (n < 2) return 0.0;
+    double mean = sum / (double)n;
+    double var = (sum_sq - (double)n * mean * mean) / (double)(n - 1);
+    if (var < 0.0) var = 0.0;
+    *mean_bps = mean;
+    return mean - a->fs_z * sqrt(var / (double)n);
+}
+
+// record one decision point to the logger (called with lock held)
+static void log_decision(ABR* a, int frame_index, const char* phase, double estimate_bps,
+                         int from_rep, int to_rep, const char* decision) {
+    if (!a->logger) return;
+    AbrLog entry = {0};
+    entry.frame_no = frame_index;
+    entry.estimator = estimator_names[a->estimator];
+    entry.phase = phase;
+    entry.estimate_bps = estimate_bps;
+    entry.samples = a->filled < a->check_interval ? a->filled : a->check_interval;
+    entry.from_rep = from_rep;
+    entry.to_rep = to_rep;
+    entry.decision = decision;
+    logger_add_abr_decision(a->logger, &entry);
+}
+
+// highest representation whose bitrate scaled by factor still fits under bps (0 if none)
+static int highest_rep_under(ABR* a, double bps, double factor) {
+    int best = 0;
+    for (int r = 0; r < a->mpd->n_reps; r++) {
+        if (bps > factor * (double)a->mpd->bitrates[r]) best = r;
+    }
+    return best;
+}
+
+// return current_rep, or current_rep + 1 if a probe is due on this frame
+static int maybe_probe(ABR* a, int frame_index) {
+    int cur = a->current_rep;
+    if (a->probe_interval <= 0 || cur >= a->mpd->n_reps - 1) return cur;
+    if (frame_index - a->last_probe_frame < a->probe_interval) return cur;
+    // don't probe while the current representation is not sustained
+    if (a->last_bps < (double)a->mpd->bitrates[cur]) return cur;
+    a->last_probe_frame = frame_index;
+    log_decision(a, frame_index, a->filled < a->check_interval ? "fast_start" : "steady",
+                 a->last_bps, cur, cur + 1, "probe");
+    return cur + 1;
+}
+
+// fast-start decision from the samples available so far (called with lock held)
+static int select_fast_start(ABR* a, int frame_index) {
+    if (a->filled < a->fs_min_samples) return a->current_rep;
+
+    double mean_bps = 0.0;
+    double lcb_bps = compute_lower_bound_bandwidth(a, &mean_bps);
+    if (mean_bps <= 0.0) return a->current_rep;
+    a->last_bps = mean_bps;
+
+    int cur = a->current_rep;
+    // jump straight to the highest rep the pessimistic estimate supports
+    int target = highest_rep_under(a, lcb_bps, a->threshold);
+    if (target > cur) {
+        a->current_rep = target;
+        log_decision(a, frame_index, "fast_start", lcb_bps, cur, target, "up");
+        return a->current_rep;
+    }
+    // early samples say the current rep is not sustainable: fall back to what the mean supports
+    if (cur > 0 && mean_bps < (double)a->mpd->bitrates[cur]) {
+        a->current_rep = highest_rep_under(a, mean_bps, 1.0);
+        log_decision(a, frame_index, "fast_start", mean_bps, cur, a->current_rep, "down");
+        return a->current_rep;
+    }
+    log_decision(a, frame_index, "fast_start", lcb_bps, cur, cur, "hold");
+    return maybe_probe(a, frame_index);
+}
+
+static int select_locked(ABR* a, int frame_index) {
     // only re-evaluate every check_interval frames
     if (a->check_interval <= 0) return a->current_rep;
-    if ((frame_index % a->check_interval) != 0) return a->current_rep;
+
+    // fast-start: use early samples instead of waiting for a full window
+    if (a->fast_start && a->filled < a->check_interval) {
+        return select_fast_start(a, frame_index);
+    }
+
+    if ((frame_index % a->check_interval) != 0) return maybe_probe(a, frame_index);
 
     // if not enough samples yet, stay at current_rep
     if (a->filled < a->check_interval) return a->current_rep;
 
-    double avg_bps = compute_avg_bandwidth(a, a->check_interval);
+    double avg_bps = estimate_bandwidth(a);
     if (avg_bps <= 0.0) return a->current_rep;
+    a->last_bps = avg_bps;
 
     int cur = a->current_rep;
     int n = a->mpd->n_reps;
@@ -79,22 +344,81 @@ int abr_select_for_frame(ABR* a, int frame_index, int buffer_count) {
     // fprintf(stderr, "[abr] frame=%d samples=%d avg_bps=%.0f cur_rep=%d cur_bitrate=%d threshold=%.2f\n",
     //     frame_index, a->filled, avg_bps, cur, cur_bitrate, a->threshold);
 
+    // fast-start mode: skip several reps at once if the estimate clears the threshold for them
+    if (a->fast_start) {
+        int target = highest_rep_under(a, avg_bps, a->threshold);
+        if (target > cur + 1) {
+            a->current_rep = target;
+            log_decision(a, frame_index, "steady", avg_bps, cur, target, "up");
+            return a->current_rep;
+        }
+    }
+
     // attempt to go up if avg_bps > threshold * current_bitrate
     if (cur < n-1 && avg_bps > a->threshold * (double)cur_bitrate) {
         a->current_rep = cur + 1;
+        log_decision(a, frame_index, "steady", avg_bps, cur, cur + 1, "up");
         return a->current_rep;
     }
     // go down if avg_bps < current_bitrate (no threshold)
     if (cur > 0 && avg_bps < (double)cur_bitrate) {
         a->current_rep = cur - 1;
+        log_decision(a, frame_index, "steady", avg_bps, cur, cur - 1, "down");
         return a->current_rep;
     }
+    log_decision(a, frame_index, "steady", avg_bps, cur, cur, "hold");
     return a->current_rep;
 }
 
+int abr_select_for_frame(ABR* a, int frame_index, int buffer_count) {
+    (void)buffer_count;
+    if (!a || !a->mpd) return 0;
+    pthread_mutex_lock(&a->lock);
+    int rep = select_locked(a, frame_index);
+    pthread_mutex_unlock(&a->lock);
+    return rep;
+}
+
+int abr_prefetch_hint(ABR* a, int next_frame, int* first_frame) {
+    if (!a || !a->mpd || a->check_interval <= 0) return -1;
+    pthread_mutex_lock(&a->lock);
+    int cur = a->current_rep;
+    int rep = -1;
+    if (cur < a->mpd->n_reps - 1 && a->filled > 0) {
+        // same up-switch test as a steady decision point, on the estimate available now
+        double bps = estimate_bandwidth(a);
+        if (bps > a->threshold * (double)a->mpd->bitrates[cur]) {
+            rep = cur + 1;
+            // fast-start decides every frame; steady mode only on check_interval boundaries
+            if (a->fast_start && a->filled < a->check_interval) {
+                *first_frame = next_frame;
+            } else {
+                int k = a->check_interval;
+                *first_frame = ((next_frame + k - 1) / k) * k;
+            }
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+    return rep;
+}
+
+void abr_note_deadline_miss(ABR* a, int frame_index, int rep) {
+    if (!a || !a->mpd || rep < 0) return;
+    pthread_mutex_lock(&a->lock);
+    int cur = a->current_rep;
+    if (rep < cur) {
+        a->current_rep = rep;
+        log_decision(a, frame_index, "deadline", a->last_bps, cur, rep, "down");
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
 void abr_free(ABR* a) {
     if (!a) return;
+    pthread_mutex_destroy(&a->lock);
     free(a->sizes);
     free(a->times_ms);
+    free(a->rates_bps);
+    free(a->bins);
     free(a);
 }
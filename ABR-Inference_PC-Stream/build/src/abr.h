@@ -2,15 +2,51 @@
 #define ABR_H
 
 #include "mpd_parser.h"
+#include "logger.h"
 
 typedef struct ABR ABR;
 
+// Throughput estimators used at steady-state decision points
+typedef enum {
+    ABR_EST_WINDOW = 0,  // sum of bytes / sum of ms over the last check_interval samples (default)
+    ABR_EST_EWMA,        // min of a fast and a slow EWMA of per-frame rates
+    ABR_EST_HARMONIC,    // harmonic mean of per-frame rates over the window
+    ABR_EST_PERCENTILE   // percentile of per-frame rates over the window (log-binned histogram)
+} AbrEstimator;
+
+// Map "window" | "ewma" | "harmonic" | "percentile" to an estimator. Returns 0 on success.
+int abr_parse_estimator(const char* name, AbrEstimator* out);
+
 // Initialize ABR with MPD info, start at lowest representation (index 0)
 ABR* abr_init(MPDInfo* mpd, double threshold, int check_interval_frames);
 
+// Enable fast-start: until a full check_interval window exists, decide on every frame
+// from as few as min_samples samples using a lower confidence bound (mean - z * stderr)
+// of per-frame throughput, and allow multi-step up-switches when the estimate supports them.
+void abr_set_fast_start(ABR* a, int min_samples, double confidence_z);
+
+// Schedule a single probe frame at current_rep + 1 every probe_interval_frames (0 = off).
+// Probes do not change current_rep; their samples feed the estimator like any other frame.
+void abr_set_probe_interval(ABR* a, int probe_interval_frames);
+
+// Choose the throughput estimator; percentile (0..1) is used by ABR_EST_PERCENTILE only.
+void abr_set_estimator(ABR* a, AbrEstimator est, double percentile);
+
+// Record every decision point (estimate, samples, old/new rep) to the logger's ABR log.
+void abr_set_logger(ABR* a, Logger* logger);
+
 // Select representation index for a given frame index and current buffer occupancy
 int abr_select_for_frame(ABR* a, int frame_index, int buffer_count);
 
+// Prefetch hint: if the current estimate already clears the up-switch condition, return the
+// representation the next decision will likely pick (current + 1) and, in *first_frame, the first
+// frame >= next_frame at which it can take effect. Returns -1 when no switch is expected.
+int abr_prefetch_hint(ABR* a, int next_frame, int* first_frame);
+
+// A transfer at a higher rep missed its playback deadline and the frame was re-requested at rep
+// (see deadline.h). Drops current_rep to rep right away instead of at the next decision point.
+void abr_note_deadline_miss(ABR* a, int frame_index, int rep);
+
 // Update estimator with observed bytes downloaded and total time (download+decrypt) in ms
 void abr_update_stats(ABR* a, size_t bytes, double total_ms);
 
@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include "affinity.h"
+
+static const char* g_names[PIN_ROLES] = { "download", "decrypt", "inference", "buffer", "player" };
+
+static int g_on = 0;
+static int g_auto = 0;
+static int g_set[PIN_ROLES];            // role has a CPU set
+static int g_explicit[PIN_ROLES];       // ... given on the command line
+static cpu_set_t g_cpus[PIN_ROLES];
+static int g_workers[PIN_ROLES];        // threads expected per role (for per-worker CPUs)
+
+// "0-3,8,10-11" -> set. Returns the number of CPUs or -1 on a syntax error.
+static int parse_cpulist(const char* s, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = s;
+    while (*p && *p != '\n') {
+        char* end;
+        long a = strtol(p, &end, 10);
+        if (end == p || a < 0 || a >= CPU_SETSIZE) return -1;
+        long b = a;
+        p = end;
+        if (*p == '-') {
+            b = strtol(p + 1, &end, 10);
+            if (end == p + 1 || b < a || b >= CPU_SETSIZE) return -1;
+            p = end;
+        }
+        for (long c = a; c <= b; c++) CPU_SET((int)c, set);
+        if (*p == ',') p++;
+        else if (*p && *p != '\n') return -1;
+    }
+    return CPU_COUNT(set);
+}
+
+static int read_cpulist(const char* path, cpu_set_t* set) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[4096];
+    int n = fgets(line, sizeof(line), f) ? parse_cpulist(line, set) : -1;
+    fclose(f);
+    return n;
+}
+
+static void format_cpulist(const cpu_set_t* set, char* out, size_t len) {
+    size_t o = 0;
+    out[0] = '\0';
+    for (int c = 0; c < CPU_SETSIZE && o < len; c++) {
+        if (!CPU_ISSET(c, set)) continue;
+        int e = c;
+        while (e + 1 < CPU_SETSIZE && CPU_ISSET(e + 1, set)) e++;
+        int w = e > c ? snprintf(out + o, len - o, "%s%d-%d", o ? "," : "", c, e)
+                      : snprintf(out + o, len - o, "%s%d", o ? "," : "", c);
+        if (w < 0) break;
+        o += (size_t)w;
+        c = e;
+    }
+}
+
+// n-th CPU of a set, wrapping around.
+static int nth_cpu(const cpu_set_t* set, int n) {
+    int count = CPU_COUNT(set);
+    if (count == 0) return -1;
+    n %= count;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, set) && n-- == 0) return c;
+    }
+    return -1;
+}
+
+int affinity_parse(const char* spec) {
+    if (!strcmp(spec, "auto")) {
+        g_on = g_auto = 1;
+        return 0;
+    }
+    const char* eq = strchr(spec, '=');
+    if (eq) {
+        for (int r = 0; r < PIN_ROLES; r++) {
+            if (strlen(g_names[r]) != (size_t)(eq - spec) || strncmp(spec, g_names[r], eq - spec)) continue;
+            if (parse_cpulist(eq + 1, &g_cpus[r]) <= 0) break;
+            g_set[r] = g_explicit[r] = 1;
+            g_on = 1;
+            return 0;
+        }
+    }
+    fprintf(stderr, "[error] bad --pin '%s' (use auto or <download|decrypt|inference|buffer|player>=<cpulist>).\n", spec);
+    return -1;
+}
+
+// NUMA node of the first network interface that reports one (an "up" one if any), -1 if none
+// does (no NUMA, virtual NICs only).
+static int nic_node(char* name, size_t len) {
+    DIR* d = opendir("/sys/class/net");
+    if (!d) return -1;
+    int node = -1, node_up = -1;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.' || !strcmp(e->d_name, "lo")) continue;
+        char path[512], buf[64];
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", e->d_name);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+        int n = fgets(buf, sizeof(buf), f) ? atoi(buf) : -1;
+        fclose(f);
+        if (n < 0) continue;
+        snprintf(path, sizeof(path), "/sys/class/net/%s/operstate", e->d_name);
+        int up = 0;
+        if ((f = fopen(path, "r")) != NULL) {
+            up = fgets(buf, sizeof(buf), f) && !strncmp(buf, "up", 2);
+            fclose(f);
+        }
+        if (up && node_up < 0) {
+            node_up = n;
+            snprintf(name, len, "%s", e->d_name);
+        } else if (node < 0 && node_up < 0) {
+            node = n;
+            snprintf(name, len, "%s", e->d_name);
+        }
+    }
+    closedir(d);
+    return node_up >= 0 ? node_up : node;
+}
+
+// First hardware thread of every physical core in `cpus`, as a set.
+static void physical_cores(const cpu_set_t* cpus, cpu_set_t* cores) {
+    CPU_ZERO(cores);
+    cpu_set_t seen;
+    CPU_ZERO(&seen);
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, cpus) || CPU_ISSET(c, &seen)) continue;
+        char path[256];
+        cpu_set_t sib;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", c);
+        if (read_cpulist(path, &sib) <= 0) {
+            CPU_ZERO(&sib);
+            CPU_SET(c, &sib);
+        }
+        CPU_OR(&seen, &seen, &sib);
+        CPU_SET(c, cores);
+    }
+}
+
+static void auto_place(const cpu_set_t* allowed) {
+    char nic[64] = "";
+    int node = nic_node(nic, sizeof(nic));
+    cpu_set_t node_cpus = *allowed;
+    if (node >= 0) {
+        char path[256];
+        cpu_set_t n;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_cpulist(path, &n) > 0) {
+            CPU_AND(&n, &n, allowed);
+            if (CPU_COUNT(&n) > 0) node_cpus = n;
+        }
+        printf("[info] pin: auto placement on NUMA node %d (NIC %s)\n", node, nic);
+    } else {
+        printf("[info] pin: auto placement, no NIC NUMA node reported; using all allowed CPUs\n");
+    }
+    cpu_set_t cores, io, rest, spare;
+    physical_cores(&node_cpus, &cores);
+    CPU_ZERO(&io);
+    CPU_SET(nth_cpu(&cores, 0), &io);
+    CPU_XOR(&rest, &cores, &io);          // other physical cores
+    CPU_XOR(&spare, &node_cpus, &io);     // everything on the node but the I/O core's first thread
+    if (CPU_COUNT(&rest) == 0) rest = CPU_COUNT(&spare) ? spare : node_cpus;
+    if (CPU_COUNT(&spare) == 0) spare = node_cpus;
+    const cpu_set_t* pick[PIN_ROLES] = { &io, &rest, &spare, &io, &io };
+    for (int r = 0; r < PIN_ROLES; r++) {
+        if (g_explicit[r]) continue;
+        g_cpus[r] = *pick[r];
+        g_set[r] = 1;
+    }
+}
+
+int affinity_setup(int decrypt_workers) {
+    if (!g_on) return 0;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        fprintf(stderr, "[warn] pin: cannot read the process CPU mask; --pin ignored.\n");
+        g_on = 0;
+        return 0;
+    }
+    if (g_auto) auto_place(&allowed);
+    for (int r = 0; r < PIN_ROLES; r++) g_workers[r] = 1;
+    g_workers[STAGE_DECRYPT] = decrypt_workers;
+    int rc = 0;
+    for (int r = 0; r < PIN_ROLES; r++) {
+        if (!g_set[r]) continue;
+        char want[256], got[256];
+        format_cpulist(&g_cpus[r], want, sizeof(want));
+        CPU_AND(&g_cpus[r], &g_cpus[r], &allowed);
+        if (CPU_COUNT(&g_cpus[r]) == 0) {
+            fprintf(stderr, "[error] pin: no CPU of %s=%s is available to this process.\n", g_names[r], want);
+            rc = -1;
+            continue;
+        }
+        format_cpulist(&g_cpus[r], got, sizeof(got));
+        if (g_workers[r] > 1) {
+            printf("[info] pin: %-9s -> cpus %s (%d workers, one cpu each)\n", g_names[r], got, g_workers[r]);
+        } else {
+            printf("[info] pin: %-9s -> cpus %s\n", g_names[r], got);
+        }
+    }
+    return rc;
+}
+
+void affinity_pin(pthread_t t, int role, int worker) {
+    if (!g_on || role < 0 || role >= PIN_ROLES || !g_set[role]) return;
+    cpu_set_t one;
+    const cpu_set_t* set = &g_cpus[role];
+    if (g_workers[role] > 1) {
+        CPU_ZERO(&one);
+        CPU_SET(nth_cpu(set, worker), &one);
+        set = &one;
+    }
+    int err = pthread_setaffinity_np(t, sizeof(cpu_set_t), set);
+    if (err != 0) {
+        fprintf(stderr, "[warn] pin: %s thread %d: pthread_setaffinity_np failed (%s)\n",
+                g_names[role], worker, strerror(err));
+    }
+}
+
+void affinity_pin_self(int role, int worker) {
+    affinity_pin(pthread_self(), role, worker);
+}
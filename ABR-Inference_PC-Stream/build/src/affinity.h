@@ -0,0 +1,33 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <pthread.h>
+#include "telemetry.h"
+
+// CPU placement of the client's threads (--pin). A role is a pipeline stage (PipelineStage)
+// or the virtual player. Each role gets a CPU set; a thread of a role with several workers is
+// pinned to one CPU of the set (worker w -> w-th CPU, wrapping), a single-thread role to the
+// whole set. Roles without a set are left to the scheduler.
+//
+// "auto" places the I/O side (download, buffer, player) on one core of the NUMA node the
+// network interface hangs off and spreads decrypt workers over the node's other physical
+// cores (one hardware thread each); inference gets the rest of the node.
+
+#define PIN_PLAYER STAGE_COUNT      // the virtual player thread
+#define PIN_ROLES  (STAGE_COUNT + 1)
+
+// Parse one --pin argument: "auto" or "<role>=<cpulist>" (role: download, decrypt, inference,
+// buffer, player; cpulist like "2-5,8"). Repeatable; explicit roles override auto.
+// Returns 0 on success, -1 on a bad spec (message printed).
+int affinity_parse(const char* spec);
+
+// Resolve the placement for decrypt_workers workers and print it. No-op without --pin.
+// Returns 0 on success, -1 if a set has no CPU the process may run on.
+int affinity_setup(int decrypt_workers);
+
+// Pin thread t as worker `worker` of role. No-op unless the role has a set.
+void affinity_pin(pthread_t t, int role, int worker);
+// Same for the calling thread (pipeline thread_init hook).
+void affinity_pin_self(int role, int worker);
+
+#endif // AFFINITY_H
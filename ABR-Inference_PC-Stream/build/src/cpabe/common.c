@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <ctype.h>
 #include <assert.h>
 #include <sys/types.h>
@@ -17,6 +18,8 @@
 #include <glib.h>
 #include <openssl/aes.h>
 #include <openssl/sha.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
 #include </usr/local/include/pbc/pbc.h>
 #include "common.h"
 
@@ -42,6 +45,67 @@ static int type_size(const char* type) {
     return 0;
 }
 
+/* Append one property to a row's segment list, merging it into the previous segment when both
+ * come from the same source. segs must have room for one entry per property. */
+static int push_segment(VvsSegment* segs, int nseg, int stripped, int size,
+                        int* red_base, int* coord_base)
+{
+    int src = stripped ? 1 : 0;
+    if (nseg > 0 && segs[nseg - 1].src == src) {
+        segs[nseg - 1].bytes += size;
+    } else {
+        segs[nseg].src = (guint8)src;
+        segs[nseg].bytes = (guint16)size;
+        segs[nseg].red_base = (guint16)(src ? 0 : *red_base);
+        segs[nseg].coord_base = (guint16)(src ? *coord_base : 0);
+        nseg++;
+    }
+    if (src) *coord_base += size;
+    else     *red_base += size;
+    return nseg;
+}
+
+/* Rebuild vcount full rows from the reduced rows and the decrypted coordinates, batch by batch,
+ * appending them to ply_buf and to out if given. Returns -1 if rows is too short. */
+static int interleave_rows(GByteArray* ply_buf, FILE* out, const guint8* rows, size_t rows_len,
+                           const guint8* coords, int vcount, int full_stride, int reduced_stride,
+                           const VvsSegment* segs, int nseg)
+{
+    const int BATCH_VERTS = 4096;
+    const int strip_per_vertex = full_stride - reduced_stride;
+    if ((size_t)vcount * (size_t)reduced_stride > rows_len) return -1;
+    unsigned char* full_chunk = (unsigned char*)scratch_alloc((size_t)full_stride * (size_t)BATCH_VERTS);
+    if (!full_chunk) die("OOM\n");
+
+    int done = 0;
+    while (done < vcount) {
+        int this_batch = vcount - done;
+        if (this_batch > BATCH_VERTS) this_batch = BATCH_VERTS;
+        for (int i = 0; i < this_batch; i++) {
+            size_t v = (size_t)done + (size_t)i;
+            unsigned char* outrow = full_chunk + (size_t)i * (size_t)full_stride;
+            const unsigned char* redrow = rows + v * (size_t)reduced_stride;
+            const unsigned char* coordrow = coords + v * (size_t)strip_per_vertex;
+            int out_off = 0;
+            for (int s = 0; s < nseg; s++) {
+                if (segs[s].src == 0) {
+                    memcpy(outrow + out_off, redrow + segs[s].red_base, (size_t)segs[s].bytes);
+                } else {
+                    memcpy(outrow + out_off, coordrow + segs[s].coord_base, (size_t)segs[s].bytes);
+                }
+                out_off += segs[s].bytes;
+            }
+        }
+        g_byte_array_append(ply_buf, full_chunk, (guint)((size_t)full_stride * (size_t)this_batch));
+        if (out) {
+            fwrite(full_chunk, (size_t)full_stride, (size_t)this_batch, out);
+        }
+        done += this_batch;
+    }
+    scratch_free(full_chunk);
+    return 0;
+}
+
 /* Process input PLY: strip coords, write reduced header+vertices,
    return payload (orig values to encrypt): [uint32 datalen][coords...] */
 
@@ -53,20 +117,27 @@ GByteArray* restore_ply_with_coords(
     EncryptPattern pat
 )
 {
-    // Parse header and vertex layout from reduced_ply_buf
-    const char* data = (const char*)reduced_ply_buf->data;
-    size_t buflen = reduced_ply_buf->len;
+    return restore_ply_view(reduced_ply_buf->data, reduced_ply_buf->len, out_file, decvals, pat, NULL);
+}
+
+GByteArray* restore_ply_view(const guint8* reduced, size_t buflen, const char* out_file,
+                             GByteArray* decvals, EncryptPattern pat, GByteArray* into)
+{
+    // Parse header and vertex layout from the reduced PLY
+    const char* data = (const char*)reduced;
     size_t pos = 0;
 
     char line[256];
     int vcount = 0;
     typedef struct { char name[32]; char type[16]; int size; int is_stripped; } PlyProp;
     int prop_capacity = 16;
-    PlyProp* props = (PlyProp*)malloc(prop_capacity * sizeof(PlyProp));
+    PlyProp* props = (PlyProp*)scratch_alloc(prop_capacity * sizeof(PlyProp));
     int prop_count = 0;
     int full_stride = 0, reduced_stride = 0;
 
-    GString* header = g_string_new("");
+    // the header is copied line by line into the output, the rows follow
+    GByteArray* ply_buf = into ? into : scratch_bytes(buflen);
+    g_byte_array_set_size(ply_buf, 0);
     FILE* out = NULL;
     if (out_file) {
         out = fopen(out_file, "wb");
@@ -83,8 +154,8 @@ GByteArray* restore_ply_with_coords(
         size_t copy_len = line_len < 255 ? line_len : 255;
         memcpy(line, data + pos, copy_len);
         line[copy_len] = 0;
-        g_string_append(header, line);
-        g_string_append_c(header, '\n');
+        g_byte_array_append(ply_buf, (guint8*)line, (guint)copy_len);
+        g_byte_array_append(ply_buf, (const guint8*)"\n", 1);
         if (out) {
             fwrite(line, 1, copy_len, out);
             fwrite("\n", 1, 1, out);
@@ -95,8 +166,11 @@ GByteArray* restore_ply_with_coords(
             char type[32], name[32];
             if (sscanf(line, "property %31s %31s", type, name) == 2) {
                 if (prop_count == prop_capacity) {
+                    PlyProp* grown = (PlyProp*)scratch_alloc(2 * prop_capacity * sizeof(PlyProp));
+                    memcpy(grown, props, prop_capacity * sizeof(PlyProp));
+                    scratch_free(props);
+                    props = grown;
                     prop_capacity *= 2;
-                    props = (PlyProp*)realloc(props, prop_capacity * sizeof(PlyProp));
                 }
                 PlyProp* p = &props[prop_count++];
                 strcpy(p->name, name);
@@ -130,114 +204,27 @@ GByteArray* restore_ply_with_coords(
         // Optionally die here if strict
     }
 
-    GByteArray* ply_buf = g_byte_array_new();
-    g_byte_array_append(ply_buf, (guint8*)header->str, header->len);
+    // room for the rows, so the batches below append without reallocating
+    guint header_len = ply_buf->len;
+    g_byte_array_set_size(ply_buf, (guint)(header_len + (size_t)vcount * (size_t)full_stride));
+    g_byte_array_set_size(ply_buf, header_len);
 
     // Build coalesced segments for final full row
-    typedef struct { unsigned char src; int bytes; int red_base; int coord_base; } Seg;
-    int seg_capacity = 8;
-    Seg* segs = (Seg*)malloc(seg_capacity * sizeof(Seg));
+    VvsSegment* segs = (VvsSegment*)scratch_alloc((prop_count > 0 ? prop_count : 1) * sizeof(VvsSegment));
+    if (!segs) die("OOM\n");
     int nseg = 0;
     int red_base = 0, coord_base = 0;
-    int curr_src = -1, curr_bytes = 0, curr_red_base = 0, curr_coord_base = 0;
-    for (int j = 0; j < prop_count; j++) {
-        int src = props[j].is_stripped ? 1 : 0;
-        int sz  = props[j].size;
-        if (src == 0) { /* RED */
-            if (curr_src == src) {
-                curr_bytes += sz;
-            } else {
-                if (curr_src != -1) {
-                    if (nseg == seg_capacity) {
-                        seg_capacity *= 2;
-                        segs = (Seg*)realloc(segs, seg_capacity * sizeof(Seg));
-                    }
-                    segs[nseg++] = (Seg){ (unsigned char)curr_src, curr_bytes, curr_red_base, curr_coord_base };
-                }
-                curr_src = 0;
-                curr_bytes = sz;
-                curr_red_base = red_base;
-                curr_coord_base = 0;
-            }
-            red_base += sz;
-        } else { /* COORD */
-            if (curr_src == src) {
-                curr_bytes += sz;
-            } else {
-                if (curr_src != -1) {
-                    if (nseg == seg_capacity) {
-                        seg_capacity *= 2;
-                        segs = (Seg*)realloc(segs, seg_capacity * sizeof(Seg));
-                    }
-                    segs[nseg++] = (Seg){ (unsigned char)curr_src, curr_bytes, curr_red_base, curr_coord_base };
-                }
-                curr_src = 1;
-                curr_bytes = sz;
-                curr_red_base = 0;
-                curr_coord_base = coord_base;
-            }
-            coord_base += sz;
-        }
-    }
-    if (curr_src != -1) {
-        if (nseg == seg_capacity) {
-            seg_capacity *= 2;
-            segs = (Seg*)realloc(segs, seg_capacity * sizeof(Seg));
-        }
-        segs[nseg++] = (Seg){ (unsigned char)curr_src, curr_bytes, curr_red_base, curr_coord_base };
-    }
-
-    const int BATCH_VERTS = 4096;
-    const size_t red_chunk_bytes  = (size_t)reduced_stride * (size_t)BATCH_VERTS;
-    const size_t full_chunk_bytes = (size_t)full_stride    * (size_t)BATCH_VERTS;
-    unsigned char* red_chunk  = (reduced_stride > 0) ? (unsigned char*)malloc(red_chunk_bytes)  : NULL;
-    unsigned char* full_chunk = (unsigned char*)malloc(full_chunk_bytes);
-    if (!full_chunk || (reduced_stride && !red_chunk)) die("OOM\n");
+    for (int j = 0; j < prop_count; j++)
+        nseg = push_segment(segs, nseg, props[j].is_stripped, props[j].size, &red_base, &coord_base);
 
-    int done = 0;
-    size_t batch_coord_base = 0;
     // Vertex data starts after header
-    size_t vertex_data_off = pos;
-    while (done < vcount) {
-        int this_batch = vcount - done;
-        if (this_batch > BATCH_VERTS) this_batch = BATCH_VERTS;
-        // Read reduced vertex rows from buffer
-        if (reduced_stride > 0) {
-            const size_t need = (size_t)this_batch * (size_t)reduced_stride;
-            if (vertex_data_off + need > buflen)
-                die("Unexpected EOF while reading reduced vertex batch at %d\n", done);
-            memcpy(red_chunk, data + vertex_data_off, need);
-            vertex_data_off += need;
-        }
-        for (int i = 0; i < this_batch; i++) {
-            unsigned char* outrow = full_chunk + (size_t)i * (size_t)full_stride;
-            const unsigned char* redrow =
-                (reduced_stride > 0) ? (red_chunk + (size_t)i * (size_t)reduced_stride) : NULL;
-            const unsigned char* coordrow =
-                coordbuf + batch_coord_base + (size_t)i * (size_t)strip_per_vertex;
-            int out_off = 0;
-            for (int s = 0; s < nseg; s++) {
-                if (segs[s].src == 0) {
-                    memcpy(outrow + out_off, redrow + segs[s].red_base, (size_t)segs[s].bytes);
-                } else {
-                    memcpy(outrow + out_off, coordrow + segs[s].coord_base, (size_t)segs[s].bytes);
-                }
-                out_off += segs[s].bytes;
-            }
-        }
-        g_byte_array_append(ply_buf, full_chunk, (size_t)full_stride * (size_t)this_batch);
-        if (out) {
-            fwrite(full_chunk, (size_t)full_stride, (size_t)this_batch, out);
-        }
-        done += this_batch;
-        batch_coord_base += (size_t)this_batch * (size_t)strip_per_vertex;
-    }
+    if (interleave_rows(ply_buf, out, reduced + pos, buflen - pos, coordbuf, vcount,
+                        full_stride, reduced_stride, segs, nseg) != 0)
+        die("Unexpected EOF while reading reduced vertex rows\n");
+
     if (out) fclose(out);
-    if (red_chunk)  free(red_chunk);
-    free(full_chunk);
-    free(segs);
-    free(props);
-    g_string_free(header, 1);
+    scratch_free(segs);
+    scratch_free(props);
     return ply_buf;
 }
 GByteArray* restore_stripped_rebuild(
@@ -249,27 +236,178 @@ GByteArray* restore_stripped_rebuild(
     return restore_ply_with_coords(reduced_ply_buf, out_file, decvals, pat);
 }
 
+/* ======================= Scratch arena ======================= */
+
+#define SCRATCH_ALIGN 16
+
+typedef struct {
+    int depth;                /* scratch_begin() nesting; 0 = plain malloc */
+    guint8* base;             /* one block, sized to the largest frame seen */
+    size_t cap, used;
+    void** spill;             /* this frame's allocations that did not fit */
+    int n_spill, spill_cap;
+    size_t spill_bytes;
+    GByteArray** arrays;      /* recycled GByteArrays, arrays_used handed out this frame */
+    int n_arrays, arrays_used;
+} ScratchArena;
+
+static __thread ScratchArena t_scratch;
+static size_t scratch_peak = 0;
+static int    scratch_grows = 0;
+
+void scratch_begin(void)
+{
+    t_scratch.depth++;
+}
+
+void scratch_end(void)
+{
+    ScratchArena* a = &t_scratch;
+    if (a->depth == 0 || --a->depth > 0) return;
+
+    size_t total = a->used + a->spill_bytes;
+    size_t seen = __atomic_load_n(&scratch_peak, __ATOMIC_RELAXED);
+    while (total > seen &&
+           !__atomic_compare_exchange_n(&scratch_peak, &seen, total, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    for (int i = 0; i < a->n_spill; i++) free(a->spill[i]);
+    if (a->n_spill > 0) {
+        /* grow once, with some headroom, so the next frame of this size fits */
+        size_t cap = total + total / 4;
+        free(a->base);
+        a->base = (guint8*)malloc(cap);
+        if (!a->base) die("OOM\n");
+        a->cap = cap;
+        __atomic_add_fetch(&scratch_grows, 1, __ATOMIC_RELAXED);
+    }
+    a->n_spill = 0;
+    a->spill_bytes = 0;
+    a->used = 0;
+    a->arrays_used = 0;
+}
+
+void* scratch_alloc(size_t n)
+{
+    ScratchArena* a = &t_scratch;
+    if (a->depth == 0) return malloc(n > 0 ? n : 1);
+
+    n = (n + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    if (n == 0) n = SCRATCH_ALIGN;
+    if (a->used + n <= a->cap) {
+        void* p = a->base + a->used;
+        a->used += n;
+        return p;
+    }
+    /* does not fit: malloc it for now, scratch_end() grows the block */
+    if (a->n_spill == a->spill_cap) {
+        int cap = a->spill_cap ? a->spill_cap * 2 : 16;
+        void** sp = (void**)realloc(a->spill, (size_t)cap * sizeof(void*));
+        if (!sp) die("OOM\n");
+        a->spill = sp;
+        a->spill_cap = cap;
+    }
+    void* p = malloc(n);
+    if (!p) die("OOM\n");
+    a->spill[a->n_spill++] = p;
+    a->spill_bytes += n;
+    return p;
+}
+
+void scratch_free(void* p)
+{
+    if (t_scratch.depth == 0) free(p);
+}
+
+GByteArray* scratch_bytes(size_t n)
+{
+    ScratchArena* a = &t_scratch;
+    if (a->depth == 0) return g_byte_array_sized_new((guint)n);
+
+    if (a->arrays_used == a->n_arrays) {
+        GByteArray** arr = (GByteArray**)realloc(a->arrays, (size_t)(a->n_arrays + 1) * sizeof(GByteArray*));
+        if (!arr) die("OOM\n");
+        a->arrays = arr;
+        a->arrays[a->n_arrays++] = g_byte_array_new();
+    }
+    GByteArray* b = a->arrays[a->arrays_used++];
+    /* keeps its allocation from earlier frames; reserve n up front */
+    if (n > 0) g_byte_array_set_size(b, (guint)n);
+    g_byte_array_set_size(b, 0);
+    return b;
+}
+
+void scratch_free_bytes(GByteArray* b)
+{
+    if (b && t_scratch.depth == 0) g_byte_array_free(b, 1);
+}
+
+void scratch_release(void)
+{
+    ScratchArena* a = &t_scratch;
+    for (int i = 0; i < a->n_spill; i++) free(a->spill[i]);
+    for (int i = 0; i < a->n_arrays; i++) g_byte_array_free(a->arrays[i], 1);
+    free(a->spill);
+    free(a->arrays);
+    free(a->base);
+    memset(a, 0, sizeof(*a));
+}
+
+void scratch_stats(size_t* peak_bytes, int* grows)
+{
+    if (peak_bytes) *peak_bytes = __atomic_load_n(&scratch_peak, __ATOMIC_RELAXED);
+    if (grows) *grows = __atomic_load_n(&scratch_grows, __ATOMIC_RELAXED);
+}
+
 /* ======================= AES helpers (unchanged) ======================= */
 
-void init_aes( element_t k, int enc, AES_KEY* key, unsigned char* iv )
+/* AES-128 key of a CP-ABE session key: bytes 1..16 of its serialization */
+static void session_aes_key( element_t k, guint8 raw[16] )
 {
   int key_len;
   unsigned char* key_buf;
 
   key_len = element_length_in_bytes(k) < 17 ? 17 : element_length_in_bytes(k);
-  key_buf = (unsigned char*) malloc(key_len);
+  key_buf = (unsigned char*) scratch_alloc(key_len);
   element_to_bytes(key_buf, k);
+  memcpy(raw, key_buf + 1, 16);
+  scratch_free(key_buf);
+}
 
+static void init_aes_raw( const guint8 raw[16], int enc, AES_KEY* key, unsigned char* iv )
+{
   if( enc )
-    AES_set_encrypt_key(key_buf + 1, 128, key);
+    AES_set_encrypt_key(raw, 128, key);
   else
-    AES_set_decrypt_key(key_buf + 1, 128, key);
-  free(key_buf);
+    AES_set_decrypt_key(raw, 128, key);
 
   memset(iv, 0, 16);
 }
 
+void init_aes( element_t k, int enc, AES_KEY* key, unsigned char* iv )
+{
+  guint8 raw[16];
+
+  session_aes_key(k, raw);
+  init_aes_raw(raw, enc, key, iv);
+}
+
 GByteArray* aes_128_cbc_encrypt( GByteArray* pt, element_t k )
+{
+  guint8 raw[16];
+
+  session_aes_key(k, raw);
+  return aes_128_cbc_encrypt_raw(pt, raw);
+}
+
+GByteArray* aes_128_cbc_decrypt( GByteArray* ct, element_t k )
+{
+  guint8 raw[16];
+
+  session_aes_key(k, raw);
+  return aes_128_cbc_decrypt_raw(ct, raw);
+}
+
+GByteArray* aes_128_cbc_encrypt_raw( GByteArray* pt, const guint8 raw[16] )
 {
   AES_KEY key;
   unsigned char iv[16];
@@ -277,7 +415,7 @@ GByteArray* aes_128_cbc_encrypt( GByteArray* pt, element_t k )
   guint8 len[4];
   guint8 zero;
 
-  init_aes(k, 1, &key, iv);
+  init_aes_raw(raw, 1, &key, iv);
 
   /* stuff in real length (big endian) before padding */
   len[0] = (pt->len & 0xff000000)>>24;
@@ -299,29 +437,29 @@ GByteArray* aes_128_cbc_encrypt( GByteArray* pt, element_t k )
   return ct;
 }
 
-GByteArray* aes_128_cbc_decrypt( GByteArray* ct, element_t k )
+GByteArray* aes_128_cbc_decrypt_raw( GByteArray* ct, const guint8 raw[16] )
 {
   AES_KEY key;
   unsigned char iv[16];
   GByteArray* pt;
   unsigned int len;
 
-  init_aes(k, 0, &key, iv);
+  init_aes_raw(raw, 0, &key, iv);
 
-  pt = g_byte_array_new();
+  pt = scratch_bytes(ct->len);
   g_byte_array_set_size(pt, ct->len);
 
   AES_cbc_encrypt(ct->data, pt->data, ct->len, &key, iv, AES_DECRYPT);
 
-  /* get real length (first 4 bytes, big-endian), then drop the 4-byte header */
+  /* get real length (first 4 bytes, big-endian), then drop the 4-byte header in one move */
   len = 0;
-  len = len
-    | ((pt->data[0])<<24) | ((pt->data[1])<<16)
-    | ((pt->data[2])<<8)  | ((pt->data[3])<<0);
-  g_byte_array_remove_index(pt, 0);
-  g_byte_array_remove_index(pt, 0);
-  g_byte_array_remove_index(pt, 0);
-  g_byte_array_remove_index(pt, 0);
+  if( pt->len >= 4 )
+    len = len
+      | ((pt->data[0])<<24) | ((pt->data[1])<<16)
+      | ((pt->data[2])<<8)  | ((pt->data[3])<<0);
+  if( len > pt->len - 4 || pt->len < 4 )
+    len = pt->len < 4 ? 0 : pt->len - 4;
+  memmove(pt->data, pt->data + 4, len);
 
   g_byte_array_set_size(pt, len);
 
@@ -414,18 +552,12 @@ void die(char* fmt, ...)
     exit(1);
 }
 
-void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len, GByteArray** aes_buf)
+int locate_cpabe_trailer(const guint8* buf, size_t buflen, const char* pattern,
+                         size_t* header_end_out, size_t* trailer_off_out)
 {
-
-    int i, len;
-    const char* data = (const char*)buffer->data;
-    size_t buflen = buffer->len;
+    const char* data = (const char*)buf;
     size_t pos = 0;
 
-    *cph_buf = g_byte_array_new();
-    *aes_buf = g_byte_array_new();
-
-
     // ---- parse header to get vertex_count, full_stride, header_end, and sizes of x/y/z ----
     int vcount = 0;
     int full_stride = 0;
@@ -434,9 +566,9 @@ void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len,
     int in_vertex = 0;
     while (pos < buflen) {
         // Find next line
-        size_t line_start = pos;
         char* endl = memchr(data + pos, '\n', buflen - pos);
-        size_t line_len = endl ? (size_t)(endl - (data + pos)) : (buflen - pos);
+        if (!endl) return 1; // header continues past what we have
+        size_t line_len = (size_t)(endl - (data + pos));
         char line[256] = {0};
         size_t copy_len = line_len < 255 ? line_len : 255;
         memcpy(line, data + pos, copy_len);
@@ -457,53 +589,667 @@ void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len,
                 else if (!strcmp(n,"z")) sz_z = ts;
             }
         }
+        pos += line_len + 1;
         if (strstr(line, "end_header")) {
-            header_end = (endl ? (size_t)(endl - data) + 1 : buflen);
+            header_end = pos;
             break;
         }
-        pos += (endl ? (size_t)(endl - (data + pos)) + 1 : buflen - pos);
     }
-    if (vcount <= 0 || full_stride <= 0 || header_end <= 0)
-        die("parse_cpabe_buffer: bad PLY header\n");
+    if (header_end == 0) return 1;
+    if (vcount <= 0 || full_stride <= 0) return -1;
 
-    EncryptPattern pat = parse_pattern(pattern_arg ? pattern_arg : "");
+    EncryptPattern pat = parse_pattern(pattern ? pattern : "");
     int stripped_per_vertex = 0;
     if (pat.encrypt_x) stripped_per_vertex += sz_x;
     if (pat.encrypt_y) stripped_per_vertex += sz_y;
     if (pat.encrypt_z) stripped_per_vertex += sz_z;
     int reduced_stride = full_stride - stripped_per_vertex;
-    if (reduced_stride < 0)
-        die("parse_cpabe_buffer: negative reduced stride (bad scheme?)\n");
+    if (reduced_stride < 0) return -1;
 
     // ---- direct seek to trailer: header_end + vcount * reduced_stride ----
-    size_t trailer_off = header_end + (size_t)vcount * (size_t)reduced_stride;
-    if (trailer_off >= buflen)
-        die("parse_cpabe_buffer: trailer offset out of bounds\n");
+    if (header_end_out) *header_end_out = header_end;
+    *trailer_off_out = header_end + (size_t)vcount * (size_t)reduced_stride;
+    return 0;
+}
+
+#define CPABE_MARKER "comment encrypted"
+
+int locate_cpabe_cph(const guint8* buf, size_t buflen, size_t* cph_off)
+{
+    const char* data = (const char*)buf;
+    size_t mlen = strlen(CPABE_MARKER);
+    int i;
+    guint32 len = 0;
 
     // verify marker
-    const char* marker = "comment encrypted";
-    size_t mlen = strlen(marker);
-    if (trailer_off+mlen > buflen || memcmp(data+trailer_off, marker, mlen) != 0)
-        die("parse_cpabe_buffer: trailer marker not found at computed offset\n");
-    // Set position to start of length fields after marker
-    pos = trailer_off + mlen;
-
-    // Skip 4 bytes for file_len (unused)
-    pos += 4;
-
-    // Read aes_buf
-    len = 0; for (i = 3; i >= 0; i--) len |= ((unsigned char)data[pos++]) << (i * 8);
-    g_byte_array_set_size(*aes_buf, (gsize)len);
-    if (pos+len > buflen)
-        die("parse_cpabe_buffer: failed to read aes_buf\n");
-    memcpy((*aes_buf)->data, data+pos, len);
-    pos += len;
-
-    // Read cph_buf
-    len = 0; for (i = 3; i >= 0; i--) len |= ((unsigned char)data[pos++]) << (i * 8);
+    if (buflen < mlen) return 1;
+    if (memcmp(data, CPABE_MARKER, mlen) != 0) return -1;
+    // marker, then 4 bytes file_len (unused), then 4 bytes aes length
+    if (buflen < mlen + 8) return 1;
+    size_t pos = mlen + 4;
+    for (i = 3; i >= 0; i--) len |= ((guint32)(unsigned char)data[pos++]) << (i * 8);
+    *cph_off = pos + len;
+    return 0;
+}
+
+int read_cpabe_cph(const guint8* buf, size_t buflen, GByteArray** cph_buf)
+{
+    int i;
+    guint32 len = 0;
+    *cph_buf = scratch_bytes(buflen >= 4 ? buflen - 4 : 0);
+    if (buflen < 4) return -1;
+    for (i = 3; i >= 0; i--) len |= ((guint32)buf[3 - i]) << (i * 8);
+    if (4 + (size_t)len > buflen) return -1;
     g_byte_array_set_size(*cph_buf, (gsize)len);
-    if (pos+len > buflen)
-        die("parse_cpabe_buffer: failed to read cph_buf\n");
-    memcpy((*cph_buf)->data, data+pos, len);
-    pos += len;
+    memcpy((*cph_buf)->data, buf + 4, len);
+    return 0;
+}
+
+int parse_cpabe_trailer(const guint8* buf, size_t buflen, GByteArray** cph_buf, GByteArray** aes_buf)
+{
+    size_t cph_off = 0;
+    size_t aes_off = strlen(CPABE_MARKER) + 8;
+
+    if (locate_cpabe_cph(buf, buflen, &cph_off) != 0 || cph_off > buflen || cph_off < aes_off) {
+        *aes_buf = scratch_bytes(0);
+        *cph_buf = scratch_bytes(0);
+        return -1;
+    }
+    *aes_buf = scratch_bytes(cph_off - aes_off);
+    // Read aes_buf, then cph_buf
+    g_byte_array_append(*aes_buf, buf + aes_off, (guint)(cph_off - aes_off));
+    return read_cpabe_cph(buf + cph_off, buflen - cph_off, cph_buf);
+}
+
+void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len, GByteArray** aes_buf)
+{
+    (void)file_len;
+    parse_cpabe_view(buffer->data, buffer->len, cph_buf, aes_buf);
+}
+
+void parse_cpabe_view(const guint8* buf, size_t buflen, GByteArray** cph_buf, GByteArray** aes_buf)
+{
+    size_t trailer_off = 0;
+
+    if (locate_cpabe_trailer(buf, buflen, pattern_arg, NULL, &trailer_off) != 0)
+        die("parse_cpabe_buffer: bad PLY header\n");
+    if (trailer_off >= buflen)
+        die("parse_cpabe_buffer: trailer offset out of bounds\n");
+    if (parse_cpabe_trailer(buf + trailer_off, buflen - trailer_off, cph_buf, aes_buf) != 0)
+        die("parse_cpabe_buffer: trailer marker not found or truncated at computed offset\n");
+}
+
+/* ---- .vvs container ---- */
+
+static void put_le(guint8* p, guint64 v, int n)
+{
+    for (int i = 0; i < n; i++) p[i] = (guint8)(v >> (8 * i));
+}
+
+static guint64 get_le(const guint8* p, int n)
+{
+    guint64 v = 0;
+    for (int i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* the legacy trailer's length fields are big-endian */
+static guint32 get_be32(const guint8* p)
+{
+    return (guint32)p[0] << 24 | (guint32)p[1] << 16 | (guint32)p[2] << 8 | (guint32)p[3];
+}
+
+/* Fill the layout part of a prologue (strides, vertex count, segments, header length) from the
+ * PLY header at the start of buf. Returns 0, or -1 if the header is missing or unsupported. */
+static int vvs_layout(const guint8* buf, size_t buflen, EncryptPattern pat, VvsPrologue* p)
+{
+    const char* data = (const char*)buf;
+    size_t pos = 0;
+    int vcount = 0, in_vertex = 0, nseg = 0, ncoord = 0;
+    int full_stride = 0, red_base = 0, coord_base = 0;
+    VvsSegment segs[64];
+    guint8 coord_size[3] = { 0, 0, 0 };
+
+    while (pos < buflen) {
+        char* endl = memchr(data + pos, '\n', buflen - pos);
+        if (!endl) return -1;
+        size_t line_len = (size_t)(endl - (data + pos));
+        char line[256];
+        size_t copy_len = line_len < 255 ? line_len : 255;
+        memcpy(line, data + pos, copy_len);
+        line[copy_len] = 0;
+        pos += line_len + 1;
+
+        if (!strncmp(line, "element vertex", 14)) {
+            sscanf(line, "element vertex %d", &vcount);
+            in_vertex = 1;
+        } else if (!strncmp(line, "element ", 8)) {
+            in_vertex = 0;
+        } else if (in_vertex && !strncmp(line, "property", 8)) {
+            char t[32], n[32];
+            if (sscanf(line, "property %31s %31s", t, n) == 2) {
+                if (nseg >= 64) return -1;
+                int ts = type_size(t);
+                int stripped = (!strcmp(n, "x") && pat.encrypt_x) ||
+                               (!strcmp(n, "y") && pat.encrypt_y) ||
+                               (!strcmp(n, "z") && pat.encrypt_z);
+                if (stripped && ncoord++ < 3)
+                    coord_size[ncoord - 1] = (guint8)ts;
+                nseg = push_segment(segs, nseg, stripped, ts, &red_base, &coord_base);
+                full_stride += ts;
+            }
+        }
+        if (strstr(line, "end_header")) {
+            if (vcount <= 0 || full_stride <= 0 || nseg > VVS_MAX_SEGMENTS || full_stride > 0xffff)
+                return -1;
+            p->pattern = (guint8)((pat.encrypt_x ? VVS_PATTERN_X : 0) |
+                                  (pat.encrypt_y ? VVS_PATTERN_Y : 0) |
+                                  (pat.encrypt_z ? VVS_PATTERN_Z : 0));
+            p->vertex_count = (guint32)vcount;
+            p->stride_full = (guint16)full_stride;
+            p->stride_reduced = (guint16)red_base;
+            p->header_len = pos;
+            p->nseg = (guint8)nseg;
+            memcpy(p->segs, segs, (size_t)nseg * sizeof(VvsSegment));
+            p->quant.ncoord = (guint8)ncoord;  /* coordinate record layout, for quantization */
+            memcpy(p->quant.size, coord_size, sizeof(coord_size));
+            return 0;
+        }
+    }
+    return -1;
+}
+
+GByteArray* strip_ply_buffer(const guint8* buf, size_t buflen, EncryptPattern pat, GByteArray** reduced)
+{
+    VvsPrologue p;
+    memset(&p, 0, sizeof(p));
+    *reduced = NULL;
+
+    if (buflen < 4 || memcmp(buf, "ply", 3) != 0) {
+        fprintf(stderr, "strip: not a PLY file\n");
+        return NULL;
+    }
+    if (vvs_layout(buf, buflen, pat, &p) != 0 || p.stride_full == p.stride_reduced) {
+        fprintf(stderr, "strip: unsupported PLY header or nothing to strip\n");
+        return NULL;
+    }
+    if (!g_strstr_len((const char*)buf, (gssize)p.header_len, "format binary_little_endian")) {
+        fprintf(stderr, "strip: only binary_little_endian PLY files are supported\n");
+        return NULL;
+    }
+    /* the trailer is located at header_end + vcount * reduced_stride, so nothing may follow
+     * the vertex rows (faces, other elements) */
+    size_t rows = (size_t)p.vertex_count * p.stride_full;
+    if (p.header_len + rows != buflen) {
+        fprintf(stderr, "strip: %zu bytes after the header, expected %zu vertex bytes only\n",
+                buflen - (size_t)p.header_len, rows);
+        return NULL;
+    }
+
+    const int strip_per_vertex = p.stride_full - p.stride_reduced;
+    guint32 datalen = p.vertex_count * (guint32)strip_per_vertex;
+    GByteArray* payload = g_byte_array_sized_new(4 + datalen);
+    g_byte_array_set_size(payload, 4 + datalen);
+    memcpy(payload->data, &datalen, 4);
+
+    GByteArray* red = g_byte_array_sized_new((guint)(p.header_len +
+                                             (guint64)p.vertex_count * p.stride_reduced));
+    g_byte_array_set_size(red, (guint)(p.header_len + (guint64)p.vertex_count * p.stride_reduced));
+    memcpy(red->data, buf, (size_t)p.header_len);
+
+    const guint8* row = buf + p.header_len;
+    guint8* redrow = red->data + p.header_len;
+    guint8* coordrow = payload->data + 4;
+    for (guint32 v = 0; v < p.vertex_count; v++) {
+        int in_off = 0;
+        for (int s = 0; s < p.nseg; s++) {
+            const VvsSegment* seg = &p.segs[s];
+            if (seg->src == 0) memcpy(redrow + seg->red_base, row + in_off, seg->bytes);
+            else               memcpy(coordrow + seg->coord_base, row + in_off, seg->bytes);
+            in_off += seg->bytes;
+        }
+        row += p.stride_full;
+        redrow += p.stride_reduced;
+        coordrow += strip_per_vertex;
+    }
+    *reduced = red;
+    return payload;
+}
+
+GByteArray* process_and_encrypt_ply(char* in_file, char* out_file, EncryptPattern pat)
+{
+    GByteArray* ply = suck_file(in_file);
+    GByteArray* reduced = NULL;
+    GByteArray* payload = strip_ply_buffer(ply->data, ply->len, pat, &reduced);
+    g_byte_array_free(ply, 1);
+    if (!payload)
+        die("%s: cannot strip coordinates\n", in_file);
+
+    FILE* f = fopen(out_file, "wb");
+    if (!f)
+        die("can't write file: %s\n", out_file);
+    if (fwrite(reduced->data, 1, reduced->len, f) != reduced->len)
+        die("short write on %s\n", out_file);
+    fclose(f);
+    g_byte_array_free(reduced, 1);
+    return payload;
+}
+
+static void append_be32(GByteArray* b, guint32 v)
+{
+    guint8 x[4] = { (guint8)(v >> 24), (guint8)(v >> 16), (guint8)(v >> 8), (guint8)v };
+    g_byte_array_append(b, x, 4);
+}
+
+void append_cpabe_trailer(GByteArray* out, GByteArray* cph_buf, int file_len, GByteArray* aes_buf)
+{
+    g_byte_array_append(out, (const guint8*)CPABE_MARKER, (guint)strlen(CPABE_MARKER));
+    append_be32(out, (guint32)file_len);
+    append_be32(out, aes_buf->len);
+    g_byte_array_append(out, aes_buf->data, aes_buf->len);
+    append_be32(out, cph_buf->len);
+    g_byte_array_append(out, cph_buf->data, cph_buf->len);
+}
+
+void write_cpabe_file(char* file, GByteArray* cph_buf, int file_len, GByteArray* aes_buf)
+{
+    GByteArray* trailer = g_byte_array_new();
+    append_cpabe_trailer(trailer, cph_buf, file_len, aes_buf);
+    spit_file(file, trailer, 1); /* appends to the reduced PLY */
+}
+
+int vvs_read_prologue(const guint8* buf, size_t buflen, VvsPrologue* p)
+{
+    if (buflen < 4) return 1;
+    if (memcmp(buf, VVS_MAGIC, 4) != 0) return -1;
+    if (buflen < VVS_FIXED_LEN) return 1;
+
+    memset(p, 0, sizeof(*p));
+    p->version      = (guint16)get_le(buf + 4, 2);
+    p->prologue_len = (guint16)get_le(buf + 6, 2);
+    p->pattern      = buf[8];
+    p->nseg         = buf[9];
+    if (p->version != VVS_VERSION && p->version != VVS_VERSION_GOP && p->version != VVS_VERSION_QUANT) {
+        fprintf(stderr, "vvs: unsupported container version %u\n", p->version);
+        return -1;
+    }
+    size_t seg_table = VVS_FIXED_LEN + (p->version != VVS_VERSION ? VVS_KEYREF_LEN : 0) +
+                       (p->version == VVS_VERSION_QUANT ? VVS_QUANT_LEN : 0);
+    if (p->nseg == 0 || p->nseg > VVS_MAX_SEGMENTS ||
+        p->prologue_len != seg_table + 8 * p->nseg) return -1;
+    if (buflen < p->prologue_len) return 1;
+
+    p->vertex_count   = (guint32)get_le(buf + 12, 4);
+    p->stride_full    = (guint16)get_le(buf + 16, 2);
+    p->stride_reduced = (guint16)get_le(buf + 18, 2);
+    p->payload_len    = (guint32)get_le(buf + 20, 4);
+    guint64* sect[8] = { &p->header_off, &p->header_len, &p->rows_off, &p->rows_len,
+                         &p->aes_off, &p->aes_len, &p->cph_off, &p->cph_len };
+    for (int i = 0; i < 8; i++) *sect[i] = get_le(buf + 24 + 8 * i, 8);
+    if (p->version != VVS_VERSION) {
+        memcpy(p->gop_id, buf + VVS_FIXED_LEN, VVS_GOP_ID_LEN);
+        p->gop_index = (guint32)get_le(buf + VVS_FIXED_LEN + 16, 4);
+        p->flags     = (guint32)get_le(buf + VVS_FIXED_LEN + 20, 4);
+    }
+    /* the quantization parameters exist in version 3 only, and there they are mandatory */
+    int quant = p->version == VVS_VERSION_QUANT;
+    if (!!(p->flags & VVS_FLAG_QUANT) != quant) return -1;
+    int record = 0;
+    if (quant) {
+        const guint8* qb = buf + VVS_FIXED_LEN + VVS_KEYREF_LEN;
+        VvsQuant* q = &p->quant;
+        q->bits   = qb[0];
+        q->ncoord = qb[1];
+        if ((q->bits != 16 && q->bits != 21) || q->ncoord < 1 || q->ncoord > 3) return -1;
+        int npat = !!(p->pattern & VVS_PATTERN_X) + !!(p->pattern & VVS_PATTERN_Y) +
+                   !!(p->pattern & VVS_PATTERN_Z);
+        if (q->ncoord != npat) return -1;
+        for (int k = 0; k < 3; k++) {
+            union { guint64 u; double d; } o, st;
+            o.u  = get_le(qb + 8 + 8 * k, 8);
+            st.u = get_le(qb + 32 + 8 * k, 8);
+            q->size[k]   = qb[2 + k];
+            q->origin[k] = o.d;
+            q->step[k]   = st.d;
+            if (k >= q->ncoord) continue;
+            if ((q->size[k] != 4 && q->size[k] != 8) || !isfinite(o.d) || !isfinite(st.d) || st.d < 0)
+                return -1;
+            record += q->size[k];
+        }
+    }
+
+    int full = 0, red = 0, coord = 0;
+    for (int s = 0; s < p->nseg; s++) {
+        const guint8* e = buf + seg_table + 8 * s;
+        VvsSegment* seg = &p->segs[s];
+        seg->src        = e[0];
+        seg->bytes      = (guint16)get_le(e + 2, 2);
+        seg->red_base   = (guint16)get_le(e + 4, 2);
+        seg->coord_base = (guint16)get_le(e + 6, 2);
+        if (seg->src > 1) return -1;
+        if (seg->src == 0 && seg->red_base + seg->bytes > p->stride_reduced) return -1;
+        if (seg->src == 1 && seg->coord_base + seg->bytes > p->stride_full - p->stride_reduced) return -1;
+        full += seg->bytes;
+        if (seg->src == 0) red += seg->bytes; else coord += seg->bytes;
+    }
+    if (full != p->stride_full || red != p->stride_reduced) return -1;
+    if (p->rows_len != (guint64)p->vertex_count * p->stride_reduced) return -1;
+    if (p->flags & VVS_FLAG_QUANT) {
+        /* the values fill the coordinate record, the payload holds the packed integers */
+        if (record != coord) return -1;
+        coord = (p->quant.ncoord * p->quant.bits + 7) / 8;
+    }
+    if ((guint64)p->payload_len != 4 + (guint64)p->vertex_count * (guint64)coord) return -1;
+    if (p->cph_len < 4 || p->header_off < p->prologue_len) return -1;
+    return 0;
+}
+
+guint64 vvs_file_size(const VvsPrologue* p)
+{
+    guint64 end = p->prologue_len;
+    const guint64 off[4] = { p->header_off, p->rows_off, p->aes_off, p->cph_off };
+    const guint64 len[4] = { p->header_len, p->rows_len, p->aes_len, p->cph_len };
+    for (int i = 0; i < 4; i++)
+        if (off[i] + len[i] > end) end = off[i] + len[i];
+    return end;
+}
+
+GByteArray* vvs_from_cpabe(const guint8* buf, size_t buflen, const char* pattern,
+                           const VvsKeyRef* key_ref, const VvsQuant* quant)
+{
+    VvsPrologue p;
+    size_t header_end = 0, trailer_off = 0, cph_rel = 0;
+    memset(&p, 0, sizeof(p));
+
+    if (locate_cpabe_trailer(buf, buflen, pattern, &header_end, &trailer_off) != 0 ||
+        trailer_off >= buflen)
+        return NULL;
+    if (vvs_layout(buf, header_end, parse_pattern(pattern ? pattern : ""), &p) != 0)
+        return NULL;
+    if (quant && (quant->ncoord != p.quant.ncoord ||
+                  memcmp(quant->size, p.quant.size, quant->ncoord) != 0))
+        return NULL;
+
+    const guint8* trailer = buf + trailer_off;
+    size_t trailer_len = buflen - trailer_off;
+    size_t aes_rel = strlen(CPABE_MARKER) + 8;
+    if (locate_cpabe_cph(trailer, trailer_len, &cph_rel) != 0 || cph_rel + 4 > trailer_len)
+        return NULL;
+    guint32 cph_n = get_be32(trailer + cph_rel);
+    if (cph_rel + 4 + (size_t)cph_n > trailer_len) return NULL;
+
+    size_t seg_table = VVS_FIXED_LEN + (key_ref || quant ? VVS_KEYREF_LEN : 0) +
+                       (quant ? VVS_QUANT_LEN : 0);
+    p.version      = quant ? VVS_VERSION_QUANT : key_ref ? VVS_VERSION_GOP : VVS_VERSION;
+    p.prologue_len = (guint16)(seg_table + 8 * p.nseg);
+    p.payload_len  = get_be32(trailer + strlen(CPABE_MARKER));
+    p.header_off   = p.prologue_len;
+    p.cph_off      = p.header_off + p.header_len;
+    p.cph_len      = 4 + (guint64)cph_n;
+    p.aes_off      = p.cph_off + p.cph_len;
+    p.aes_len      = cph_rel - aes_rel;
+    p.rows_off     = p.aes_off + p.aes_len;
+    p.rows_len     = (guint64)p.vertex_count * p.stride_reduced;
+    if (header_end + p.rows_len != trailer_off) return NULL;
+
+    GByteArray* out = g_byte_array_sized_new((guint)vvs_file_size(&p));
+    g_byte_array_set_size(out, p.prologue_len);
+    guint8* h = out->data;
+    memset(h, 0, p.prologue_len);
+    memcpy(h, VVS_MAGIC, 4);
+    put_le(h + 4, p.version, 2);
+    put_le(h + 6, p.prologue_len, 2);
+    h[8] = p.pattern;
+    h[9] = p.nseg;
+    put_le(h + 12, p.vertex_count, 4);
+    put_le(h + 16, p.stride_full, 2);
+    put_le(h + 18, p.stride_reduced, 2);
+    put_le(h + 20, p.payload_len, 4);
+    const guint64 sect[8] = { p.header_off, p.header_len, p.rows_off, p.rows_len,
+                              p.aes_off, p.aes_len, p.cph_off, p.cph_len };
+    for (int i = 0; i < 8; i++) put_le(h + 24 + 8 * i, sect[i], 8);
+    if (key_ref) {
+        memcpy(h + VVS_FIXED_LEN, key_ref->gop_id, VVS_GOP_ID_LEN);
+        put_le(h + VVS_FIXED_LEN + 16, key_ref->gop_index, 4);
+    }
+    if (key_ref || quant)
+        put_le(h + VVS_FIXED_LEN + 20, (key_ref ? VVS_FLAG_GOP_KEY : 0) | (quant ? VVS_FLAG_QUANT : 0), 4);
+    if (quant) {
+        guint8* qb = h + VVS_FIXED_LEN + VVS_KEYREF_LEN;
+        qb[0] = quant->bits;
+        qb[1] = quant->ncoord;
+        for (int k = 0; k < quant->ncoord; k++) {
+            union { guint64 u; double d; } o, st;
+            o.d = quant->origin[k];
+            st.d = quant->step[k];
+            qb[2 + k] = quant->size[k];
+            put_le(qb + 8 + 8 * k, o.u, 8);
+            put_le(qb + 32 + 8 * k, st.u, 8);
+        }
+    }
+    for (int s = 0; s < p.nseg; s++) {
+        guint8* e = h + seg_table + 8 * s;
+        e[0] = p.segs[s].src;
+        put_le(e + 2, p.segs[s].bytes, 2);
+        put_le(e + 4, p.segs[s].red_base, 2);
+        put_le(e + 6, p.segs[s].coord_base, 2);
+    }
+
+    g_byte_array_append(out, buf, (guint)header_end);                           /* header */
+    g_byte_array_append(out, trailer + cph_rel, (guint)p.cph_len);             /* cph */
+    g_byte_array_append(out, trailer + aes_rel, (guint)p.aes_len);             /* aes */
+    g_byte_array_append(out, buf + header_end, (guint)p.rows_len);             /* rows */
+    return out;
+}
+
+void vvs_gop_id(const guint8* cph_field, size_t len, guint8 gop_id[VVS_GOP_ID_LEN])
+{
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    SHA256(cph_field, len, md);
+    memcpy(gop_id, md, VVS_GOP_ID_LEN);
+}
+
+void vvs_frame_key(element_t m, const guint8 gop_id[VVS_GOP_ID_LEN], guint32 gop_index,
+                   guint8 key[16])
+{
+    static const char label[] = "vvs-frame-key";
+    unsigned char prk[SHA256_DIGEST_LENGTH], okm[SHA256_DIGEST_LENGTH];
+    unsigned char info[sizeof(label) - 1 + 4 + 1];
+    unsigned int n = 0;
+
+    /* HKDF-SHA256 (RFC 5869), one output block: extract with the GOP id as salt, expand with
+     * the frame index */
+    int ikm_len = element_length_in_bytes(m);
+    unsigned char* ikm = (unsigned char*)scratch_alloc(ikm_len > 0 ? ikm_len : 1);
+    element_to_bytes(ikm, m);
+    HMAC(EVP_sha256(), gop_id, VVS_GOP_ID_LEN, ikm, (size_t)ikm_len, prk, &n);
+    memset(ikm, 0, (size_t)ikm_len);
+    scratch_free(ikm);
+
+    memcpy(info, label, sizeof(label) - 1);
+    info[sizeof(label) - 1 + 0] = (unsigned char)(gop_index >> 24);
+    info[sizeof(label) - 1 + 1] = (unsigned char)(gop_index >> 16);
+    info[sizeof(label) - 1 + 2] = (unsigned char)(gop_index >> 8);
+    info[sizeof(label) - 1 + 3] = (unsigned char)gop_index;
+    info[sizeof(label) - 1 + 4] = 0x01;
+    HMAC(EVP_sha256(), prk, SHA256_DIGEST_LENGTH, info, sizeof(info), okm, &n);
+    memcpy(key, okm, 16);
+    memset(prk, 0, sizeof(prk));
+    memset(okm, 0, sizeof(okm));
+}
+
+static double load_coord(const guint8* v, int size)
+{
+    if (size == 4) {
+        float f;
+        memcpy(&f, v, 4);
+        return f;
+    }
+    double d;
+    memcpy(&d, v, 8);
+    return d;
+}
+
+static void store_coord(guint8* v, int size, double x)
+{
+    if (size == 4) {
+        float f = (float)x;
+        memcpy(v, &f, 4);
+    } else {
+        memcpy(v, &x, 8);
+    }
+}
+
+GByteArray* vvs_quantize_payload(const guint8* ply, size_t plylen, EncryptPattern pat,
+                                 const GByteArray* payload, int bits, VvsQuant* q)
+{
+    VvsPrologue p;
+    memset(&p, 0, sizeof(p));
+    if (bits != 16 && bits != 21) {
+        fprintf(stderr, "quantize: %d bits per coordinate unsupported (16 or 21)\n", bits);
+        return NULL;
+    }
+    if (vvs_layout(ply, plylen, pat, &p) != 0 || p.quant.ncoord < 1 || p.quant.ncoord > 3) {
+        fprintf(stderr, "quantize: unsupported PLY header\n");
+        return NULL;
+    }
+    const int n = p.quant.ncoord;
+    const int stride = p.stride_full - p.stride_reduced;
+    int off[3];
+    for (int k = 0, o = 0; k < n; k++) {
+        if (p.quant.size[k] != 4 && p.quant.size[k] != 8) {
+            fprintf(stderr, "quantize: only float or double coordinates can be quantized\n");
+            return NULL;
+        }
+        off[k] = o;
+        o += p.quant.size[k];
+    }
+    guint32 datalen = 0;
+    if (payload->len >= 4) memcpy(&datalen, payload->data, 4);
+    if (payload->len < 4 || (guint64)datalen != (guint64)p.vertex_count * stride ||
+        payload->len - 4 < datalen) {
+        fprintf(stderr, "quantize: payload does not match the PLY header\n");
+        return NULL;
+    }
+
+    /* bounding box of the frame, per coordinate */
+    const guint8* coords = payload->data + 4;
+    double lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (guint32 v = 0; v < p.vertex_count; v++) {
+        const guint8* rec = coords + (size_t)v * stride;
+        for (int k = 0; k < n; k++) {
+            double x = load_coord(rec + off[k], p.quant.size[k]);
+            if (!isfinite(x)) {
+                fprintf(stderr, "quantize: vertex %u has a non-finite coordinate\n", v);
+                return NULL;
+            }
+            if (x < lo[k]) lo[k] = x;
+            if (x > hi[k]) hi[k] = x;
+        }
+    }
+    const guint64 top = ((guint64)1 << bits) - 1;
+    memset(q, 0, sizeof(*q));
+    q->bits = (guint8)bits;
+    q->ncoord = (guint8)n;
+    memcpy(q->size, p.quant.size, sizeof(q->size));
+    for (int k = 0; k < n; k++) {
+        q->origin[k] = lo[k];
+        q->step[k] = (hi[k] - lo[k]) / (double)top;
+    }
+
+    const int record = (n * bits + 7) / 8;
+    guint32 qlen = p.vertex_count * (guint32)record;
+    GByteArray* out = g_byte_array_sized_new(4 + qlen);
+    g_byte_array_set_size(out, 4 + qlen);
+    memcpy(out->data, &qlen, 4);
+    guint8* dst = out->data + 4;
+    for (guint32 v = 0; v < p.vertex_count; v++) {
+        const guint8* rec = coords + (size_t)v * stride;
+        guint64 word = 0;
+        for (int k = 0; k < n; k++) {
+            guint64 iq = 0;
+            if (q->step[k] > 0) {
+                double t = (load_coord(rec + off[k], q->size[k]) - lo[k]) / q->step[k] + 0.5;
+                iq = t >= (double)top ? top : (guint64)t;
+            }
+            word |= iq << (k * bits);
+        }
+        put_le(dst, word, record);
+        dst += record;
+    }
+    return out;
+}
+
+/* Expand a quantized payload (after its length field) into raw coordinate records, laid out as
+ * the segment table expects. Scratch, vertex_count * coordinate stride bytes. */
+static guint8* vvs_dequantize(const VvsPrologue* p, const guint8* packed)
+{
+    const VvsQuant* q = &p->quant;
+    const int stride = p->stride_full - p->stride_reduced;
+    const int record = (q->ncoord * q->bits + 7) / 8;
+    const guint64 mask = ((guint64)1 << q->bits) - 1;
+    guint8* raw = (guint8*)scratch_alloc((size_t)p->vertex_count * (size_t)stride);
+    if (!raw) die("OOM\n");
+
+    int off[3];
+    for (int k = 0, o = 0; k < q->ncoord; k++) {
+        off[k] = o;
+        o += q->size[k];
+    }
+    guint8* dst = raw;
+    for (guint32 v = 0; v < p->vertex_count; v++) {
+        guint64 word = get_le(packed, record);
+        for (int k = 0; k < q->ncoord; k++) {
+            guint64 iq = (word >> (k * q->bits)) & mask;
+            store_coord(dst + off[k], q->size[k], q->origin[k] + (double)iq * q->step[k]);
+        }
+        packed += record;
+        dst += stride;
+    }
+    return raw;
+}
+
+GByteArray* restore_vvs_with_coords(const guint8* buf, size_t buflen, const VvsPrologue* p,
+                                    const char* out_file, GByteArray* decvals, GByteArray* into)
+{
+    if (vvs_file_size(p) > buflen) {
+        fprintf(stderr, "vvs: container truncated (%zu of %llu bytes)\n",
+                buflen, (unsigned long long)vvs_file_size(p));
+        return NULL;
+    }
+    guint32 datalen = 0;
+    if (decvals->len < 4) return NULL;
+    memcpy(&datalen, decvals->data, 4);
+    if (datalen + 4 != p->payload_len || (size_t)decvals->len - 4 < datalen) {
+        fprintf(stderr, "coord payload len (%u) != expected (%u)\n", datalen, p->payload_len - 4);
+        return NULL;
+    }
+
+    FILE* out = NULL;
+    if (out_file) {
+        out = fopen(out_file, "wb");
+        if (!out) fprintf(stderr, "Failed to open output file: %s\n", out_file);
+    }
+    size_t full_len = (size_t)(p->header_len + (guint64)p->vertex_count * p->stride_full);
+    GByteArray* ply_buf = into;
+    if (ply_buf) {
+        g_byte_array_set_size(ply_buf, (guint)full_len); // reserve
+        g_byte_array_set_size(ply_buf, 0);
+    } else {
+        ply_buf = scratch_bytes(full_len);
+    }
+    g_byte_array_append(ply_buf, buf + p->header_off, (guint)p->header_len);
+    if (out) fwrite(buf + p->header_off, 1, (size_t)p->header_len, out);
+
+    guint8* raw = (p->flags & VVS_FLAG_QUANT) ? vvs_dequantize(p, decvals->data + 4) : NULL;
+    int rc = interleave_rows(ply_buf, out, buf + p->rows_off, (size_t)p->rows_len,
+                             raw ? raw : decvals->data + 4, (int)p->vertex_count,
+                             p->stride_full, p->stride_reduced, p->segs, p->nseg);
+    if (raw) scratch_free(raw);
+    if (out) fclose(out);
+    if (rc != 0) {
+        if (!into) scratch_free_bytes(ply_buf);
+        return NULL;
+    }
+    return ply_buf;
 }
@@ -1,5 +1,3 @@
-// In-memory version of read_cpabe_file
-void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len, GByteArray** aes_buf);
 #pragma once
 #include <glib.h>
 #include <pbc.h>
@@ -40,6 +38,12 @@ typedef struct {
  * Encrypt-time processing: read header, strip coords, write reduced PLY,
  * and return a byte array containing payload (original values to encrypt).
  */
+GByteArray* process_and_encrypt_ply(char* in_file, char* out_file, EncryptPattern pat);
+
+/* In-memory strip of a binary_little_endian, vertex-only PLY: *reduced gets the unchanged
+ * header and the reduced vertex rows, the return value is the payload to encrypt,
+ * [uint32 datalen][stripped values per vertex]. NULL (with a message) if unsupported. */
+GByteArray* strip_ply_buffer(const guint8* buf, size_t buflen, EncryptPattern pat, GByteArray** reduced);
 
 
 /**
@@ -53,6 +57,12 @@ GByteArray* restore_ply_with_coords(
 );
 
 
+/* restore_ply_with_coords() on a read-only view of the reduced PLY (e.g. an mmap). The rebuilt
+ * PLY replaces the contents of into (must not overlap the view) and is returned; into = NULL
+ * allocates it with scratch_bytes(). */
+GByteArray* restore_ply_view(const guint8* reduced, size_t buflen, const char* out_file,
+                             GByteArray* decvals, EncryptPattern pat, GByteArray* into);
+
 /* Portable fallback: rebuild a full PLY by streaming reduced rows and
  * interleaving decrypted prefixes, writing to 'out_ply'. Slower but works everywhere.
  */
@@ -70,11 +80,210 @@ GByteArray* suck_file(char* file);
 void spit_file(char* file, GByteArray* b, int free);
 
 void read_cpabe_file(char* file, GByteArray** cph_buf, int* file_len, GByteArray** aes_buf);
+
+/* Append the trailer (layout below) to out / to the reduced PLY already written to file. */
+void append_cpabe_trailer(GByteArray* out, GByteArray* cph_buf, int file_len, GByteArray* aes_buf);
+void write_cpabe_file(char* file, GByteArray* cph_buf, int file_len, GByteArray* aes_buf);
+
+// In-memory version of read_cpabe_file
+void parse_cpabe_buffer(GByteArray* buffer, GByteArray** cph_buf, int* file_len, GByteArray** aes_buf);
+// Same on a read-only view of the frame
+void parse_cpabe_view(const guint8* buf, size_t buflen, GByteArray** cph_buf, GByteArray** aes_buf);
+
+/* Trailer offset ("comment encrypted" marker) of a .ply.cpabe from the PLY header at the start
+ * of buf: header_end + vertex_count * reduced_stride for the given pattern.
+ * Returns 0 on success, 1 if buf ends before end_header, -1 on a malformed header.
+ * Lets a client fetch the trailer with an HTTP Range before the vertex rows. */
+int locate_cpabe_trailer(const guint8* buf, size_t buflen, const char* pattern,
+                         size_t* header_end, size_t* trailer_off);
+
+/* Trailer layout: "comment encrypted", uint32 file_len, uint32 aes_len, aes_buf,
+ * uint32 cph_len, cph_buf (lengths big-endian). */
+
+/* Offset of the cph_len field relative to the trailer start (buf starts at the marker), so the
+ * small CP-ABE ciphertext can be fetched ahead of the AES buffer.
+ * Returns 0, 1 if buf ends before the length fields, -1 if the marker is missing. */
+int locate_cpabe_cph(const guint8* buf, size_t buflen, size_t* cph_off);
+
+/* Read [uint32 cph_len][cph] into cph_buf. Returns 0, or -1 if truncated. */
+int read_cpabe_cph(const guint8* buf, size_t buflen, GByteArray** cph_buf);
+
+/* Split a trailer (buf starts at the marker) into aes_buf and cph_buf.
+ * Returns 0, or -1 if the marker is missing or the trailer is truncated. */
+int parse_cpabe_trailer(const guint8* buf, size_t buflen, GByteArray** cph_buf, GByteArray** aes_buf);
+
+/* ---- .vvs container ----
+ * A frame laid out for direct access: a fixed little-endian prologue that records where every
+ * part of the file is and the row layout the restore needs, so a reader never scans the PLY
+ * header or computes the trailer offset from the pattern.
+ *
+ *   off  size
+ *     0     4  magic "VVSC"
+ *     4     2  version (VVS_VERSION)
+ *     6     2  prologue length in bytes (fixed part + segment table)
+ *     8     1  pattern bits (VVS_PATTERN_X|Y|Z)
+ *     9     1  segment count
+ *    10     2  reserved (0)
+ *    12     4  vertex count
+ *    16     2  full stride (bytes per vertex)
+ *    18     2  reduced stride
+ *    20     4  plaintext payload length, [uint32 datalen][coords] (the legacy file_len)
+ *    24    64  8 x uint64: header, rows, aes, cph offsets and lengths (in that order)
+ *    88   8*n  segment table, one VvsSegment per run of reduced or decrypted bytes in a row
+ *
+ * Version 2 (group-of-frames keys, cpabe-pack -g) inserts a key reference before the table:
+ *    88    16  GOP id: first 16 bytes of SHA-256 over the cph field, shared by the group
+ *   104     4  index of the frame in its group
+ *   108     4  flags (VVS_FLAG_GOP_KEY)
+ *   112   8*n  segment table
+ * With VVS_FLAG_GOP_KEY the AES key is not the CP-ABE session key itself but
+ * HKDF-SHA256(session key, salt = GOP id, info = "vvs-frame-key" || uint32be index), so one
+ * bswabe_dec unlocks the group while every frame keeps its own AES key.
+ *
+ * Version 3 (quantized coordinates, cpabe-pack/cpabe-enc -q) always has the key reference (GOP
+ * id and index zero unless VVS_FLAG_GOP_KEY is set) and adds the quantization parameters:
+ *   112     1  bits per coordinate (16 or 21)
+ *   113     1  quantized coordinates per vertex (n, in record order)
+ *   114     3  byte size of each coordinate in the PLY (4 = float, 8 = double)
+ *   117     3  reserved (0)
+ *   120    24  3 x float64: origin (bounding box minimum) per coordinate
+ *   144    24  3 x float64: step, (max - min) / (2^bits - 1) per coordinate
+ *   168   8*n  segment table
+ * flags then include VVS_FLAG_QUANT. The payload holds one ceil(n * bits / 8)-byte record per
+ * vertex instead of the raw values: coordinate k is the integer round((v - origin) / step) at
+ * bit k * bits of the little-endian record. The rebuild writes origin + q * step back in the
+ * PLY's type, so each coordinate is within step / 2 of the original (plus float rounding) and
+ * the segment table still describes the unquantized rows.
+ *
+ * The sections follow in the order header, cph, aes, rows so the small part a client needs to
+ * start the key unwrap sits right after the prologue. The cph section keeps the legacy framing
+ * [uint32 cph_len][cph] so both formats share the same unwrap code. */
+#define VVS_MAGIC        "VVSC"
+#define VVS_VERSION      1
+#define VVS_VERSION_GOP  2
+#define VVS_VERSION_QUANT 3
+#define VVS_FIXED_LEN    88
+#define VVS_KEYREF_LEN   24
+#define VVS_QUANT_LEN    56
+#define VVS_MAX_SEGMENTS 16
+#define VVS_PROLOGUE_MAX (VVS_FIXED_LEN + VVS_KEYREF_LEN + VVS_QUANT_LEN + 8 * VVS_MAX_SEGMENTS)
+#define VVS_GOP_ID_LEN   16
+
+#define VVS_FLAG_GOP_KEY 1
+#define VVS_FLAG_QUANT   2
+
+#define VVS_PATTERN_X 1
+#define VVS_PATTERN_Y 2
+#define VVS_PATTERN_Z 4
+
+typedef struct {
+    guint8  src;          // 0 = reduced row, 1 = decrypted coordinates
+    guint16 bytes;
+    guint16 red_base;     // offset in the reduced row (src 0)
+    guint16 coord_base;   // offset in the per-vertex coordinate record (src 1)
+} VvsSegment;
+
+/* Coordinate quantization of a version 3 container. */
+typedef struct {
+    guint8  bits;         // 16 or 21
+    guint8  ncoord;       // quantized coordinates per vertex
+    guint8  size[3];      // 4 = float, 8 = double
+    double  origin[3];
+    double  step[3];
+} VvsQuant;
+
+typedef struct {
+    guint16 version;
+    guint16 prologue_len;
+    guint8  pattern;
+    guint8  nseg;
+    guint32 vertex_count;
+    guint16 stride_full;
+    guint16 stride_reduced;
+    guint32 payload_len;
+    guint64 header_off, header_len;   // PLY header, end_header line included
+    guint64 rows_off, rows_len;       // reduced vertex rows
+    guint64 aes_off, aes_len;         // AES-encrypted coordinate payload
+    guint64 cph_off, cph_len;         // [uint32 cph_len][cph]
+    guint8  gop_id[VVS_GOP_ID_LEN];   // version 2 and 3 only
+    guint32 gop_index;
+    guint32 flags;
+    VvsQuant quant;                   // version 3 only
+    VvsSegment segs[VVS_MAX_SEGMENTS];
+} VvsPrologue;
+
+/* Key reference of a frame encrypted with a group key (version 2). */
+typedef struct {
+    guint8  gop_id[VVS_GOP_ID_LEN];
+    guint32 gop_index;
+} VvsKeyRef;
+
+/* Parse the prologue at the start of buf. Returns 0, 1 if buf is shorter than the prologue,
+ * -1 if buf is not a .vvs container or the prologue is inconsistent. */
+int vvs_read_prologue(const guint8* buf, size_t buflen, VvsPrologue* p);
+
+/* End of the last section, i.e. the container size the prologue describes. */
+guint64 vvs_file_size(const VvsPrologue* p);
+
+/* Repack a legacy .ply.cpabe buffer (reduced PLY + trailer) encrypted with pattern into a .vvs
+ * container. Needs no keys: the ciphertexts are copied as they are. With key_ref (AES buffer
+ * encrypted under a vvs_frame_key()) a version 2 prologue is written, with quant (payload from
+ * vvs_quantize_payload()) a version 3 one. NULL on malformed input. */
+GByteArray* vvs_from_cpabe(const guint8* buf, size_t buflen, const char* pattern,
+                           const VvsKeyRef* key_ref, const VvsQuant* quant);
+
+/* Quantize a strip_ply_buffer() payload to bits (16 or 21) per coordinate relative to the
+ * frame's bounding box; ply is the original or reduced PLY (only its header is read). Returns
+ * the new payload and fills *q, or NULL (with a message) for non-float coordinates or values
+ * that are not finite. The payload must then go into a version 3 container. */
+GByteArray* vvs_quantize_payload(const guint8* ply, size_t plylen, EncryptPattern pat,
+                                 const GByteArray* payload, int bits, VvsQuant* q);
+
+/* GOP id of a cph field ([uint32 cph_len][cph], as stored in the container). */
+void vvs_gop_id(const guint8* cph_field, size_t len, guint8 gop_id[VVS_GOP_ID_LEN]);
+
+/* Per-frame AES-128 key of a group: HKDF-SHA256 over the session key (see above). */
+void vvs_frame_key(element_t m, const guint8 gop_id[VVS_GOP_ID_LEN], guint32 gop_index,
+                   guint8 key[16]);
+
+/* Rebuild the full PLY from a .vvs buffer and its decrypted coordinate payload using the
+ * prologue's layout (no header parsing), dequantizing it first for VVS_FLAG_QUANT.
+ * Optionally writes it to out_file. NULL on bad sizes.
+ * The PLY replaces the contents of into (must not overlap buf), or a scratch_bytes() array
+ * when into is NULL. */
+GByteArray* restore_vvs_with_coords(const guint8* buf, size_t buflen, const VvsPrologue* p,
+                                    const char* out_file, GByteArray* decvals, GByteArray* into);
+
 void die(char* fmt, ...);
 
 GByteArray* aes_128_cbc_encrypt(GByteArray* pt, element_t k);
 GByteArray* aes_128_cbc_decrypt(GByteArray* ct, element_t k);
 
+/* Same, with a raw 128-bit key (vvs_frame_key()) instead of the CP-ABE session key. */
+GByteArray* aes_128_cbc_encrypt_raw(GByteArray* pt, const guint8 key[16]);
+GByteArray* aes_128_cbc_decrypt_raw(GByteArray* ct, const guint8 key[16]);
+
+/* ---- Per-frame scratch arena ----
+ * Decrypting one frame takes a dozen short-lived buffers: the cph and AES copies, the AES
+ * plaintext, the rebuilt PLY, the property/segment tables and the row batches. Between
+ * scratch_begin() and scratch_end() the helpers above (parse_cpabe_buffer, read_cpabe_cph,
+ * parse_cpabe_trailer, aes_128_cbc_decrypt*, restore_*) take them from the calling thread's
+ * bump arena instead of malloc. scratch_end() drops them all at once and keeps the memory, so
+ * after the first frames a decrypt worker no longer touches the allocator (no lock contention
+ * between workers, no fragmentation over long runs). Anything returned inside the bracket is
+ * only valid until scratch_end(); copy out what must survive it.
+ * Outside a bracket the same helpers allocate normally and the caller frees as before. */
+void        scratch_begin(void);
+void        scratch_end(void);
+void*       scratch_alloc(size_t n);            /* 16-byte aligned */
+void        scratch_free(void* p);              /* no-op inside a bracket */
+GByteArray* scratch_bytes(size_t n);            /* empty, room for n bytes */
+void        scratch_free_bytes(GByteArray* a);  /* no-op inside a bracket */
+/* Free the calling thread's arena; call before a decrypt thread exits. */
+void        scratch_release(void);
+/* Largest frame footprint seen by any thread, and how often an arena had to grow. */
+void        scratch_stats(size_t* peak_bytes, int* grows);
+
 extern char* pattern_arg;
 
 #define CPABE_VERSION PACKAGE_NAME "%s " PACKAGE_VERSION "\n" \
@@ -17,8 +17,8 @@ char* usage =
 "Encrypt FILE under the decryption policy POLICY using public key\n"
 "PUB_KEY. SCHEME specifies which coordinate(s) to encrypt/strip.\n"
 "\n"
-"The encrypted file will be written to FILE.cpabe unless the -o option\n"
-"is used. The original file will be removed unless -k is given.\n"
+"The encrypted file will be written to FILE.cpabe (FILE.vvs with -V) unless\n"
+"the -o option is used. The original file will be removed unless -k is given.\n"
 "\n"
 "SCHEME must be one of: x, y, z, xy, yz, xyz\n"
 "\n"
@@ -27,6 +27,10 @@ char* usage =
 " -v, --version            print version information\n\n"
 " -k, --keep-input-file    don't delete original file\n\n"
 " -o, --output FILE        write resulting file to FILE\n\n"
+" -V, --vvs                write a .vvs container (prologue with section\n"
+"                          offsets and row layout) instead of .ply.cpabe\n\n"
+" -q, --quantize BITS      encrypt the coordinates as BITS-bit integers (16 or\n"
+"                          21) relative to the bounding box (lossy; implies -V)\n\n"
 " -d, --deterministic      use deterministic \"random\" numbers\n"
 "                          (only for debugging)\n\n";
 
@@ -34,6 +38,8 @@ char* pub_file = NULL;
 char* in_file = NULL;
 char* out_file = NULL;
 int   keep = 0;
+int   vvs = 0;
+int   quant_bits = 0;
 char* policy = NULL;
 char* pattern_arg = NULL;
 
@@ -60,6 +66,14 @@ static void parse_args(int argc, char** argv) {
                 else
                     out_file = argv[i];
             }
+            else if (!strcmp(argv[i], "-V") || !strcmp(argv[i], "--vvs")) {
+                vvs = 1;
+            }
+            else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quantize")) {
+                if (++i >= argc || ((quant_bits = atoi(argv[i])) != 16 && quant_bits != 21))
+                    die(usage);
+                vvs = 1; /* the parameters live in the .vvs prologue */
+            }
             else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic")) {
                 pbc_random_set_deterministic(0);
             }
@@ -83,7 +97,7 @@ static void parse_args(int argc, char** argv) {
         die("Missing PUB_KEY or FILE!\n%s", usage);
 
     if (!out_file)
-        out_file = g_strdup_printf("%s.cpabe", in_file);
+        out_file = g_strdup_printf(vvs ? "%s.vvs" : "%s.cpabe", in_file);
 
     if (!policy)
         policy = parse_policy_lang(suck_stdin());
@@ -121,6 +135,17 @@ int main(int argc, char** argv)
 
     // Strip + write reduced PLY; return plaintext payload of stripped bytes
     pt_payload = process_and_encrypt_ply(in_file, out_file, pattern);
+    VvsQuant quant;
+    if (quant_bits) {
+        GByteArray* reduced = suck_file(out_file);
+        GByteArray* packed = vvs_quantize_payload(reduced->data, reduced->len, pattern, pt_payload,
+                                                  quant_bits, &quant);
+        g_byte_array_free(reduced, 1);
+        if (!packed)
+            die("%s: cannot quantize coordinates\n", in_file);
+        g_byte_array_free(pt_payload, 1);
+        pt_payload = packed;
+    }
     file_len = pt_payload->len;                 // plaintext payload length
     aes_buf  = aes_128_cbc_encrypt(pt_payload, m); // encrypt payload with session key
 
@@ -130,6 +155,18 @@ int main(int argc, char** argv)
     // Append trailer: marker + file_len + aes_buf + cph_buf
     write_cpabe_file(out_file, cph_buf, file_len, aes_buf);
 
+    // Repack as .vvs: prologue, header, cph, aes, reduced rows
+    if (vvs) {
+        GByteArray* legacy = suck_file(out_file);
+        GByteArray* container = vvs_from_cpabe(legacy->data, legacy->len, pattern_arg, NULL,
+                                                   quant_bits ? &quant : NULL);
+        g_byte_array_free(legacy, 1);
+        if (!container)
+            die("could not lay out %s as a .vvs container\n", out_file);
+        unlink(out_file); /* spit_file() appends */
+        spit_file(out_file, container, 1);
+    }
+
     g_byte_array_free(cph_buf, 1);
     g_byte_array_free(aes_buf, 1);
 
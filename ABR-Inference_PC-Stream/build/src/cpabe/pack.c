@@ -0,0 +1,488 @@
+#define PACKAGE_NAME "cpabe"
+#define PACKAGE_VERSION "1.0"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <pbc.h>
+#include <pbc_random.h>
+
+#include "bswabe.h"
+#include "common.h"
+#include "policy_lang.h"
+
+char* usage =
+"Usage: cpabe-pack [OPTION ...] PUB_KEY IN_DIR OUT_DIR POLICY SCHEME\n"
+"\n"
+"Encrypt a whole point cloud sequence under the decryption policy POLICY\n"
+"using public key PUB_KEY, and write the MPD describing it.\n"
+"\n"
+"IN_DIR holds one binary PLY per frame and representation, named\n"
+"NAME-NUMBER-REP.ply (e.g. office52-00001-100.ply). Each frame is written\n"
+"to OUT_DIR as NAME-NUMBER-REP.ply.cpabe (.ply.vvs with -V), and the MPD\n"
+"to OUT_DIR/NAME.mpd unless -m is given. Every representation must have\n"
+"the same consecutive frame numbers. The input files are kept.\n"
+"\n"
+"SCHEME must be one of: x, y, z, xy, yz, xyz\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n\n"
+" -h, --help               print this message\n\n"
+" -v, --version            print version information\n\n"
+" -r, --reps LIST          comma-separated REP values to package, in MPD\n"
+"                          order (default: all found, ascending)\n\n"
+" -j, --jobs N             encrypt N frames in parallel\n"
+"                          (default: number of online CPUs)\n\n"
+" -f, --fps N              frame rate written to the MPD (default 24)\n\n"
+" -m, --mpd FILE           write the MPD to FILE\n\n"
+" -V, --vvs                write .vvs containers instead of .ply.cpabe\n\n"
+" -g, --gop N              encrypt groups of N consecutive frames under one\n"
+"                          CP-ABE ciphertext, with per-frame AES keys\n"
+"                          derived from it (implies -V; default 1)\n\n"
+" -q, --quantize BITS      store the stripped coordinates as BITS-bit integers\n"
+"                          (16 or 21) relative to each frame's bounding box\n"
+"                          instead of raw float/double values; lossy, within\n"
+"                          half a step per axis (implies -V)\n\n"
+" -d, --deterministic      use deterministic \"random\" numbers\n"
+"                          (only for debugging; implies -j 1)\n\n";
+
+char* pub_file = NULL;
+char* in_dir = NULL;
+char* out_dir = NULL;
+char* policy = NULL;
+char* pattern_arg = NULL;
+char* reps_arg = NULL;
+char* mpd_file = NULL;
+int   jobs = 0;
+int   fps = 24;
+int   vvs = 0;
+int   gop = 1;
+int   quant_bits = 0;
+int   deterministic = 0;
+
+/* One input file, NAME-NUMBER-REP.ply */
+typedef struct {
+    char* name;          /* file name without directory */
+    int   number;
+    int   rep;           /* index into reps[] */
+    size_t out_size;     /* encrypted size, set by the worker */
+} PackJob;
+
+static char*    seq_name = NULL;   /* NAME shared by all frames */
+static int      num_width = 0;     /* digits in NUMBER */
+static GArray*  reps = NULL;       /* int REP values, MPD order */
+static PackJob* pack_jobs = NULL;
+static int      n_jobs = 0;
+
+static bswabe_pub_t*   pub = NULL;
+static int             per_rep = 0;    /* frames per representation */
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             next_group = 0;
+static int             n_groups = 0;
+static int             jobs_done = 0;
+
+static void parse_args(int argc, char** argv) {
+    int i;
+    int positional = 0; // PUB_KEY, IN_DIR, OUT_DIR, POLICY, SCHEME
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+                printf("%s", usage);
+                exit(0);
+            }
+            else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--version")) {
+                printf(CPABE_VERSION, "-pack");
+                exit(0);
+            }
+            else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--reps")) {
+                if (++i >= argc)
+                    die(usage);
+                reps_arg = argv[i];
+            }
+            else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+                if (++i >= argc || (jobs = atoi(argv[i])) <= 0)
+                    die(usage);
+            }
+            else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--fps")) {
+                if (++i >= argc || (fps = atoi(argv[i])) <= 0)
+                    die(usage);
+            }
+            else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--mpd")) {
+                if (++i >= argc)
+                    die(usage);
+                mpd_file = argv[i];
+            }
+            else if (!strcmp(argv[i], "-V") || !strcmp(argv[i], "--vvs")) {
+                vvs = 1;
+            }
+            else if (!strcmp(argv[i], "-g") || !strcmp(argv[i], "--gop")) {
+                if (++i >= argc || (gop = atoi(argv[i])) <= 0)
+                    die(usage);
+            }
+            else if (!strcmp(argv[i], "-q") || !strcmp(argv[i], "--quantize")) {
+                if (++i >= argc || ((quant_bits = atoi(argv[i])) != 16 && quant_bits != 21))
+                    die(usage);
+            }
+            else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--deterministic")) {
+                pbc_random_set_deterministic(0);
+                deterministic = 1;
+            }
+            else {
+                die("Unknown option: %s\n%s", argv[i], usage);
+            }
+        } else {
+            switch (positional) {
+                case 0: pub_file = argv[i]; break;
+                case 1: in_dir   = argv[i]; break;
+                case 2: out_dir  = argv[i]; break;
+                case 3: policy   = parse_policy_lang(argv[i]); break;
+                case 4: pattern_arg = argv[i]; break;
+                default: die("Too many positional arguments!\n%s", usage);
+            }
+            positional++;
+        }
+    }
+
+    if (positional < 5)
+        die("Missing arguments!\n%s", usage);
+    if (gop > 1 || quant_bits)
+        vvs = 1; /* the key reference and the quantization parameters live in the .vvs prologue */
+    if (deterministic)
+        jobs = 1; /* the deterministic generator is one shared state */
+    if (jobs <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = n > 0 ? (int)n : 1;
+    }
+}
+
+/* Split NAME-NUMBER-REP.ply. Returns 0, or -1 if file does not follow the pattern. */
+static int parse_frame_name(const char* file, char** name, int* number, int* width, int* rep)
+{
+    size_t len = strlen(file);
+    if (len < 5 || strcmp(file + len - 4, ".ply"))
+        return -1;
+    const char* end = file + len - 4;
+    const char* d2 = end;
+    while (d2 > file && d2[-1] != '-') d2--;
+    if (d2 == file || d2 == end) return -1;
+    const char* d1 = d2 - 1;
+    while (d1 > file && d1[-1] != '-') d1--;
+    if (d1 == file || d1 == d2 - 1) return -1;
+    for (const char* c = d1; c < d2 - 1; c++) if (!isdigit((unsigned char)*c)) return -1;
+    for (const char* c = d2; c < end; c++) if (!isdigit((unsigned char)*c)) return -1;
+
+    *name = g_strndup(file, (gsize)(d1 - 1 - file));
+    *number = atoi(d1);
+    *width = (int)(d2 - 1 - d1);
+    *rep = atoi(d2);
+    return 0;
+}
+
+static int rep_index(int rep)
+{
+    for (guint i = 0; i < reps->len; i++)
+        if (g_array_index(reps, int, i) == rep) return (int)i;
+    return -1;
+}
+
+static int cmp_int(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static int cmp_job(const void* a, const void* b)
+{
+    const PackJob* x = a;
+    const PackJob* y = b;
+    return x->rep != y->rep ? x->rep - y->rep : x->number - y->number;
+}
+
+/* Collect the frames of IN_DIR, check that every rep has the same consecutive numbers. */
+static void scan_input(int* first, int* count)
+{
+    DIR* d = opendir(in_dir);
+    struct dirent* e;
+    GArray* found = g_array_new(0, 0, sizeof(PackJob));
+    GArray* all_reps = g_array_new(0, 0, sizeof(int));
+
+    if (!d)
+        die("can't read directory: %s\n", in_dir);
+    while ((e = readdir(d))) {
+        PackJob j = {0};
+        char* name;
+        int width;
+        if (parse_frame_name(e->d_name, &name, &j.number, &width, &j.rep) != 0)
+            continue;
+        if (!seq_name) {
+            seq_name = name;
+            num_width = width;
+        } else {
+            if (strcmp(seq_name, name))
+                die("%s: more than one sequence in %s (%s, %s)\n", e->d_name, in_dir, seq_name, name);
+            g_free(name);
+        }
+        j.name = g_strdup(e->d_name);
+        g_array_append_val(found, j);
+        int known = 0;
+        for (guint i = 0; i < all_reps->len; i++)
+            if (g_array_index(all_reps, int, i) == j.rep) known = 1;
+        if (!known)
+            g_array_append_val(all_reps, j.rep);
+    }
+    closedir(d);
+    if (found->len == 0)
+        die("no NAME-NUMBER-REP.ply frames in %s\n", in_dir);
+
+    reps = g_array_new(0, 0, sizeof(int));
+    if (reps_arg) {
+        gchar** list = g_strsplit(reps_arg, ",", -1);
+        for (gchar** r = list; *r; r++) {
+            int v = atoi(*r);
+            g_array_append_val(reps, v);
+        }
+        g_strfreev(list);
+    } else {
+        qsort(all_reps->data, all_reps->len, sizeof(int), cmp_int);
+        g_array_append_vals(reps, all_reps->data, all_reps->len);
+    }
+    g_array_free(all_reps, 1);
+
+    /* keep the requested reps, ordered by rep then number */
+    pack_jobs = malloc(found->len * sizeof(PackJob));
+    for (guint i = 0; i < found->len; i++) {
+        PackJob j = g_array_index(found, PackJob, i);
+        j.rep = rep_index(j.rep);
+        if (j.rep < 0) {
+            g_free(j.name);
+            continue;
+        }
+        pack_jobs[n_jobs++] = j;
+    }
+    g_array_free(found, 1);
+    qsort(pack_jobs, n_jobs, sizeof(PackJob), cmp_job);
+
+    int per_rep = 0;
+    for (int i = 0; i < n_jobs && pack_jobs[i].rep == 0; i++) per_rep++;
+    if (per_rep == 0 || n_jobs != per_rep * (int)reps->len)
+        die("every representation needs the same frames (%d files for %u reps)\n", n_jobs, reps->len);
+    *first = pack_jobs[0].number;
+    *count = per_rep;
+    for (int i = 0; i < n_jobs; i++) {
+        PackJob* j = &pack_jobs[i];
+        if (j->rep != i / per_rep || j->number != *first + i % per_rep)
+            die("rep %d: frame %d missing or duplicated\n",
+                g_array_index(reps, int, i / per_rep), *first + i % per_rep);
+    }
+}
+
+static void write_file(const char* file, GByteArray* b)
+{
+    FILE* f = fopen(file, "wb");
+    if (!f)
+        die("can't write file: %s\n", file);
+    if (fwrite(b->data, 1, b->len, f) != b->len)
+        die("short write on %s\n", file);
+    fclose(f);
+}
+
+/* Strip, encrypt and write one frame. key_ref is set for frames of a group: the AES key is then
+ * derived from the group's session key m instead of being m itself. */
+static void pack_frame(PackJob* j, element_t m, GByteArray* cph_buf, const VvsKeyRef* key_ref)
+{
+    char* in_file = g_strdup_printf("%s/%s", in_dir, j->name);
+    char* out_file = g_strdup_printf("%s/%s%s", out_dir, j->name, vvs ? ".vvs" : ".cpabe");
+    GByteArray* ply = suck_file(in_file);
+    GByteArray* reduced = NULL;
+    EncryptPattern pat = parse_pattern(pattern_arg);
+    GByteArray* payload = strip_ply_buffer(ply->data, ply->len, pat, &reduced);
+    g_byte_array_free(ply, 1);
+    if (!payload)
+        die("%s: cannot strip coordinates\n", in_file);
+
+    VvsQuant quant;
+    if (quant_bits) {
+        GByteArray* packed = vvs_quantize_payload(reduced->data, reduced->len, pat, payload,
+                                                  quant_bits, &quant);
+        if (!packed)
+            die("%s: cannot quantize coordinates\n", in_file);
+        g_byte_array_free(payload, 1);
+        payload = packed;
+    }
+
+    int file_len = payload->len;
+    GByteArray* aes_buf;
+    if (key_ref) {
+        guint8 key[16];
+        vvs_frame_key(m, key_ref->gop_id, key_ref->gop_index, key);
+        aes_buf = aes_128_cbc_encrypt_raw(payload, key);
+        memset(key, 0, sizeof(key));
+    } else {
+        aes_buf = aes_128_cbc_encrypt(payload, m);
+    }
+    g_byte_array_free(payload, 1);
+
+    append_cpabe_trailer(reduced, cph_buf, file_len, aes_buf);
+    g_byte_array_free(aes_buf, 1);
+
+    if (vvs) {
+        GByteArray* container = vvs_from_cpabe(reduced->data, reduced->len, pattern_arg, key_ref,
+                                                   quant_bits ? &quant : NULL);
+        if (!container)
+            die("%s: could not lay out as a .vvs container\n", in_file);
+        g_byte_array_free(reduced, 1);
+        reduced = container;
+    }
+    write_file(out_file, reduced);
+    j->out_size = reduced->len;
+
+    g_byte_array_free(reduced, 1);
+    g_free(in_file);
+    g_free(out_file);
+}
+
+/* One bswabe_enc for frames [first, first + n) of one representation. */
+static void pack_group(int first, int n)
+{
+    element_t m;
+    bswabe_cph_t* cph = bswabe_enc(pub, m, policy);
+    if (!cph)
+        die("%s", bswabe_error());
+    GByteArray* cph_buf = bswabe_cph_serialize(cph);
+    bswabe_cph_free(cph);
+
+    VvsKeyRef ref;
+    if (gop > 1) {
+        /* the id covers the cph field exactly as the container stores it */
+        GByteArray* field = g_byte_array_new();
+        guint8 be[4] = { (guint8)(cph_buf->len >> 24), (guint8)(cph_buf->len >> 16),
+                         (guint8)(cph_buf->len >> 8), (guint8)cph_buf->len };
+        g_byte_array_append(field, be, 4);
+        g_byte_array_append(field, cph_buf->data, cph_buf->len);
+        vvs_gop_id(field->data, field->len, ref.gop_id);
+        g_byte_array_free(field, 1);
+    }
+    for (int i = 0; i < n; i++) {
+        ref.gop_index = (guint32)i;
+        pack_frame(&pack_jobs[first + i], m, cph_buf, gop > 1 ? &ref : NULL);
+    }
+    element_clear(m);
+    g_byte_array_free(cph_buf, 1);
+}
+
+static void* pack_worker(void* arg)
+{
+    (void)arg;
+    int groups_per_rep = (per_rep + gop - 1) / gop;
+    for (;;) {
+        pthread_mutex_lock(&next_lock);
+        int g = next_group < n_groups ? next_group++ : -1;
+        pthread_mutex_unlock(&next_lock);
+        if (g < 0)
+            break;
+
+        /* groups never span two representations */
+        int rep = g / groups_per_rep;
+        int off = (g % groups_per_rep) * gop;
+        int n = per_rep - off < gop ? per_rep - off : gop;
+        pack_group(rep * per_rep + off, n);
+
+        pthread_mutex_lock(&next_lock);
+        int before = jobs_done;
+        jobs_done += n;
+        if (jobs_done / 100 != before / 100 || jobs_done == n_jobs)
+            fprintf(stderr, "\r%d/%d frames", jobs_done, n_jobs);
+        pthread_mutex_unlock(&next_lock);
+    }
+    return NULL;
+}
+
+/* Same shape as the hand-written dataset MPDs: one FrameTemplate per representation,
+ * bandwidth = average encrypted frame size * 8 * fps. */
+static void write_mpd(int first, int count)
+{
+    char* file = mpd_file ? g_strdup(mpd_file) : g_strdup_printf("%s/%s.mpd", out_dir, seq_name);
+    FILE* f = fopen(file, "w");
+    if (!f)
+        die("can't write file: %s\n", file);
+
+    double secs = (double)count / fps;
+    int mins = (int)(secs / 60);
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+    fprintf(f, "<MPD profiles=\"frame:based:pointcloud:streaming:NoDash:\"\n");
+    if (count % fps == 0)
+        fprintf(f, "\tmediaPresentationDuration=\"PT%dM%02dS\">\n", mins, (int)secs % 60);
+    else
+        fprintf(f, "\tmediaPresentationDuration=\"PT%dM%06.3fS\">\n", mins, secs - 60.0 * mins);
+    fprintf(f, "\t<AdaptationSet id=\"0\" contentType=\"volumetricvideo\" mimeType=\"model/ply\">\n");
+    for (guint r = 0; r < reps->len; r++) {
+        int rep = g_array_index(reps, int, r);
+        guint64 bytes = 0;
+        for (int i = 0; i < count; i++)
+            bytes += pack_jobs[r * count + i].out_size;
+        guint64 bandwidth = (bytes * 8 * (guint64)fps + count / 2) / (guint64)count;
+        fprintf(f, "\t\t<Representation id=\"rep%d\" frameRate=\"%d\" bandwidth=\"%llu\">\n",
+                rep, fps, (unsigned long long)bandwidth);
+        fprintf(f, "\t\t\t<FrameTemplate media=\"%s-$Number%%0%dd$-%d.ply%s\" startNumber=\"%d\" frameCount=\"%d\" />\n",
+                seq_name, num_width, rep, vvs ? ".vvs" : ".cpabe", first, count);
+        fprintf(f, "\t\t</Representation>\n");
+    }
+    fprintf(f, "\t</AdaptationSet>\n");
+    fprintf(f, "</MPD>\n");
+    fclose(f);
+    printf("wrote %s\n", file);
+    g_free(file);
+}
+
+int main(int argc, char** argv)
+{
+    int first = 0, count = 0;
+
+    parse_args(argc, argv);
+
+    EncryptPattern pattern = parse_pattern(pattern_arg);
+    if (!(pattern.encrypt_x || pattern.encrypt_y || pattern.encrypt_z))
+        die("Invalid SCHEME. Use one of: x, y, z, xy, yz, xyz\n");
+
+    scan_input(&first, &count);
+    per_rep = count;
+    n_groups = (int)reps->len * ((count + gop - 1) / gop);
+    if (mkdir(out_dir, 0755) != 0 && access(out_dir, W_OK) != 0)
+        die("can't create directory: %s\n", out_dir);
+
+    /* the public key and the policy are loaded once and shared read-only by the workers */
+    pub = bswabe_pub_unserialize(suck_file(pub_file), 1);
+
+    if (jobs > n_groups)
+        jobs = n_groups;
+    printf("%s: %d frames x %u reps, %d jobs", seq_name, count, reps->len, jobs);
+    if (gop > 1)
+        printf(", %d-frame key groups", gop);
+    if (quant_bits)
+        printf(", %d-bit coordinates", quant_bits);
+    printf("\n");
+    pthread_t* threads = malloc((size_t)jobs * sizeof(pthread_t));
+    for (int t = 0; t < jobs; t++)
+        if (pthread_create(&threads[t], NULL, pack_worker, NULL) != 0)
+            die("pthread_create failed\n");
+    for (int t = 0; t < jobs; t++)
+        pthread_join(threads[t], NULL);
+    fprintf(stderr, "\n");
+    free(threads);
+
+    write_mpd(first, count);
+
+    free(policy);
+    bswabe_pub_free(pub);
+    for (int i = 0; i < n_jobs; i++)
+        g_free(pack_jobs[i].name);
+    free(pack_jobs);
+    g_array_free(reps, 1);
+    g_free(seq_name);
+    return 0;
+}
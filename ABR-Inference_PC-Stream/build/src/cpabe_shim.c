@@ -7,6 +7,7 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 #include <glib.h>
 #include <pbc.h>
 
@@ -22,6 +23,8 @@ static char*         g_pattern = NULL;
 static EncryptPattern g_parsed_pattern;
 char* pattern_arg = NULL;   /* defined extern in common.h; some helpers read this */
 
+static void key_cache_clear(void);
+
 /* Small helper: strdup safely */
 static char* xstrdup(const char* s) {
     if (!s) return NULL;
@@ -92,44 +95,117 @@ void cpabe_ctx_free(void)
     if (g_pattern) { free(g_pattern); g_pattern = NULL; }
     pattern_arg = NULL;
     g_parsed_pattern = (EncryptPattern){0,0,0};
+    key_cache_clear();
 }
 
-int cpabe_decrypt_ply_buffer(GByteArray* buffer, double* time_ms, int write_output_flag, const char* output_ply_filename)
+struct CpabeFrameKey {
+    element_t m;          /* AES key recovered by bswabe_dec */
+};
+
+/* ----------------------- GOP key cache ----------------------- */
+/* Frames packed with cpabe-pack -g share one CP-ABE session key per group (VVS_FLAG_GOP_KEY).
+ * The unwrapped key is kept here by GOP id so only the first frame of a group pays for
+ * bswabe_dec. Workers walk the sequence roughly in order, so a handful of slots is enough:
+ * one per concurrently decoded group plus the one being prefetched. Frames without the flag
+ * never touch the cache. */
+#define KEY_CACHE_SLOTS 4
+
+typedef struct {
+    int      valid;
+    guint8   gop_id[VVS_GOP_ID_LEN];
+    element_t m;
+    unsigned long stamp;  /* LRU */
+} KeyCacheSlot;
+
+static KeyCacheSlot    g_key_cache[KEY_CACHE_SLOTS];
+static unsigned long   g_key_clock = 0;
+static int             g_key_hits = 0, g_key_misses = 0;
+static pthread_mutex_t g_key_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static int is_gop_frame(const VvsPrologue* vvs)
 {
-    double tx = now_ms_mono();
-    if (!g_pub || !g_prv || !g_pattern) {
-        fprintf(stderr, "[cpabe_shim] ctx not initialized\n");
-        return -1;
+    return vvs && (vvs->flags & VVS_FLAG_GOP_KEY);
+}
+
+/* Copy the cached key for gop_id into m (initialised here). 1 hit, 0 miss. */
+static int key_cache_get(const guint8 gop_id[VVS_GOP_ID_LEN], element_t m)
+{
+    int hit = 0;
+    pthread_mutex_lock(&g_key_mu);
+    for (int i = 0; i < KEY_CACHE_SLOTS; i++) {
+        KeyCacheSlot* s = &g_key_cache[i];
+        if (s->valid && !memcmp(s->gop_id, gop_id, VVS_GOP_ID_LEN)) {
+            element_init_same_as(m, s->m);
+            element_set(m, s->m);
+            s->stamp = ++g_key_clock;
+            hit = 1;
+            break;
+        }
     }
-    if (!buffer || buffer->len == 0) return -2;
+    if (hit) g_key_hits++;
+    pthread_mutex_unlock(&g_key_mu);
+    return hit;
+}
 
-    // double t0 = now_ms_mono();
-    // Parse the buffer as a cpabe file trailer
-    GByteArray *cph_buf = NULL, *aes_buf = NULL;
-    int file_len = 0;
-    parse_cpabe_buffer(buffer, &cph_buf, &file_len, &aes_buf);
+/* Remember m for gop_id, evicting the least recently used slot. Keeps an existing entry.
+ * Misses are counted here rather than in key_cache_get() so lookups of legacy frames (whose
+ * keys are never inserted) do not show up in the stats. */
+static void key_cache_put(const guint8 gop_id[VVS_GOP_ID_LEN], element_t m)
+{
+    pthread_mutex_lock(&g_key_mu);
+    KeyCacheSlot* victim = &g_key_cache[0];
+    for (int i = 0; i < KEY_CACHE_SLOTS; i++) {
+        KeyCacheSlot* s = &g_key_cache[i];
+        if (s->valid && !memcmp(s->gop_id, gop_id, VVS_GOP_ID_LEN)) {
+            pthread_mutex_unlock(&g_key_mu);
+            return;
+        }
+        if (!s->valid || (victim->valid && s->stamp < victim->stamp)) victim = s;
+    }
+    if (victim->valid) element_clear(victim->m);
+    g_key_misses++;
+    memcpy(victim->gop_id, gop_id, VVS_GOP_ID_LEN);
+    element_init_same_as(victim->m, m);
+    element_set(victim->m, m);
+    victim->stamp = ++g_key_clock;
+    victim->valid = 1;
+    pthread_mutex_unlock(&g_key_mu);
+}
 
-    // double t1 = now_ms_mono();
-    bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 1);
-    // double t3 = now_ms_mono();
-    if (!cph) {
-        fprintf(stderr, "[cpabe_shim] cph unserialize failed for buffer\n");
-        g_byte_array_free(aes_buf, 1);
-        return -4;
+static void key_cache_clear(void)
+{
+    pthread_mutex_lock(&g_key_mu);
+    for (int i = 0; i < KEY_CACHE_SLOTS; i++) {
+        if (g_key_cache[i].valid) element_clear(g_key_cache[i].m);
+        g_key_cache[i].valid = 0;
+    }
+    pthread_mutex_unlock(&g_key_mu);
+}
+
+void cpabe_key_cache_stats(int* hits, int* misses)
+{
+    pthread_mutex_lock(&g_key_mu);
+    if (hits) *hits = g_key_hits;
+    if (misses) *misses = g_key_misses;
+    pthread_mutex_unlock(&g_key_mu);
+}
+
+/* AES-decrypt the coordinates with m and rebuild the full PLY of frame [in, in + len) into out.
+ * out may be the array holding the frame itself (in place) or a separate one (read-only view). */
+static int rebuild_with_key(const guint8* in, size_t len, GByteArray* out, const VvsPrologue* vvs,
+                            element_t m, GByteArray* aes_buf, int write_output_flag,
+                            const char* output_ply_filename)
+{
+    GByteArray* pt_payload;
+    if (is_gop_frame(vvs)) {
+        // Group session key: the frame's AES key is derived from it by its index in the GOP
+        guint8 frame_key[16];
+        vvs_frame_key(m, vvs->gop_id, vvs->gop_index, frame_key);
+        pt_payload = aes_128_cbc_decrypt_raw(aes_buf, frame_key);
+        memset(frame_key, 0, sizeof frame_key);
+    } else {
+        pt_payload = aes_128_cbc_decrypt(aes_buf, m);
     }
-    element_t m;
-    // double t_dec_start = now_ms_mono();
-    int dec_ok = bswabe_dec(g_pub, g_prv, cph, m);
-    // double t_dec_end = now_ms_mono();
-    bswabe_cph_free(cph);
-    if (!dec_ok) {
-         const char* err = bswabe_error();
-         fprintf(stderr, "[cpabe_shim] bswabe_dec failed: %s\n", err ? err : "(unknown)");
-         g_byte_array_free(aes_buf, 1);
-         return -5;
-     }
-    GByteArray* pt_payload = aes_128_cbc_decrypt(aes_buf, m);
-    element_clear(m);
 
     // Use pattern parsed at init
     EncryptPattern pat = g_parsed_pattern;
@@ -137,37 +213,247 @@ int cpabe_decrypt_ply_buffer(GByteArray* buffer, double* time_ms, int write_outp
     // Output filename logic simplified
     const char* output_filename = (write_output_flag && output_ply_filename) ? output_ply_filename : NULL;
 
-    // Rebuild full PLY in memory, optionally write to disk
-    GByteArray* rebuilt_ply = restore_stripped_rebuild(
-        buffer,
-        output_filename,
-        pt_payload,
-        pat
-    );
+    // Rebuild full PLY in memory, optionally write to disk. A .vvs container carries its own
+    // layout (and pattern), the legacy format is rebuilt by parsing the header.
+    // A separate out is written directly; in place, the rebuild goes to scratch first.
+    int in_place = out->data == in;
+    GByteArray* into = in_place ? NULL : out;
+    GByteArray* rebuilt_ply = vvs
+        ? restore_vvs_with_coords(in, len, vvs, output_filename, pt_payload, into)
+        : restore_ply_view(in, len, output_filename, pt_payload, pat, into);
     if (!rebuilt_ply) {
-        fprintf(stderr, "[cpabe_shim] restore_stripped_rebuild failed\n");
-        g_byte_array_free(pt_payload, 1);
-        g_byte_array_free(aes_buf, 1);
+        fprintf(stderr, "[cpabe_shim] restore failed\n");
         return -6;
     }
 
     // Overwrite the original buffer with the rebuilt (decrypted) PLY so caller sees decrypted data
-    // Clear existing buffer contents and append rebuilt data
-    g_byte_array_set_size(buffer, 0);
-    g_byte_array_append(buffer, rebuilt_ply->data, rebuilt_ply->len);
-
-    // // Resize buffer to the rebuilt size and copy bytes in-place.
-    // // This preserves the GByteArray object (no pointer to the struct is swapped).
-    // size_t new_len = rebuilt_ply->len;
-    // g_byte_array_set_size(buffer, new_len);
-    // if (buffer->data && rebuilt_ply->data && new_len > 0) {
-    //     memcpy(buffer->data, rebuilt_ply->data, new_len);
-    // }
-
-    // free the rebuilt_ply temporary
-    g_byte_array_free(rebuilt_ply, 1);
-    g_byte_array_free(pt_payload, 1);
-    g_byte_array_free(aes_buf, 1);
+    // Clear existing buffer contents and append rebuilt data. pt_payload and rebuilt_ply are
+    // scratch, released when the entry point ends its bracket.
+    if (in_place) {
+        g_byte_array_set_size(out, 0);
+        g_byte_array_append(out, rebuilt_ply->data, rebuilt_ply->len);
+    }
+    return 0;
+}
+
+/* Split a frame into its CP-ABE ciphertext and AES buffer (both scratch). *vvs_out is set for
+ * .vvs containers (O(1) from the prologue), left NULL for the legacy .ply.cpabe layout. */
+static int split_frame(const guint8* in, size_t len, VvsPrologue* vvs, VvsPrologue** vvs_out,
+                       GByteArray** cph_buf, GByteArray** aes_buf)
+{
+    *vvs_out = NULL;
+    int rc = vvs_read_prologue(in, len, vvs);
+    if (rc == 0) {
+        if (vvs_file_size(vvs) > len) {
+            fprintf(stderr, "[cpabe_shim] truncated .vvs frame\n");
+            return -3;
+        }
+        if (read_cpabe_cph(in + vvs->cph_off, (size_t)vvs->cph_len, cph_buf) != 0)
+            return -3;
+        *aes_buf = scratch_bytes((size_t)vvs->aes_len);
+        g_byte_array_append(*aes_buf, in + vvs->aes_off, (guint)vvs->aes_len);
+        *vvs_out = vvs;
+        return 0;
+    }
+    if (len >= 4 && !memcmp(in, VVS_MAGIC, 4)) {
+        fprintf(stderr, "[cpabe_shim] bad .vvs prologue\n");
+        return -3;
+    }
+    parse_cpabe_view(in, len, cph_buf, aes_buf);
+    return 0;
+}
+
+/* The entry points below run their body between scratch_begin() and scratch_end(): every
+ * temporary of a frame comes from the calling thread's arena (cpabe/common.h) and is dropped
+ * in one go when the frame is done, so the bodies never free them. */
+
+static int decrypt_frame(const guint8* in, size_t len, GByteArray* out, double tx, double* time_ms,
+                         int write_output_flag, const char* output_ply_filename)
+{
+    // Parse the buffer as a .vvs container or a cpabe file trailer
+    GByteArray *cph_buf = NULL, *aes_buf = NULL;
+    VvsPrologue vvs_buf, *vvs = NULL;
+    int split_rc = split_frame(in, len, &vvs_buf, &vvs, &cph_buf, &aes_buf);
+    if (split_rc != 0) return split_rc;
+
+    element_t m;
+    if (!is_gop_frame(vvs) || !key_cache_get(vvs->gop_id, m)) { // else: group key already unwrapped
+        bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 0);
+        if (!cph) {
+            fprintf(stderr, "[cpabe_shim] cph unserialize failed for buffer\n");
+            return -4;
+        }
+        int dec_ok = bswabe_dec(g_pub, g_prv, cph, m);
+        bswabe_cph_free(cph);
+        if (!dec_ok) {
+             const char* err = bswabe_error();
+             fprintf(stderr, "[cpabe_shim] bswabe_dec failed: %s\n", err ? err : "(unknown)");
+             return -5;
+         }
+        if (is_gop_frame(vvs)) key_cache_put(vvs->gop_id, m);
+    }
+    int rc = rebuild_with_key(in, len, out, vvs, m, aes_buf, write_output_flag, output_ply_filename);
+    element_clear(m);
+    if (rc != 0) return rc;
     if (time_ms) *time_ms = now_ms_mono() - tx;
     return 0;
-}
\ No newline at end of file
+}
+
+int cpabe_decrypt_ply_buffer(GByteArray* buffer, double* time_ms, int write_output_flag, const char* output_ply_filename)
+{
+    double tx = now_ms_mono();
+    if (!g_pub || !g_prv || !g_pattern) {
+        fprintf(stderr, "[cpabe_shim] ctx not initialized\n");
+        return -1;
+    }
+    if (!buffer || buffer->len == 0) return -2;
+    scratch_begin();
+    int rc = decrypt_frame(buffer->data, buffer->len, buffer, tx, time_ms, write_output_flag,
+                           output_ply_filename);
+    scratch_end();
+    return rc;
+}
+
+int cpabe_decrypt_ply_view(const guint8* data, size_t len, GByteArray* out, double* time_ms,
+                           int write_output_flag, const char* output_ply_filename)
+{
+    double tx = now_ms_mono();
+    if (!g_pub || !g_prv || !g_pattern) {
+        fprintf(stderr, "[cpabe_shim] ctx not initialized\n");
+        return -1;
+    }
+    if (!data || len == 0 || !out) return -2;
+    scratch_begin();
+    int rc = decrypt_frame(data, len, out, tx, time_ms, write_output_flag, output_ply_filename);
+    scratch_end();
+    return rc;
+}
+
+int cpabe_locate_trailer(const guint8* head, size_t len, size_t* header_end, size_t* trailer_off)
+{
+    if (!g_pattern || !head) return -1;
+    return locate_cpabe_trailer(head, len, g_pattern, header_end, trailer_off);
+}
+
+int cpabe_locate_cph(const guint8* trailer, size_t len, size_t* cph_off)
+{
+    if (!trailer) return -1;
+    return locate_cpabe_cph(trailer, len, cph_off);
+}
+
+int cpabe_vvs_locate_cph(const guint8* head, size_t len, size_t* cph_off, size_t* cph_end, size_t* file_size)
+{
+    VvsPrologue p;
+    if (!head) return -1;
+    int rc = vvs_read_prologue(head, len, &p);
+    if (rc != 0) return rc;
+    *cph_off = (size_t)p.cph_off;
+    *cph_end = (size_t)(p.cph_off + p.cph_len);
+    if (file_size) *file_size = (size_t)vvs_file_size(&p);
+    return 0;
+}
+
+/* Size of the [cph_len][cph] field at the start of the len bytes at field, 0 if truncated */
+static size_t cph_field_len(const guint8* field, size_t len)
+{
+    if (len < 4) return 0;
+    size_t n = 4 + (((size_t)field[0] << 24) | ((size_t)field[1] << 16) |
+                    ((size_t)field[2] << 8) | field[3]);
+    return n <= len ? n : 0;
+}
+
+static CpabeFrameKey* unwrap_key(const guint8* cph_field, size_t len, double tx, double* time_ms)
+{
+    // Only .vvs containers carry a GOP key, but the id is just a hash of the field, so a cache
+    // lookup costs nothing for legacy frames (their ids never get inserted). The id covers
+    // exactly [cph_len][cph], as pack hashed it; whatever follows in the buffer is not read.
+    len = cph_field_len(cph_field, len);
+    if (len == 0) {
+        fprintf(stderr, "[cpabe_shim] truncated cph in trailer\n");
+        return NULL;
+    }
+    guint8 gop_id[VVS_GOP_ID_LEN];
+    vvs_gop_id(cph_field, len, gop_id);
+    CpabeFrameKey* cached = (CpabeFrameKey*)calloc(1, sizeof(CpabeFrameKey));
+    if (cached && key_cache_get(gop_id, cached->m)) {
+        if (time_ms) *time_ms = now_ms_mono() - tx;
+        return cached;
+    }
+    free(cached);
+    GByteArray* cph_buf = NULL;
+    if (read_cpabe_cph(cph_field, len, &cph_buf) != 0) {
+        fprintf(stderr, "[cpabe_shim] truncated cph in trailer\n");
+        return NULL;
+    }
+    bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 0);
+    if (!cph) {
+        fprintf(stderr, "[cpabe_shim] cph unserialize failed for trailer\n");
+        return NULL;
+    }
+    CpabeFrameKey* key = (CpabeFrameKey*)calloc(1, sizeof(CpabeFrameKey));
+    int dec_ok = key ? bswabe_dec(g_pub, g_prv, cph, key->m) : 0;
+    bswabe_cph_free(cph);
+    if (!dec_ok) {
+        const char* err = bswabe_error();
+        fprintf(stderr, "[cpabe_shim] bswabe_dec failed: %s\n", err ? err : "(unknown)");
+        free(key);
+        return NULL;
+    }
+    if (time_ms) *time_ms = now_ms_mono() - tx;
+    return key;
+}
+
+CpabeFrameKey* cpabe_unwrap_key(const guint8* cph_field, size_t len, double* time_ms)
+{
+    double tx = now_ms_mono();
+    if (!g_pub || !g_prv || !g_pattern) {
+        fprintf(stderr, "[cpabe_shim] ctx not initialized\n");
+        return NULL;
+    }
+    scratch_begin();
+    CpabeFrameKey* key = unwrap_key(cph_field, len, tx, time_ms);
+    scratch_end();
+    return key;
+}
+
+static int decrypt_frame_with_key(GByteArray* buffer, CpabeFrameKey* key, double tx, double* time_ms,
+                                  int write_output_flag, const char* output_ply_filename)
+{
+    GByteArray *cph_buf = NULL, *aes_buf = NULL;  // cph already unwrapped
+    VvsPrologue vvs_buf, *vvs = NULL;
+    int split_rc = split_frame(buffer->data, buffer->len, &vvs_buf, &vvs, &cph_buf, &aes_buf);
+    if (split_rc != 0) return split_rc;
+    if (is_gop_frame(vvs)) key_cache_put(vvs->gop_id, key->m);
+    int rc = rebuild_with_key(buffer->data, buffer->len, buffer, vvs, key->m, aes_buf, write_output_flag, output_ply_filename);
+    if (rc != 0) return rc;
+    if (time_ms) *time_ms = now_ms_mono() - tx;
+    return 0;
+}
+
+int cpabe_decrypt_ply_buffer_with_key(GByteArray* buffer, CpabeFrameKey* key, double* time_ms,
+                                      int write_output_flag, const char* output_ply_filename)
+{
+    double tx = now_ms_mono();
+    if (!buffer || buffer->len == 0 || !key) return -2;
+    scratch_begin();
+    int rc = decrypt_frame_with_key(buffer, key, tx, time_ms, write_output_flag, output_ply_filename);
+    scratch_end();
+    return rc;
+}
+
+void cpabe_thread_cleanup(void)
+{
+    scratch_release();
+}
+
+void cpabe_scratch_stats(size_t* peak_bytes, int* grows)
+{
+    scratch_stats(peak_bytes, grows);
+}
+
+void cpabe_key_free(CpabeFrameKey* key)
+{
+    if (!key) return;
+    element_clear(key->m);
+    free(key);
+}
@@ -13,9 +13,47 @@ int cpabe_ctx_init(const char* pub_path, const char* prv_path, const char* patte
 
 /* Decrypts/restores a single PLY from a memory buffer (GByteArray).
  * Returns 0 on success; non-zero on failure.
+ * The keys and pattern are read-only after cpabe_ctx_init(), so concurrent calls from
+ * several threads (--sessions workers) are safe; init/free must not race with them.
  */
 int cpabe_decrypt_ply_buffer(GByteArray* buffer, double* time_ms, int write_output_flag, const char* output_ply_filename);
 
+/* Same, for a frame held in read-only memory (e.g. an mmap'd file): data is left untouched and
+ * the decrypted PLY replaces the contents of out. */
+int cpabe_decrypt_ply_view(const guint8* data, size_t len, GByteArray* out, double* time_ms,
+                           int write_output_flag, const char* output_ply_filename);
+
+/* Progressive decrypt for frames fetched out of order with HTTP Range.
+ * cpabe_locate_trailer() finds the trailer from the PLY header alone and cpabe_locate_cph() the
+ * CP-ABE ciphertext from the start of the trailer (0 ok, 1 need more bytes, -1 bad data).
+ * cpabe_unwrap_key() runs the expensive part (cph unserialize + bswabe_dec) on [cph_len][cph]
+ * alone; cpabe_decrypt_ply_buffer_with_key() does AES + rebuild once the whole frame is in the
+ * buffer, with the same result as cpabe_decrypt_ply_buffer(). */
+typedef struct CpabeFrameKey CpabeFrameKey;
+int cpabe_locate_trailer(const guint8* head, size_t len, size_t* header_end, size_t* trailer_off);
+int cpabe_locate_cph(const guint8* trailer, size_t len, size_t* cph_off);
+CpabeFrameKey* cpabe_unwrap_key(const guint8* cph, size_t len, double* time_ms);
+int cpabe_decrypt_ply_buffer_with_key(GByteArray* buffer, CpabeFrameKey* key, double* time_ms,
+                                      int write_output_flag, const char* output_ply_filename);
+void cpabe_key_free(CpabeFrameKey* key);
+
+/* .vvs containers (see cpabe/common.h) are detected by their magic in every decrypt entry point;
+ * their pattern and row layout come from the prologue, not from cpabe_ctx_init().
+ * cpabe_vvs_locate_cph() reads [cph_off, cph_end) of the [cph_len][cph] field and the container
+ * size from the prologue: 0 ok, 1 need more bytes, -1 not a .vvs container. */
+int cpabe_vvs_locate_cph(const guint8* head, size_t len, size_t* cph_off, size_t* cph_end, size_t* file_size);
+
+/* Frames packed with a shared GOP key (VVS_FLAG_GOP_KEY) unwrap the CP-ABE key once per group;
+ * later frames of the group reuse it from a small LRU cache in every decrypt entry point.
+ * hits = frames that skipped bswabe_dec, misses = group keys unwrapped. Cleared by cpabe_ctx_free(). */
+void cpabe_key_cache_stats(int* hits, int* misses);
+
+/* Decrypt temporaries come from a per-thread arena (scratch_*, cpabe/common.h). A thread that
+ * decrypted frames calls cpabe_thread_cleanup() before it exits; cpabe_scratch_stats() gives the
+ * largest per-frame footprint and how often an arena had to grow. */
+void cpabe_thread_cleanup(void);
+void cpabe_scratch_stats(size_t* peak_bytes, int* grows);
+
 /* Free any global/heap state (keys, pattern, buffers). */
 void cpabe_ctx_free(void);
 
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "deadline.h"
+#include "downloader.h"
+#include "utils.h"
+
+#define DEADLINE_EWMA_ALPHA 0.3
+#define DEADLINE_MIN_BYTES  65536   // bytes received before the transfer's own rate is trusted
+
+// One download attempt, seen by the progress callback
+typedef struct {
+    DeadlineScheduler* s;
+    int rep;
+    double due_ms;          // download must be done by then (0 = no deadline)
+    double start_ms;
+    size_t got;
+    // set when the callback aborts
+    int to_rep;             // rep to re-request, -1 = skip
+    double late_ms;
+} Attempt;
+
+static double ewma(double old, double sample) {
+    return old > 0.0 ? old + DEADLINE_EWMA_ALPHA * (sample - old) : sample;
+}
+
+// nominal size of one frame of rep
+static double frame_bytes(MPDInfo* mpd, int rep) {
+    return (double)mpd->bitrates[rep] / 8.0 / (double)(mpd->frame_rate > 0 ? mpd->frame_rate : 1);
+}
+
+static int attempt_check(void* user, size_t dl_total, size_t dl_now) {
+    Attempt* a = (Attempt*)user;
+    DeadlineScheduler* s = a->s;
+    double now = now_ms_mono();
+    a->got = dl_now;
+    if (a->due_ms <= 0.0) return 0;
+
+    // Rates include the request round trip. Data arrives in bursts (socket buffers, shaping),
+    // so the transfer's own rate is only trusted when it is the more pessimistic one.
+    double rate = s->rate_Bps;
+    if (dl_now >= DEADLINE_MIN_BYTES && now > a->start_ms) {
+        double cur = (double)dl_now * 1000.0 / (now - a->start_ms);
+        if (rate <= 0.0 || cur < rate) rate = cur;
+    }
+    if (rate <= 0.0) return 0;
+
+    double size = dl_total > 0 ? (double)dl_total : frame_bytes(s->mpd, a->rep);
+    double remaining = size > (double)dl_now ? size - (double)dl_now : 0.0;
+    double finish = now + remaining * 1000.0 / rate;
+    double limit = a->due_ms + s->slack_ms;
+    if (finish <= limit) return 0;
+
+    // highest lower rep that makes it when restarted now
+    a->to_rep = a->rep;
+    for (int r = a->rep - 1; r >= 0; r--) {
+        if (now + frame_bytes(s->mpd, r) * 1000.0 / rate <= limit) { a->to_rep = r; break; }
+    }
+    if (a->to_rep == a->rep) {
+        if (!s->last_skipped) {
+            a->to_rep = -1;
+        } else if (a->rep > 0 && now + frame_bytes(s->mpd, 0) * 1000.0 / rate < finish) {
+            a->to_rep = 0; // late either way, but less late
+        } else {
+            return 0;
+        }
+    }
+    a->late_ms = finish - a->due_ms;
+    return 1;
+}
+
+DeadlineScheduler* deadline_init(PlayerClock* clock, MPDInfo* mpd, ABR* abr, Logger* logger,
+                                 double slack_ms) {
+    if (!clock || !mpd) return NULL;
+    DeadlineScheduler* s = calloc(1, sizeof(DeadlineScheduler));
+    if (!s) return NULL;
+    s->clock = clock;
+    s->mpd = mpd;
+    s->abr = abr;
+    s->logger = logger;
+    s->slack_ms = slack_ms > 0.0 ? slack_ms : 0.0;
+    pthread_mutex_init(&s->lock, NULL);
+    return s;
+}
+
+void deadline_note_decode(DeadlineScheduler* s, double dec_ms) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->decode_ms = ewma(s->decode_ms, dec_ms);
+    pthread_mutex_unlock(&s->lock);
+}
+
+int deadline_fetch(DeadlineScheduler* s, int index, int position, int rep, int queued,
+                   GByteArray** out_buf, double* dl_ms) {
+    *out_buf = NULL;
+    *dl_ms = 0.0;
+    for (;;) {
+        char url[1024];
+        if (mpd_frame_url(s->mpd, rep, index, url, sizeof(url)) < 0) {
+            fprintf(stderr, "[warn] no URL for frame %d (rep %d)\n", index, rep);
+            s->failed++;
+            s->last_skipped = 1;
+            return rep;
+        }
+        Attempt a = {0};
+        a.s = s;
+        a.rep = rep;
+        a.due_ms = player_clock_due_ms(s->clock, position);
+        if (a.due_ms > 0.0) {
+            pthread_mutex_lock(&s->lock);
+            a.due_ms -= (double)(queued + 1) * s->decode_ms;
+            pthread_mutex_unlock(&s->lock);
+        }
+        a.start_ms = now_ms_mono();
+
+        double ms = 0.0;
+        int rc = download_file_mem_cancelable(url, rep, out_buf, &ms, attempt_check, &a);
+        *dl_ms += ms;
+
+        if (rc != DOWNLOAD_CANCELLED) {
+            if (rc != 0 || !*out_buf) {
+                // no data for this frame either: the next one must not be skipped
+                fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, url);
+                s->failed++;
+                s->last_skipped = 1;
+                return rep;
+            }
+            if (ms > 0.0 && (*out_buf)->len >= DEADLINE_MIN_BYTES) {
+                s->rate_Bps = ewma(s->rate_Bps, (double)(*out_buf)->len * 1000.0 / ms);
+            }
+            s->completed++;
+            s->last_skipped = 0;
+            return rep;
+        }
+
+        // aborted by attempt_check: log, then downgrade or skip
+        s->aborted_bytes += a.got;
+        DeadlineLog entry = {0};
+        entry.frame_no = index;
+        entry.position = position;
+        entry.from_rep = rep;
+        entry.to_rep = a.to_rep;
+        entry.late_ms = a.late_ms;
+        entry.aborted_bytes = a.got;
+        entry.decision = a.to_rep < 0 ? "skip" : "down";
+        logger_add_deadline_decision(s->logger, &entry);
+
+        if (a.to_rep < 0) {
+            s->skipped++;
+            s->last_skipped = 1;
+            return -1;
+        }
+        s->downgraded++;
+        abr_note_deadline_miss(s->abr, index, a.to_rep);
+        rep = a.to_rep;
+    }
+}
+
+void deadline_report(DeadlineScheduler* s) {
+    if (!s) return;
+    printf("[info] deadline: %d frames downloaded, %d re-requested at a lower rep, %d skipped, %d failed, "
+           "%.1f MB aborted\n", s->completed, s->downgraded, s->skipped, s->failed, (double)s->aborted_bytes / 1e6);
+}
+
+void deadline_free(DeadlineScheduler* s) {
+    if (!s) return;
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
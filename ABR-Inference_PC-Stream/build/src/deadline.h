@@ -0,0 +1,52 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <pthread.h>
+#include <glib.h>
+#include "mpd_parser.h"
+#include "player.h"
+#include "logger.h"
+#include "abr.h"
+
+// Deadline-aware frame downloads (--frame-deadline). Every frame fills the next play position
+// and the player clock says when that position is consumed; the download has to finish that
+// much earlier again to leave time for decrypting the frames queued ahead of it.
+// While a transfer runs, curl's progress callback projects its completion from the bytes
+// received so far. If it would land more than slack_ms past the deadline the transfer is
+// aborted and the frame is re-requested at the highest lower rep that still fits, or skipped
+// (the player repeats the previous frame) when even the lowest rep cannot make it.
+// Two frames in a row are never skipped.
+typedef struct {
+    PlayerClock* clock;
+    MPDInfo* mpd;
+    ABR* abr;              // told about every down-switch (may be NULL)
+    Logger* logger;
+    double slack_ms;       // lateness tolerated before a transfer is aborted
+
+    pthread_mutex_t lock;  // decode_ms is written by the decrypting thread
+    double decode_ms;      // EWMA of per-frame decrypt time
+
+    // owned by the downloading thread
+    double rate_Bps;       // EWMA of completed transfer throughput (request to last byte)
+    int last_skipped;      // the previous frame has no data (skipped or failed)
+    int completed, downgraded, skipped, failed;
+    size_t aborted_bytes;
+} DeadlineScheduler;
+
+DeadlineScheduler* deadline_init(PlayerClock* clock, MPDInfo* mpd, ABR* abr, Logger* logger,
+                                 double slack_ms);
+
+// Download frame `index` at `rep` for play position `position`, with `queued` frames still to
+// be decrypted ahead of it. Returns the rep actually fetched, or -1 when the frame was skipped
+// (*out_buf = NULL). A failed download returns its rep with *out_buf = NULL and is counted in
+// `failed`, not `completed`. *dl_ms includes the time spent on aborted attempts.
+int deadline_fetch(DeadlineScheduler* s, int index, int position, int rep, int queued,
+                   GByteArray** out_buf, double* dl_ms);
+
+// Report the decrypt time of a finished frame (pipelined mode).
+void deadline_note_decode(DeadlineScheduler* s, double dec_ms);
+
+void deadline_report(DeadlineScheduler* s);
+void deadline_free(DeadlineScheduler* s);
+
+#endif
@@ -45,9 +45,25 @@ int decryptor_init(const char* pub, const char* priv, const char* pattern, int e
 }
 
 
+void decryptor_thread_exit(void) {
+#ifdef USE_CPABE_LIB
+    if (g_enabled) cpabe_thread_cleanup();
+#endif
+}
+
 void decryptor_shutdown(void) {
 #ifdef USE_CPABE_LIB
     if (g_enabled) {
+        int hits = 0, misses = 0;
+        cpabe_key_cache_stats(&hits, &misses);
+        if (hits + misses > 0)
+            fprintf(stderr, "[info] GOP key cache: %d hits, %d misses\n", hits, misses);
+        size_t peak = 0;
+        int grows = 0;
+        cpabe_scratch_stats(&peak, &grows);
+        if (peak > 0)
+            fprintf(stderr, "[info] decrypt scratch: peak %.1f MB per frame, %d arena grows\n", peak / 1e6, grows);
+        cpabe_thread_cleanup();
         cpabe_ctx_free();
     }
 #endif
@@ -67,4 +83,80 @@ int decrypt_file_buffer(GByteArray* buffer, double* time_ms, int write_output_fl
     // If not using CP-ABE, just return success
     return 0;
 #endif
-}
\ No newline at end of file
+}
+int decrypt_file_view(const guint8* data, size_t len, GByteArray* out, double* time_ms, int write_output_flag, const char* output_ply_filename) {
+    if (time_ms) *time_ms = 0.0;
+    if (!g_enabled) {
+        g_byte_array_set_size(out, 0);
+        g_byte_array_append(out, data, (guint)len);
+        return 0;
+    }
+#ifdef USE_CPABE_LIB
+    return cpabe_decrypt_ply_view(data, len, out, time_ms, write_output_flag, output_ply_filename);
+#else
+    (void)write_output_flag; (void)output_ply_filename;
+    g_byte_array_set_size(out, 0);
+    g_byte_array_append(out, data, (guint)len);
+    return 0;
+#endif
+}
+
+int decryptor_locate_trailer(const guint8* head, size_t len, size_t* header_end, size_t* trailer_off) {
+    if (!g_enabled) return -1;
+#ifdef USE_CPABE_LIB
+    return cpabe_locate_trailer(head, len, header_end, trailer_off);
+#else
+    (void)head; (void)len; (void)header_end; (void)trailer_off;
+    return -1;
+#endif
+}
+
+int decryptor_locate_cph(const guint8* trailer, size_t len, size_t* cph_off) {
+    if (!g_enabled) return -1;
+#ifdef USE_CPABE_LIB
+    return cpabe_locate_cph(trailer, len, cph_off);
+#else
+    (void)trailer; (void)len; (void)cph_off;
+    return -1;
+#endif
+}
+
+int decryptor_vvs_locate_cph(const guint8* head, size_t len, size_t* cph_off, size_t* cph_end, size_t* file_size) {
+    if (!g_enabled) return -1;
+#ifdef USE_CPABE_LIB
+    return cpabe_vvs_locate_cph(head, len, cph_off, cph_end, file_size);
+#else
+    (void)head; (void)len; (void)cph_off; (void)cph_end; (void)file_size;
+    return -1;
+#endif
+}
+
+DecryptKey* decrypt_unwrap_key(const guint8* cph, size_t len, double* time_ms) {
+    if (time_ms) *time_ms = 0.0;
+    if (!g_enabled) return NULL;
+#ifdef USE_CPABE_LIB
+    return cpabe_unwrap_key(cph, len, time_ms);
+#else
+    (void)cph; (void)len;
+    return NULL;
+#endif
+}
+
+int decrypt_file_buffer_with_key(GByteArray* buffer, DecryptKey* key, double* time_ms, int write_output_flag, const char* output_ply_filename) {
+    if (time_ms) *time_ms = 0.0;
+    if (!g_enabled) return 0;
+#ifdef USE_CPABE_LIB
+    return cpabe_decrypt_ply_buffer_with_key(buffer, key, time_ms, write_output_flag, output_ply_filename);
+#else
+    (void)buffer; (void)key; (void)write_output_flag; (void)output_ply_filename;
+    return 0;
+#endif
+}
+
+void decrypt_key_free(DecryptKey* key) {
+#ifdef USE_CPABE_LIB
+    cpabe_key_free(key);
+#else
+    (void)key;
+#endif
+}
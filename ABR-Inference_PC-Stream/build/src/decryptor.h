@@ -7,7 +7,31 @@ int decryptor_init(const char* pub, const char* priv, const char* pattern, int e
 // Decrypt a single frame from memory buffer. If disabled, returns 0 and sets *time_ms = 0.0.
 int decrypt_file_buffer(GByteArray* buffer, double* time_ms, int write_output_flag, const char* output_ply_filename);
 
-// Cleanup any allocated state.
+// Same for a frame in read-only memory (--mmap): data is not modified, out receives the
+// decrypted frame. If disabled, out receives a copy of data.
+int decrypt_file_view(const guint8* data, size_t len, GByteArray* out, double* time_ms, int write_output_flag, const char* output_ply_filename);
+
+// Progressive decrypt (--progressive): the frame arrives out of order (HTTP Range). The CP-ABE
+// key unwrap needs only the small ciphertext at the end of the trailer, so it runs while the
+// rest of the frame is in flight; decrypt_file_buffer_with_key() finishes AES/rebuild once the
+// whole frame is in the buffer.
+typedef struct CpabeFrameKey DecryptKey;
+
+// 0 ok, 1 need more bytes, -1 bad data or decryption not available.
+// Trailer offset from the start of the frame; ciphertext offset from the start of the trailer.
+int decryptor_locate_trailer(const guint8* head, size_t len, size_t* header_end, size_t* trailer_off);
+int decryptor_locate_cph(const guint8* trailer, size_t len, size_t* cph_off);
+// .vvs container: [cph_off, cph_end) of the ciphertext field and the file size, read straight
+// from the prologue. 0 ok, 1 need more bytes, -1 not a .vvs container.
+int decryptor_vvs_locate_cph(const guint8* head, size_t len, size_t* cph_off, size_t* cph_end, size_t* file_size);
+DecryptKey* decrypt_unwrap_key(const guint8* cph, size_t len, double* time_ms);
+int decrypt_file_buffer_with_key(GByteArray* buffer, DecryptKey* key, double* time_ms, int write_output_flag, const char* output_ply_filename);
+void decrypt_key_free(DecryptKey* key);
+
+// Free the calling thread's decrypt scratch arena; call from worker threads before they exit.
+void decryptor_thread_exit(void);
+
+// Cleanup any allocated state (including the calling thread's scratch arena).
 void decryptor_shutdown(void);
 
 #endif
@@ -1,70 +1,212 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <glib.h>
 #include "download_queue.h"
+#include "telemetry.h"
+#include <stdint.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
-DownloadQueue* download_queue_init(int capacity) {
-    DownloadQueue* q = malloc(sizeof(DownloadQueue));
+static double mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void futex_wait(atomic_uint* word, unsigned val) {
+    syscall(SYS_futex, (unsigned*)word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake_all(atomic_uint* word) {
+    syscall(SYS_futex, (unsigned*)word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static DownloadQueue* queue_new(int capacity, int spsc) {
+    if (capacity < 1) return NULL;
+    // aligned_alloc wants a multiple of the alignment; sizeof already is one
+    DownloadQueue* q = aligned_alloc(_Alignof(DownloadQueue), sizeof(DownloadQueue));
     if (!q) return NULL;
-    q->items = malloc(sizeof(Frame*) * capacity);
-    if (!q->items) { free(q); return NULL; }
+    q->cells = malloc(sizeof(DownloadQueueCell) * capacity);
+    if (!q->cells) { free(q); return NULL; }
+    for (int i = 0; i < capacity; i++) {
+        atomic_init(&q->cells[i].seq, 2 * (size_t)i);
+        q->cells[i].frame = NULL;
+    }
     q->capacity = capacity;
-    q->count = 0;
-    q->head = 0;
-    q->tail = 0;
-    pthread_mutex_init(&q->mutex, NULL);
-    pthread_cond_init(&q->not_empty, NULL);
-    pthread_cond_init(&q->not_full, NULL);
+    q->spsc = spsc;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->not_empty, 0);
+    atomic_init(&q->not_full, 0);
+    q->producer = STAGE_NONE;
+    q->consumer = STAGE_NONE;
     return q;
 }
 
+DownloadQueue* download_queue_init(int capacity) {
+    return queue_new(capacity, 0);
+}
+
+DownloadQueue* download_queue_init_spsc(int capacity) {
+    return queue_new(capacity, 1);
+}
+
 void download_queue_free(DownloadQueue* q) {
     if (!q) return;
-    free(q->items);
-    pthread_mutex_destroy(&q->mutex);
-    pthread_cond_destroy(&q->not_empty);
-    pthread_cond_destroy(&q->not_full);
+    free(q->cells);
     free(q);
 }
 
+// --- ring operations, no blocking ---
+
+// SPSC: only the producer moves tail and only the consumer moves head.
+static int spsc_push(DownloadQueue* q, Frame* frame) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - head == (size_t)q->capacity) return -1;
+    q->cells[tail % q->capacity].frame = frame;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+static Frame* spsc_pop(DownloadQueue* q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+    Frame* frame = q->cells[head % q->capacity].frame;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return frame;
+}
+
+// MPMC: the cell of position p is free for the push at p when seq == 2p and holds that push's
+// frame for the pop at p when seq == 2p + 1; the pop hands it to the next lap (2(p + capacity)).
+// Doubling keeps "free" and "full" apart even with one cell. Positions are claimed with a CAS.
+static int mpmc_push(DownloadQueue* q, Frame* frame) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    DownloadQueueCell* c;
+    for (;;) {
+        c = &q->cells[pos % q->capacity];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(2 * pos);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return -1; // full: the pop of the previous lap has not happened yet
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    c->frame = frame;
+    atomic_store_explicit(&c->seq, 2 * pos + 1, memory_order_release);
+    return 0;
+}
+
+static Frame* mpmc_pop(DownloadQueue* q) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    DownloadQueueCell* c;
+    for (;;) {
+        c = &q->cells[pos % q->capacity];
+        size_t seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(2 * pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            return NULL; // empty
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    Frame* frame = c->frame;
+    atomic_store_explicit(&c->seq, 2 * (pos + q->capacity), memory_order_release);
+    return frame;
+}
+
+static int ring_push(DownloadQueue* q, Frame* frame) {
+    return q->spsc ? spsc_push(q, frame) : mpmc_push(q, frame);
+}
+
+static Frame* ring_pop(DownloadQueue* q) {
+    return q->spsc ? spsc_pop(q) : mpmc_pop(q);
+}
+
+// not_empty/not_full are event counts: bit 0 says a caller is about to sleep on the word, the
+// other bits count wake-ups. A caller that needs the ring to change sets the bit, re-checks the
+// ring and sleeps unless the word moved; the first push/pop after that clears the bit, bumps the
+// count and wakes every sleeper, later ones see the bit clear and skip the syscall. The fence
+// orders the ring update before the bit check, so either the sleeper sees the update or the
+// waker sees the bit.
+static void notify(atomic_uint* ev) {
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned v = atomic_load_explicit(ev, memory_order_relaxed);
+    do {
+        if (!(v & 1u)) return;
+    } while (!atomic_compare_exchange_weak(ev, &v, (v + 2u) & ~1u));
+    futex_wake_all(ev);
+}
+
+// --- public API ---
+
 int download_queue_push(DownloadQueue* q, Frame* frame) {
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    pthread_mutex_lock(&q->mutex);
-    while (q->count == q->capacity) {
-        pthread_cond_wait(&q->not_full, &q->mutex);
+    if (ring_push(q, frame) != 0) {
+        double start = mono_ms();
+        for (;;) {
+            unsigned key = atomic_fetch_or(&q->not_full, 1u) | 1u;
+            if (ring_push(q, frame) == 0) break;
+            futex_wait(&q->not_full, key);
+        }
+        telemetry_enqueue_wait(q->producer, mono_ms() - start);
     }
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    double wait_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
-    // if (wait_ms > 1.0) {
-    //     printf("[queue push] waited %.2f ms for space\n", wait_ms);
-    // }
-    q->items[q->tail] = frame;
-    q->tail = (q->tail + 1) % q->capacity;
-    q->count++;
-    pthread_cond_signal(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
+    notify(&q->not_empty);
+    telemetry_depth(q->consumer, download_queue_count(q));
     return 0;
 }
 
 Frame* download_queue_pop(DownloadQueue* q) {
-    // struct timespec start, end;
-    // clock_gettime(CLOCK_MONOTONIC, &start);
-    pthread_mutex_lock(&q->mutex);
-    while (q->count == 0) {
-        pthread_cond_wait(&q->not_empty, &q->mutex);
+    Frame* frame = ring_pop(q);
+    if (!frame) {
+        double start = mono_ms();
+        for (;;) {
+            unsigned key = atomic_fetch_or(&q->not_empty, 1u) | 1u;
+            if ((frame = ring_pop(q)) != NULL) break;
+            futex_wait(&q->not_empty, key);
+        }
+        telemetry_dequeue_wait(q->consumer, mono_ms() - start);
     }
-    // clock_gettime(CLOCK_MONOTONIC, &end);
-    // double wait_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
-    // if (wait_ms > 1.0) {
-    //     printf("[queue pop] waited %.2f ms for item\n\n\n\n", wait_ms);
-    // }
-    Frame* frame = q->items[q->head];
-    q->head = (q->head + 1) % q->capacity;
-    q->count--;
-    pthread_cond_signal(&q->not_full);
-    pthread_mutex_unlock(&q->mutex);
+    notify(&q->not_full);
+    telemetry_depth(q->consumer, download_queue_count(q));
+    return frame;
+}
+
+Frame* download_queue_try_pop(DownloadQueue* q) {
+    Frame* frame = ring_pop(q);
+    if (!frame) return NULL;
+    notify(&q->not_full);
+    telemetry_depth(q->consumer, download_queue_count(q));
     return frame;
 }
+
+int download_queue_try_push(DownloadQueue* q, Frame* frame) {
+    if (ring_push(q, frame) != 0) return -1;
+    notify(&q->not_empty);
+    telemetry_depth(q->consumer, download_queue_count(q));
+    return 0;
+}
+
+void download_queue_set_stages(DownloadQueue* q, int producer, int consumer) {
+    q->producer = producer;
+    q->consumer = consumer;
+}
+
+int download_queue_count(DownloadQueue* q) {
+    size_t head = atomic_load(&q->head);
+    size_t tail = atomic_load(&q->tail);
+    if (tail <= head) return 0;
+    size_t n = tail - head;
+    return n > (size_t)q->capacity ? q->capacity : (int)n;
+}
@@ -1,31 +1,57 @@
 #ifndef DOWNLOAD_QUEUE_H
 #define DOWNLOAD_QUEUE_H
 
-#include <pthread.h>
+#include <stdatomic.h>
 
 // Change Frame to your actual frame struct if needed
 typedef struct {
     int index; // frame index
+    long seq; // position in the stream, assigned by the pipeline source (ordered stages)
     GByteArray* buffer; // downloaded frame data in memory
     double dl_ms; // download time in ms
     int rep; // selected representation index
     size_t size_bytes; // size of downloaded buffer in bytes
+    double dec_ms; // decrypt time in ms (set by the decrypt stage / --sessions workers)
+    double inf_ms; // inference time in ms (set by the inference stage / --sessions workers, 0 = skipped)
+    void* owner; // owning session in --sessions mode, NULL otherwise
+    struct ProgressiveFrame* progressive; // --progressive: vertex rows may still be arriving
+    int skipped; // no data, later stages pass it on: --frame-deadline gave up (the player repeats the previous frame) or the download failed
+    int failed; // skipped because the download failed: the sink drops it (not buffered, logged or fed to the ABR)
+    struct LocalView* local; // --mmap: read-only mapping of the frame file, decrypted into buffer
 } Frame;
 
+// Bounded ring of Frame pointers. Push and pop are lock-free: a few atomic operations, no
+// mutex handoff. A caller sleeps (futex) only when it finds the ring full (push) or empty (pop),
+// and the other side makes a wake-up syscall only when someone is about to sleep.
+// download_queue_init() makes a multi-producer/multi-consumer ring; download_queue_init_spsc()
+// a cheaper one for one producer and one consumer at a time (handing either role to another
+// thread is fine as long as the handoff itself is synchronized).
 typedef struct {
-    Frame** items;
+    atomic_size_t seq;  // MPMC: which lap of the ring may use the cell next
+    Frame* frame;
+} DownloadQueueCell;
+
+typedef struct {
+    DownloadQueueCell* cells;
     int capacity;
-    int count;
-    int head;
-    int tail;
-    pthread_mutex_t mutex;
-    pthread_cond_t not_empty;
-    pthread_cond_t not_full;
+    int spsc;
+    _Alignas(64) atomic_size_t head; // pops so far (next cell to read)
+    _Alignas(64) atomic_size_t tail; // pushes so far (next cell to write)
+    _Alignas(64) atomic_uint not_empty; // futex event counts (download_queue.c)
+    atomic_uint not_full;
+    int producer; // telemetry stage pushing (enqueue waits), STAGE_NONE = untracked
+    int consumer; // telemetry stage popping (dequeue waits, input depth)
 } DownloadQueue;
 
 DownloadQueue* download_queue_init(int capacity);
+DownloadQueue* download_queue_init_spsc(int capacity);
 void download_queue_free(DownloadQueue* q);
 int download_queue_push(DownloadQueue* q, Frame* frame); // blocks if full
 Frame* download_queue_pop(DownloadQueue* q); // blocks if empty
+Frame* download_queue_try_pop(DownloadQueue* q); // NULL if empty
+int download_queue_try_push(DownloadQueue* q, Frame* frame); // -1 if full
+int download_queue_count(DownloadQueue* q); // snapshot; may be stale by the time it returns
+// Attribute waits and depth to telemetry stages (telemetry.h); untracked by default.
+void download_queue_set_stages(DownloadQueue* q, int producer, int consumer);
 
 #endif // DOWNLOAD_QUEUE_H
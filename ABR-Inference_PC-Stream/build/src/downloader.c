@@ -2,54 +2,182 @@
 #include <curl/curl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <glib.h>
 #include "downloader.h"
 #include "utils.h"
+#include "netem.h"
+#include "framepool.h"
 
 typedef struct {
-    GByteArray* buf;
+    GByteArray* buf;       // from the frame pool, taken once the size is known
+    int size_class;
+    NetEmTransfer net;
+    DownloadCancelFn should_cancel;
+    void* cancel_user;
 } MemDownloadCtx;
 
+// Content-Length arrives before the body: take a pooled buffer that already fits it
+static size_t header_mem(char *line, size_t size, size_t nitems, void *userdata) {
+    MemDownloadCtx* ctx = (MemDownloadCtx*)userdata;
+    size_t n = size * nitems;
+    unsigned long long len;
+    if (n > 15 && !strncasecmp(line, "Content-Length:", 15) && sscanf(line + 15, " %llu", &len) == 1) {
+        if (!ctx->buf) ctx->buf = frame_pool_get(ctx->size_class, (size_t)len);
+        else frame_pool_reserve(ctx->buf, (size_t)len); // redirect: the final response decides
+    }
+    return n;
+}
+
 static size_t write_data_mem(void *ptr, size_t size, size_t nmemb, void *userdata) {
     MemDownloadCtx* ctx = (MemDownloadCtx*)userdata;
     size_t total = size * nmemb;
+    netem_on_bytes(&ctx->net, total); // no-op unless --net-* emulation is on
+    if (!ctx->buf) ctx->buf = frame_pool_get(ctx->size_class, 0); // no Content-Length (chunked)
     g_byte_array_append(ctx->buf, (guint8*)ptr, (guint)total);
     return total;
 }
 
-int download_file_mem(const char* url, GByteArray** out_buf, double* time_ms) {
+static int xferinfo_cancel(void *userdata, curl_off_t dltotal, curl_off_t dlnow,
+                           curl_off_t ultotal, curl_off_t ulnow) {
+    (void)ultotal; (void)ulnow;
+    MemDownloadCtx* ctx = (MemDownloadCtx*)userdata;
+    return ctx->should_cancel(ctx->cancel_user, dltotal > 0 ? (size_t)dltotal : 0,
+                              dlnow > 0 ? (size_t)dlnow : 0);
+}
+
+int download_file_mem(const char* url, int size_class, GByteArray** out_buf, double* time_ms) {
+    return download_file_mem_cancelable(url, size_class, out_buf, time_ms, NULL, NULL);
+}
+
+int download_file_mem_cancelable(const char* url, int size_class, GByteArray** out_buf, double* time_ms,
+                                 DownloadCancelFn should_cancel, void* user) {
     CURL *curl = curl_easy_init();
     if (!curl) return -1;
 
-    MemDownloadCtx ctx;
-    ctx.buf = g_byte_array_new();
+    MemDownloadCtx ctx = {0};
+    ctx.size_class = size_class;
+    ctx.should_cancel = should_cancel;
+    ctx.cancel_user = user;
 
     double start = now_ms_mono();
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_mem);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ctx);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data_mem);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+    if (should_cancel) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_cancel);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &ctx);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
 
     int res = curl_easy_perform(curl);
     curl_easy_cleanup(curl);
 
     *time_ms = now_ms_mono() - start;
     if (res == 0) {
-        *out_buf = ctx.buf;
+        *out_buf = ctx.buf ? ctx.buf : frame_pool_get(size_class, 0); // empty body
     } else {
-        g_byte_array_free(ctx.buf, 1);
+        frame_pool_put(ctx.buf);
         *out_buf = NULL;
     }
     return res;
 }
 
+typedef struct {
+    GByteArray* buf;
+    size_t first;        // file offset of the first byte requested
+    size_t written;
+    size_t total;        // file size (Content-Range, or Content-Length of a 200)
+    int partial;         // 206: bytes start at first; otherwise at 0
+    NetEmTransfer net;
+} RangeDownloadCtx;
+
+static __thread CURL* t_range_curl; // per-thread handle so header/trailer/rows share a connection
+
+static size_t range_header(char *line, size_t size, size_t nitems, void *userdata) {
+    RangeDownloadCtx* ctx = (RangeDownloadCtx*)userdata;
+    size_t n = size * nitems;
+    unsigned long long a, b, total;
+    if (n > 14 && !strncasecmp(line, "HTTP/", 5)) {
+        ctx->partial = 0; // new response (redirects): reset
+    } else if (n > 14 && !strncasecmp(line, "Content-Range:", 14) &&
+               sscanf(line + 14, " bytes %llu-%llu/%llu", &a, &b, &total) == 3) {
+        ctx->partial = 1;
+        ctx->total = (size_t)total;
+    } else if (n > 15 && !strncasecmp(line, "Content-Length:", 15) && !ctx->partial &&
+               sscanf(line + 15, " %llu", &total) == 1) {
+        ctx->total = (size_t)total;
+    }
+    return n;
+}
+
+static size_t write_data_range(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    RangeDownloadCtx* ctx = (RangeDownloadCtx*)userdata;
+    size_t n = size * nmemb;
+    netem_on_bytes(&ctx->net, n);
+    size_t off = (ctx->partial ? ctx->first : 0) + ctx->written;
+    if (off + n > ctx->buf->len) g_byte_array_set_size(ctx->buf, (guint)(off + n));
+    memcpy(ctx->buf->data + off, ptr, n);
+    ctx->written += n;
+    return n;
+}
+
+int download_range_mem(const char* url, size_t first, size_t last, GByteArray* file_buf,
+                       size_t* total_len, double* time_ms) {
+    if (!t_range_curl) t_range_curl = curl_easy_init();
+    CURL *curl = t_range_curl;
+    if (!curl || !file_buf) return -1;
+
+    RangeDownloadCtx ctx = {0};
+    ctx.buf = file_buf;
+    ctx.first = first;
+    char range[64];
+    if (last == DOWNLOAD_TO_END) snprintf(range, sizeof(range), "%zu-", first);
+    else snprintf(range, sizeof(range), "%zu-%zu", first, last);
+
+    double start = now_ms_mono();
+    curl_easy_reset(curl); // keeps the connection cache
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, range_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ctx);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data_range);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+
+    int res = curl_easy_perform(curl);
+    *time_ms = now_ms_mono() - start;
+    if (total_len) *total_len = ctx.total;
+    if (res != 0) return res;
+    return ctx.partial ? 0 : DOWNLOAD_FULL_BODY;
+}
+
+void download_range_cleanup(void) {
+    if (t_range_curl) curl_easy_cleanup(t_range_curl);
+    t_range_curl = NULL;
+}
+
 // For write-out to disk in case of HTTPS and HTTP-only (no decryption)
 
 
-static size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-    return fwrite(ptr, size, nmemb, stream);
+typedef struct {
+    FILE* fp;
+    NetEmTransfer net;
+} FileDownloadCtx;
+
+static size_t write_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    FileDownloadCtx* ctx = (FileDownloadCtx*)userdata;
+    netem_on_bytes(&ctx->net, size * nmemb);
+    return fwrite(ptr, size, nmemb, ctx->fp);
 }
 
 int download_file(const char* url, const char* outpath, double* time_ms) {
@@ -62,13 +190,16 @@ int download_file(const char* url, const char* outpath, double* time_ms) {
         return -1;
     }
 
+    FileDownloadCtx ctx = {0};
+    ctx.fp = fp;
+
     double start = now_ms_mono();
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
 
     int res = curl_easy_perform(curl);
     fclose(fp);
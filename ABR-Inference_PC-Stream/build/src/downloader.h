@@ -2,9 +2,34 @@
 #define DOWNLOADER_H
 #include <glib.h>
 
-// Download file to memory buffer (GByteArray)
-int download_file_mem(const char* url, GByteArray** out_buf, double* time_ms);
+// Download file to memory buffer (GByteArray). The buffer comes from the frame pool
+// (framepool.h, size_class = representation index), sized from Content-Length before the body
+// arrives; hand it back with frame_pool_put().
+int download_file_mem(const char* url, int size_class, GByteArray** out_buf, double* time_ms);
 
+// Polled by curl while a transfer runs (several times a second) with the expected size
+// (0 = unknown yet) and the bytes received so far; non-zero aborts it.
+typedef int (*DownloadCancelFn)(void* user, size_t dl_total, size_t dl_now);
+
+#define DOWNLOAD_CANCELLED 42  // CURLE_ABORTED_BY_CALLBACK
+
+// download_file_mem() that can be aborted mid-transfer. Returns DOWNLOAD_CANCELLED
+// with *out_buf = NULL when should_cancel fired.
+int download_file_mem_cancelable(const char* url, int size_class, GByteArray** out_buf, double* time_ms,
+                                 DownloadCancelFn should_cancel, void* user);
+
+#define DOWNLOAD_FULL_BODY 1   // download_range_mem(): server ignored Range and sent the whole file
+
+// Fetch bytes [first, last] of url (last = DOWNLOAD_TO_END for the rest of the file) and store
+// them at the same offsets in file_buf, growing it if needed (never shrinking, so a buffer sized
+// to the whole file up front is not reallocated). *total_len receives the file size from
+// Content-Range. Returns 0, DOWNLOAD_FULL_BODY when the whole file was written from offset 0,
+// or a curl error. Consecutive calls from one thread reuse a keep-alive connection;
+// call download_range_cleanup() before that thread exits.
+#define DOWNLOAD_TO_END ((size_t)-1)
+int download_range_mem(const char* url, size_t first, size_t last, GByteArray* file_buf,
+                       size_t* total_len, double* time_ms);
+void download_range_cleanup(void);
 
 // Download file to disk at outpath for HTTPS and HTTP-only (no decryption)
 int download_file(const char* url, const char* outpath, double* time_ms);
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "framepool.h"
+
+typedef struct {
+    GByteArray* buf;
+    size_t cap;            // bytes it holds without reallocating (what we asked glib for)
+    int cls;               // representation it was last used for
+    int in_use;
+} PoolBuf;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_on = 0;
+static int g_max_free = 0;
+static PoolBuf* g_bufs = NULL;  // every buffer the pool knows, in use or idle
+static int g_n = 0, g_alloc = 0, g_idle = 0;
+// stats
+static long g_hits = 0, g_misses = 0, g_grown = 0;
+static size_t g_bytes = 0, g_peak_bytes = 0;
+static int g_peak_bufs = 0;
+
+void frame_pool_init(int n_classes, int max_free) {
+    (void)n_classes; // classes are just tags on the buffers
+    pthread_mutex_lock(&g_lock);
+    g_on = 1;
+    g_max_free = max_free > 0 ? max_free : 1;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void note_bytes(void) {
+    if (g_bytes > g_peak_bytes) g_peak_bytes = g_bytes;
+    if (g_n > g_peak_bufs) g_peak_bufs = g_n;
+}
+
+// Grow e to hold size bytes, keeping its contents. Caller holds g_lock.
+static void reserve_locked(PoolBuf* e, size_t size) {
+    if (size <= e->cap) return;
+    guint len = e->buf->len;
+    g_byte_array_set_size(e->buf, (guint)size);
+    g_byte_array_set_size(e->buf, len);
+    g_bytes += size - e->cap;
+    e->cap = size;
+    note_bytes();
+}
+
+static PoolBuf* find_locked(GByteArray* buf) {
+    for (int k = 0; k < g_n; k++) {
+        if (g_bufs[k].buf == buf) return &g_bufs[k];
+    }
+    return NULL;
+}
+
+static PoolBuf* add_locked(GByteArray* buf, size_t cap, int cls) {
+    if (g_n == g_alloc) {
+        int n = g_alloc ? g_alloc * 2 : 16;
+        PoolBuf* p = realloc(g_bufs, (size_t)n * sizeof(PoolBuf));
+        if (!p) return NULL;
+        g_bufs = p;
+        g_alloc = n;
+    }
+    PoolBuf* e = &g_bufs[g_n++];
+    e->buf = buf;
+    e->cap = cap;
+    e->cls = cls;
+    e->in_use = 1;
+    g_bytes += cap;
+    note_bytes();
+    return e;
+}
+
+GByteArray* frame_pool_get(int cls, size_t size) {
+    pthread_mutex_lock(&g_lock);
+    if (!g_on) {
+        pthread_mutex_unlock(&g_lock);
+        return g_byte_array_sized_new((guint)size);
+    }
+    // best idle buffer: same rep and big enough, then any rep big enough, then the largest
+    // one to grow. With an unknown size take the largest of the rep (least likely to grow).
+    PoolBuf* best = NULL;
+    int best_rank = 3;
+    for (int k = 0; k < g_n; k++) {
+        PoolBuf* e = &g_bufs[k];
+        if (e->in_use) continue;
+        int rank = e->cap < size ? 2 : (e->cls == cls ? 0 : 1);
+        int better = rank < best_rank;
+        if (!better && rank == best_rank) {
+            better = (rank < 2 && size > 0) ? e->cap < best->cap : e->cap > best->cap;
+        }
+        if (better) { best = e; best_rank = rank; }
+    }
+    GByteArray* buf = NULL;
+    if (best) {
+        if (best_rank < 2) g_hits++;
+        else { g_misses++; g_grown++; }
+        best->in_use = 1;
+        best->cls = cls;
+        g_idle--;
+        g_byte_array_set_size(best->buf, 0);
+        reserve_locked(best, size);
+        buf = best->buf;
+    } else {
+        g_misses++;
+        buf = g_byte_array_sized_new((guint)size);
+        if (!add_locked(buf, size, cls)) {
+            pthread_mutex_unlock(&g_lock);
+            return buf; // untracked: adopted (or freed) on put
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return buf;
+}
+
+void frame_pool_reserve(GByteArray* buf, size_t size) {
+    if (!buf) return;
+    pthread_mutex_lock(&g_lock);
+    PoolBuf* e = g_on ? find_locked(buf) : NULL;
+    if (e) {
+        reserve_locked(e, size);
+    } else if (size > buf->len) {
+        guint len = buf->len;
+        g_byte_array_set_size(buf, (guint)size);
+        g_byte_array_set_size(buf, len);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void frame_pool_put(GByteArray* buf) {
+    if (!buf) return;
+    pthread_mutex_lock(&g_lock);
+    if (!g_on) {
+        pthread_mutex_unlock(&g_lock);
+        g_byte_array_free(buf, 1);
+        return;
+    }
+    PoolBuf* e = find_locked(buf);
+    if (!e) e = add_locked(buf, buf->len, 0);
+    if (!e || g_idle >= g_max_free) {
+        // enough idle buffers already: release this one
+        if (e) {
+            g_bytes -= e->cap;
+            *e = g_bufs[--g_n];
+        }
+        pthread_mutex_unlock(&g_lock);
+        g_byte_array_free(buf, 1);
+        return;
+    }
+    // decrypt rebuilds in place, so the array may have grown past what we reserved
+    if (buf->len > e->cap) {
+        g_bytes += buf->len - e->cap;
+        e->cap = buf->len;
+        note_bytes();
+    }
+    e->in_use = 0;
+    g_idle++;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void frame_pool_report(void) {
+    pthread_mutex_lock(&g_lock);
+    if (g_hits + g_misses > 0) {
+        printf("[info] frame pool: %ld hits, %ld misses (%ld grown), peak %.1f MB in %d buffers\n",
+               g_hits, g_misses, g_grown, g_peak_bytes / 1e6, g_peak_bufs);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void frame_pool_shutdown(void) {
+    pthread_mutex_lock(&g_lock);
+    // buffers still out belong to their callers; put() frees them once the pool is off
+    for (int k = 0; k < g_n; k++) {
+        if (!g_bufs[k].in_use) g_byte_array_free(g_bufs[k].buf, 1);
+    }
+    free(g_bufs);
+    g_bufs = NULL;
+    g_n = g_alloc = g_idle = 0;
+    g_on = 0;
+    pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,34 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <stddef.h>
+#include <glib.h>
+
+// Recycled frame payload buffers. A frame is downloaded into a GByteArray, decrypted in place
+// and dropped once it is played; the pool keeps those arrays (with their allocation) instead
+// of freeing them, so after warm-up the next frame reuses one that is already big enough.
+// Size classes are the representations: frames of one rep are close in size, so a buffer that
+// held one fits the next without growing. When no buffer of the frame's rep is free, any free
+// buffer that is large enough is taken instead (down-switch); an up-switch grows one.
+// The downloader learns the size from Content-Length and asks for that much up front, so the
+// body is written without reallocating.
+// Shared by all threads. Before frame_pool_init() (and after frame_pool_shutdown()) get/put
+// fall back to plain g_byte_array allocation, so every caller can use them unconditionally.
+
+// n_classes = number of representations; max_free = buffers kept while idle (the rest are freed).
+void frame_pool_init(int n_classes, int max_free);
+
+// Empty buffer (len 0) able to hold size bytes without reallocating; size 0 = unknown.
+GByteArray* frame_pool_get(int cls, size_t size);
+
+// Make room for size bytes in a buffer from frame_pool_get() (e.g. once Content-Length arrives).
+void frame_pool_reserve(GByteArray* buf, size_t size);
+
+// Give a buffer back (NULL is ignored). Buffers not obtained from the pool are adopted.
+void frame_pool_put(GByteArray* buf);
+
+// Print hits/misses and peak bytes held by the pool (in use + idle), then free everything.
+void frame_pool_report(void);
+void frame_pool_shutdown(void);
+
+#endif
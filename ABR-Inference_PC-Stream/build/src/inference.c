@@ -10,6 +10,9 @@
 
 static PyObject *g_module = NULL;
 static PyObject *g_model = NULL;
+// Main thread state saved after init: the GIL is released so any thread (main decrypt loop or
+// --sessions workers) can run inference by taking it with PyGILState_Ensure().
+static PyThreadState *g_saved_state = NULL;
 
 static double now_sec() {
     struct timespec ts;
@@ -111,9 +114,12 @@ int inference_init(const char* model_path) {
         return -4;
     }
 
+    g_saved_state = PyEval_SaveThread();
     return 0;
 }
 
+static int call_run_inference(float* points, int N);
+
 int inference_run_buffer(GByteArray* ply_buf, double* inference_ms) {
     if (!ply_buf) return -1;
     if (!g_module) return -2;
@@ -131,18 +137,30 @@ int inference_run_buffer(GByteArray* ply_buf, double* inference_ms) {
     //             points[i*3 + 0], points[i*3 + 1], points[i*3 + 2]);
     // }
 
+    // Python calls need the GIL; it is released between frames (see inference_init)
+    PyGILState_STATE gil = PyGILState_Ensure();
+    int rc = call_run_inference(points, N);
+    PyGILState_Release(gil);
+    free(points);
+    if (rc != 0) return rc;
+
+    double t1 = now_sec();
+    if (inference_ms) *inference_ms = (t1 - t0) * 1000.0;
+    return 0;
+}
+
+// Hand N points to rf_sr_api.run_inference (GIL held by the caller)
+static int call_run_inference(float* points, int N) {
     // Create numpy array (N x 3) using points (will copy because we cannot rely on caller's memory lifetime)
     npy_intp dims[2] = {N, 3};
     PyObject* np_array = PyArray_SimpleNewFromData(2, dims, NPY_FLOAT32, points);
     if (!np_array) {
-        free(points);
         return -4;
     }
 
     // Ensure array owns its data so Python can manage it (make copy)
     PyObject* np_copy = PyArray_NewCopy((PyArrayObject*)np_array, NPY_ANYORDER);
     Py_DECREF(np_array);
-    free(points);
     if (!np_copy) return -5;
 
     PyObject *infer_func = PyObject_GetAttrString(g_module, "run_inference");
@@ -166,13 +184,11 @@ int inference_run_buffer(GByteArray* ply_buf, double* inference_ms) {
     // Expect result to be a numpy array of floats; for logging we collapse to a single label
     // discard numeric output here; only measure time
     Py_DECREF(result);
-
-    double t1 = now_sec();
-    if (inference_ms) *inference_ms = (t1 - t0) * 1000.0;
     return 0;
 }
 
 void inference_shutdown(void) {
+    if (g_saved_state) { PyEval_RestoreThread(g_saved_state); g_saved_state = NULL; }
     if (g_model) { Py_DECREF(g_model); g_model = NULL; }
     if (g_module) { Py_DECREF(g_module); g_module = NULL; }
     if (Py_IsInitialized()) Py_Finalize();
@@ -0,0 +1,429 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include <glib.h>
+#include "loadgen.h"
+#include "buffer.h"
+#include "decryptor.h"
+#include "download_queue.h"
+#include "inference.h"
+#include "utils.h"
+#include "framepool.h"
+#include "telemetry.h"
+
+#define LOOP_POLL_MS 5   // upper bound on player tick latency
+
+typedef struct {
+    int id;
+    Buffer* buffer;
+    Logger* logger;
+    ABR* abr;
+
+    // download side (owned by the event loop thread)
+    CURL* easy;
+    GByteArray* dl_buf;
+    int dl_frame, dl_rep;
+    double dl_start_ms;
+    int next_frame;          // frame cursor
+    int outstanding;         // a frame is downloading or decrypting
+    double start_at_ms;      // staggered start
+    int started;
+
+    // player simulation (owned by the event loop thread)
+    int playing, in_stall, done;
+    int played;
+    double next_consume_ms;
+    double stall_start_ms;
+    double startup_ms;
+
+    // inference gating (touched only by the worker holding this session's frame)
+    double inf_sum_ms;
+    int inf_runs;
+
+    // summary
+    double bytes;
+    int frames, failed, stalls, switches, last_rep;
+    double stall_ms, dl_ms_sum, dec_ms_sum, bitrate_sum;
+} Session;
+
+typedef struct {
+    MPDInfo* mpd;
+    const LoadGenConfig* cfg;
+    DownloadQueue* jobs;     // downloaded frames waiting for a worker
+    DownloadQueue* ready;    // decrypted frames back to the event loop
+    CURLM* multi;
+} LoadGen;
+
+static void ensure_dir(const char* path) {
+    mkdir(path, 0755);
+}
+
+static size_t write_session(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    Session* s = (Session*)userdata;
+    size_t total = size * nmemb;
+    g_byte_array_append(s->dl_buf, (guint8*)ptr, (guint)total);
+    return total;
+}
+
+static size_t session_header(char *line, size_t size, size_t nitems, void *userdata) {
+    Session* s = (Session*)userdata;
+    size_t n = size * nitems;
+    unsigned long long len;
+    if (n > 15 && !strncasecmp(line, "Content-Length:", 15) && sscanf(line + 15, " %llu", &len) == 1) {
+        frame_pool_reserve(s->dl_buf, (size_t)len);
+    }
+    return n;
+}
+
+// --- Worker pool: decrypt + optional inference, then hand the frame back to the loop ---
+static void* worker_func(void* arg) {
+    LoadGen* lg = (LoadGen*)arg;
+    const LoadGenConfig* cfg = lg->cfg;
+    for (;;) {
+        Frame* f = download_queue_pop(lg->jobs);
+        if (f->index < 0) { // shutdown marker
+            free(f);
+            decryptor_thread_exit();
+            break;
+        }
+        Session* s = (Session*)f->owner;
+        if (f->buffer) {
+            int rc = decrypt_file_buffer(f->buffer, &f->dec_ms, 0, NULL);
+            if (rc != 0) fprintf(stderr, "[warn] session %d: decrypt failed (rc=%d) for frame %d\n", s->id, rc, f->index);
+            telemetry_busy(STAGE_DECRYPT, f->dec_ms);
+        }
+        int is_highest = f->rep == lg->mpd->n_reps - 1;
+        double avg = s->inf_runs ? s->inf_sum_ms / s->inf_runs : 0.0;
+        if (cfg->inference && f->buffer && !is_highest && avg < cfg->inference_threshold_ms) {
+            if (inference_run_buffer(f->buffer, &f->inf_ms) == 0) {
+                s->inf_sum_ms += f->inf_ms;
+                s->inf_runs++;
+                telemetry_busy(STAGE_INFERENCE, f->inf_ms);
+            } else {
+                f->inf_ms = 0.0;
+            }
+        }
+        download_queue_push(lg->ready, f);
+        curl_multi_wakeup(lg->multi);
+    }
+    return NULL;
+}
+
+// Frame is playable: buffer it, log it, feed ABR. A failed download is dropped and the
+// session's player stops waiting for it.
+static void on_frame_ready(LoadGen* lg, Session* s, Frame* f) {
+    double t0 = now_ms_mono();
+    if (f->failed) {
+        s->failed++;
+        s->outstanding = 0;
+        free(f);
+        telemetry_busy(STAGE_BUFFER, now_ms_mono() - t0);
+        return;
+    }
+    if (buffer_add(s->buffer) != 0) {
+        fprintf(stderr, "[warn] session %d: buffer full, frame %d dropped\n", s->id, f->index);
+    }
+    Logger* log = s->logger;
+    logger_add_frame(log, f->index, f->dl_ms, f->dec_ms, s->buffer->count);
+    if (log->frame_size > 0) {
+        FrameLog* fl = &log->frame_logs[log->frame_size - 1];
+        fl->rep = f->rep;
+        fl->bitrate = lg->mpd->bitrates[f->rep];
+        fl->size_bytes = f->size_bytes;
+        fl->inference_ms = f->inf_ms;
+    }
+    if (s->abr) abr_update_stats(s->abr, f->size_bytes, f->dl_ms + f->dec_ms);
+
+    s->frames++;
+    s->bytes += (double)f->size_bytes;
+    s->dl_ms_sum += f->dl_ms;
+    s->dec_ms_sum += f->dec_ms;
+    s->bitrate_sum += lg->mpd->bitrates[f->rep];
+    if (s->frames > 1 && f->rep != s->last_rep) s->switches++;
+    s->last_rep = f->rep;
+    s->outstanding = 0;
+
+    frame_pool_put(f->buffer);
+    free(f);
+    telemetry_busy(STAGE_BUFFER, now_ms_mono() - t0);
+}
+
+static void on_download_done(LoadGen* lg, Session* s, CURLcode res) {
+    curl_multi_remove_handle(lg->multi, s->easy);
+    Frame* f = calloc(1, sizeof(Frame));
+    f->index = s->dl_frame;
+    f->rep = s->dl_rep;
+    f->owner = s;
+    f->dl_ms = now_ms_mono() - s->dl_start_ms;
+    if (res == CURLE_OK) {
+        f->buffer = s->dl_buf;
+        f->size_bytes = f->buffer->len;
+    } else {
+        fprintf(stderr, "[warn] session %d: download failed (%s) for frame %d\n",
+                s->id, curl_easy_strerror(res), f->index);
+        frame_pool_put(s->dl_buf);
+        f->skipped = f->failed = 1;
+    }
+    s->dl_buf = NULL;
+    telemetry_busy(STAGE_DOWNLOAD, f->dl_ms);
+    if (lg->cfg->decrypt || lg->cfg->inference) {
+        download_queue_push(lg->jobs, f);
+    } else {
+        on_frame_ready(lg, s, f);
+    }
+}
+
+// Start the next download when the session has room (one frame in flight per session,
+// like the single downloader thread of the normal client)
+static void maybe_start_download(LoadGen* lg, Session* s) {
+    int total = lg->mpd->total_frames;
+    if (s->outstanding || s->next_frame >= total) return;
+    if (s->buffer->count >= s->buffer->max_frames) return;
+
+    int i = s->next_frame++;
+    int rep = s->abr ? abr_select_for_frame(s->abr, i, s->buffer->count) : 0;
+    char url[1024];
+    if (mpd_frame_url(lg->mpd, rep, i, url, sizeof(url)) < 0) {
+        fprintf(stderr, "[warn] session %d: no URL for frame %d (rep %d)\n", s->id, i, rep);
+        url[0] = '\0';
+    }
+    s->dl_buf = frame_pool_get(rep, 0); // sized by session_header() once Content-Length arrives
+    s->dl_frame = i;
+    s->dl_rep = rep;
+    s->dl_start_ms = now_ms_mono();
+    s->outstanding = 1;
+    curl_easy_setopt(s->easy, CURLOPT_URL, url);
+    curl_multi_add_handle(lg->multi, s->easy);
+}
+
+// Virtual player for one session, advanced to `now`. Mirrors simulate_player(): wait for a
+// full buffer, consume one frame per interval, stall while empty, rebase after a stall.
+static void player_tick(LoadGen* lg, Session* s, double now) {
+    int total = lg->mpd->total_frames - s->failed; // dropped frames never arrive
+    double interval = 1000.0 / lg->mpd->frame_rate;
+    Buffer* b = s->buffer;
+    if (s->done) return;
+    if (!s->playing) {
+        if (b->count < b->max_frames && b->count < total) return;
+        s->playing = 1;
+        s->next_consume_ms = now;
+        s->startup_ms = now - s->start_at_ms;
+        logger_add_player_event(s->logger, "playback_start", 0, b->count);
+    }
+    while (s->played < total) {
+        if (s->in_stall) {
+            if (b->count == 0) return;
+            double dur = now - s->stall_start_ms;
+            logger_add_stall(s->logger, s->stall_start_ms, dur);
+            logger_add_player_event(s->logger, "stall_end", s->played, b->count);
+            s->stall_ms += dur;
+            s->in_stall = 0;
+            s->next_consume_ms = now;
+        }
+        if (now < s->next_consume_ms) return;
+        if (b->count == 0) {
+            s->in_stall = 1;
+            s->stall_start_ms = s->next_consume_ms;
+            s->stalls++;
+            logger_add_player_event(s->logger, "stall_start", s->played, b->count);
+            return;
+        }
+        buffer_consume(b);
+        s->played++;
+        s->next_consume_ms += interval;
+    }
+    s->done = 1;
+    logger_add_player_event(s->logger, "playback_end", s->played, b->count);
+}
+
+static void write_session_logs(const LoadGenConfig* cfg, Session* s) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sessions/s%04d_stream.csv", cfg->log_dir, s->id);
+    logger_flush(s->logger, path);
+    snprintf(path, sizeof(path), "%s/sessions/s%04d_player.csv", cfg->log_dir, s->id);
+    logger_flush_player(s->logger, path);
+    if (s->abr) {
+        snprintf(path, sizeof(path), "%s/sessions/s%04d_abr.csv", cfg->log_dir, s->id);
+        logger_flush_abr(s->logger, path);
+    }
+}
+
+int loadgen_run(MPDInfo* mpd, const LoadGenConfig* cfg) {
+    if (!mpd || !cfg || cfg->n_sessions <= 0) return -1;
+    if (mpd->is_dynamic) {
+        fprintf(stderr, "[error] --sessions needs a static MPD.\n");
+        return -1;
+    }
+    int n = cfg->n_sessions;
+    int workers = cfg->workers > 0 ? cfg->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+
+    char path[512];
+    ensure_dir(cfg->log_dir);
+    snprintf(path, sizeof(path), "%s/sessions", cfg->log_dir);
+    ensure_dir(path);
+
+    LoadGen lg = { mpd, cfg, NULL, NULL, NULL };
+    lg.jobs = download_queue_init(n + workers);   // <= one frame per session + shutdown markers
+    lg.ready = download_queue_init(n);
+    lg.multi = curl_multi_init();
+    Session* sessions = calloc((size_t)n, sizeof(Session));
+    if (!lg.jobs || !lg.ready || !lg.multi || !sessions) {
+        fprintf(stderr, "[error] loadgen: allocation failed.\n");
+        download_queue_free(lg.jobs);
+        download_queue_free(lg.ready);
+        if (lg.multi) curl_multi_cleanup(lg.multi);
+        free(sessions);
+        return -2;
+    }
+    // one transfer in flight per session; workers both decrypt and infer
+    download_queue_set_stages(lg.jobs, STAGE_DOWNLOAD, STAGE_DECRYPT);
+    download_queue_set_stages(lg.ready, STAGE_DECRYPT, STAGE_BUFFER);
+    telemetry_set_threads(STAGE_DOWNLOAD, n);
+    telemetry_set_threads(STAGE_DECRYPT, workers);
+    telemetry_set_threads(STAGE_INFERENCE, workers);
+
+    double t0 = now_ms_mono();
+    for (int k = 0; k < n; k++) {
+        Session* s = &sessions[k];
+        s->id = k;
+        s->buffer = buffer_init(cfg->buffer_sec, mpd->frame_rate);
+        if (s->buffer->max_frames < 1) s->buffer->max_frames = 1;
+        s->logger = logger_init(mpd->total_frames, /*stall_cap*/ 10000);
+        s->abr = cfg->make_abr ? cfg->make_abr(mpd, s->logger, cfg->abr_user) : NULL;
+        s->start_at_ms = t0 + (double)k * cfg->stagger_ms;
+        s->easy = curl_easy_init();
+        curl_easy_setopt(s->easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(s->easy, CURLOPT_FAILONERROR, 1L); // 404s count as failed frames
+        curl_easy_setopt(s->easy, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(s->easy, CURLOPT_SSL_VERIFYHOST, 0L);
+        curl_easy_setopt(s->easy, CURLOPT_WRITEFUNCTION, write_session);
+        curl_easy_setopt(s->easy, CURLOPT_WRITEDATA, s);
+        curl_easy_setopt(s->easy, CURLOPT_HEADERFUNCTION, session_header);
+        curl_easy_setopt(s->easy, CURLOPT_HEADERDATA, s);
+        curl_easy_setopt(s->easy, CURLOPT_PRIVATE, s);
+    }
+
+    pthread_t* threads = calloc((size_t)workers, sizeof(pthread_t));
+    for (int w = 0; w < workers; w++) pthread_create(&threads[w], NULL, worker_func, &lg);
+    printf("[info] loadgen: %d sessions, %d workers, %d frames each, stagger %d ms\n",
+           n, workers, mpd->total_frames, cfg->stagger_ms);
+
+    // Aggregate time series, one row per second
+    snprintf(path, sizeof(path), "%s/loadgen.csv", cfg->log_dir);
+    FILE* agg = fopen(path, "w");
+    if (agg) fprintf(agg, "t_s,started,playing,stalled,done,throughput_mbps,frames_per_s,decrypt_backlog\n");
+    double next_report = t0 + 1000.0, last_report = t0;
+    double bytes_mark = 0.0;
+    long frames_mark = 0;
+
+    int finished = 0;
+    while (finished < n) {
+        double now = now_ms_mono();
+        finished = 0;
+        for (int k = 0; k < n; k++) {
+            Session* s = &sessions[k];
+            if (!s->started) {
+                if (now < s->start_at_ms) continue;
+                s->started = 1;
+                logger_add_player_event(s->logger, "session_start", 0, 0);
+            }
+            player_tick(&lg, s, now);
+            maybe_start_download(&lg, s);
+            finished += s->done;
+        }
+
+        int running = 0;
+        curl_multi_perform(lg.multi, &running);
+        CURLMsg* msg;
+        int left;
+        while ((msg = curl_multi_info_read(lg.multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Session* s = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&s);
+            on_download_done(&lg, s, msg->data.result);
+        }
+        Frame* f;
+        while ((f = download_queue_try_pop(lg.ready)) != NULL) {
+            on_frame_ready(&lg, (Session*)f->owner, f);
+        }
+
+        if (agg && now >= next_report) {
+            int started = 0, playing = 0, stalled = 0, done = 0;
+            double bytes = 0.0;
+            long frames = 0;
+            for (int k = 0; k < n; k++) {
+                Session* s = &sessions[k];
+                started += s->started;
+                playing += s->playing && !s->in_stall && !s->done;
+                stalled += s->in_stall;
+                done += s->done;
+                bytes += s->bytes;
+                frames += s->frames;
+            }
+            double span_s = (now - last_report) / 1000.0;
+            int backlog = download_queue_count(lg.jobs);
+            fprintf(agg, "%.1f,%d,%d,%d,%d,%.2f,%.1f,%d\n", (now - t0) / 1000.0, started, playing, stalled,
+                    done, (bytes - bytes_mark) * 8.0 / 1e6 / span_s, (frames - frames_mark) / span_s, backlog);
+            bytes_mark = bytes;
+            frames_mark = frames;
+            last_report = now;
+            next_report += 1000.0;
+        }
+        if (finished < n) curl_multi_poll(lg.multi, NULL, 0, LOOP_POLL_MS, NULL);
+    }
+    double wall_ms = now_ms_mono() - t0;
+
+    for (int w = 0; w < workers; w++) {
+        Frame* stop = calloc(1, sizeof(Frame));
+        stop->index = -1;
+        download_queue_push(lg.jobs, stop);
+    }
+    for (int w = 0; w < workers; w++) pthread_join(threads[w], NULL);
+    free(threads);
+    if (agg) fclose(agg);
+
+    // Per-session summary + aggregate
+    snprintf(path, sizeof(path), "%s/sessions.csv", cfg->log_dir);
+    FILE* fp = fopen(path, "w");
+    if (fp) fprintf(fp, "session,frames,failed,startup_ms,stalls,stall_ms,avg_dl_ms,avg_dec_ms,avg_bitrate_bps,switches,mbytes\n");
+    double total_bytes = 0.0, startup_sum = 0.0, stall_ms_sum = 0.0;
+    int stalled_sessions = 0, stall_count = 0;
+    for (int k = 0; k < n; k++) {
+        Session* s = &sessions[k];
+        int fr = s->frames ? s->frames : 1;
+        if (fp) {
+            fprintf(fp, "%d,%d,%d,%.1f,%d,%.1f,%.2f,%.2f,%.0f,%d,%.2f\n", s->id, s->frames, s->failed, s->startup_ms,
+                    s->stalls, s->stall_ms, s->dl_ms_sum / fr, s->dec_ms_sum / fr, s->bitrate_sum / fr,
+                    s->switches, s->bytes / 1e6);
+        }
+        total_bytes += s->bytes;
+        startup_sum += s->startup_ms;
+        stall_ms_sum += s->stall_ms;
+        stall_count += s->stalls;
+        stalled_sessions += s->stalls > 0;
+        write_session_logs(cfg, s);
+
+        curl_easy_cleanup(s->easy);
+        if (s->abr) abr_free(s->abr);
+        logger_free(s->logger);
+        buffer_free(s->buffer);
+    }
+    if (fp) fclose(fp);
+    printf("[info] loadgen: %d sessions in %.1f s, %.1f Mbit/s aggregate, mean startup %.0f ms, "
+           "%d/%d sessions stalled (%d stalls, %.0f ms total)\n",
+           n, wall_ms / 1000.0, total_bytes * 8.0 / 1e6 / (wall_ms / 1000.0), startup_sum / n,
+           stalled_sessions, n, stall_count, stall_ms_sum);
+
+    free(sessions);
+    curl_multi_cleanup(lg.multi);
+    download_queue_free(lg.jobs);
+    download_queue_free(lg.ready);
+    return 0;
+}
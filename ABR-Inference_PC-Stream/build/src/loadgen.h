@@ -0,0 +1,33 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include "mpd_parser.h"
+#include "logger.h"
+#include "abr.h"
+
+// --sessions N: many independent streaming sessions in one process.
+// One thread drives every session's downloads through a curl multi handle and simulates
+// each session's player; a pool of worker threads decrypts (and optionally runs inference).
+// Sessions share the parsed MPD and the CP-ABE keys; each owns its frame cursor, ABR, buffer
+// and logger.
+
+// Creates the ABR for one session (NULL = fixed lowest representation)
+typedef ABR* (*LoadGenAbrFactory)(MPDInfo* mpd, Logger* logger, void* user);
+
+typedef struct {
+    int n_sessions;
+    int buffer_sec;
+    int decrypt;              // decryptor_init() must already have succeeded
+    int workers;              // decrypt/inference threads (0 = online CPUs)
+    int stagger_ms;           // start offset between consecutive sessions
+    int inference;            // inference_init() must already have succeeded
+    double inference_threshold_ms; // skip inference while a session's average exceeds this
+    const char* log_dir;      // per-session CSVs go to <log_dir>/sessions/, aggregates to <log_dir>
+    LoadGenAbrFactory make_abr;
+    void* abr_user;
+} LoadGenConfig;
+
+// Run all sessions to completion and write logs. Returns 0 on success.
+int loadgen_run(MPDInfo* mpd, const LoadGenConfig* cfg);
+
+#endif
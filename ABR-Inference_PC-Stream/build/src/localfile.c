@@ -0,0 +1,86 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "localfile.h"
+#include "utils.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+int local_path(const char* url, char* path, size_t n) {
+    if (!url || !path || n == 0) return -1;
+    const char* p = url;
+    if (!strncmp(p, "file://", 7)) {
+        p += 7;
+        if (!strncmp(p, "localhost/", 10)) p += 9;
+        if (*p != '/') return -1; // file://host/... is not local
+    } else if (strstr(p, "://")) {
+        return -1;
+    }
+    if (strlen(p) + 1 > n) return -1;
+    strcpy(path, p);
+    return 0;
+}
+
+LocalView* local_map(const char* url, double* map_ms) {
+    double t0 = now_ms_mono();
+    if (map_ms) *map_ms = 0.0;
+    char path[1024];
+    if (local_path(url, path, sizeof(path)) != 0) {
+        fprintf(stderr, "[warn] --mmap: not a local file: %s\n", url);
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[warn] --mmap: cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "[warn] --mmap: cannot stat %s: %s\n", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    LocalView* v = calloc(1, sizeof(LocalView));
+    if (!v) {
+        close(fd);
+        return NULL;
+    }
+    v->len = (size_t)st.st_size;
+    if (v->len > 0) { // mmap of length 0 fails
+        void* p = mmap(NULL, v->len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "[warn] --mmap: mmap %s failed: %s\n", path, strerror(errno));
+            free(v);
+            close(fd);
+            return NULL;
+        }
+        madvise(p, v->len, MADV_SEQUENTIAL); // decrypt walks the frame front to back
+        v->data = p;
+    }
+    close(fd); // the mapping keeps the file
+    if (map_ms) *map_ms = now_ms_mono() - t0;
+    return v;
+}
+
+void local_unmap(LocalView* v) {
+    if (!v) return;
+    if (v->data) munmap((void*)v->data, v->len);
+    free(v);
+}
+
+void local_readahead(const char* url) {
+    char path[1024];
+    if (local_path(url, path, sizeof(path)) != 0) return;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
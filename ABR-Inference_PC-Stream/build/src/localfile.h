@@ -0,0 +1,30 @@
+#ifndef LOCALFILE_H
+#define LOCALFILE_H
+
+#include <stddef.h>
+#include <glib.h>
+
+// Local dataset source (--mmap). For a file:// MPD (or a plain path) the frames are files on
+// this machine; instead of reading them through libcurl into a GByteArray, each frame file is
+// mapped read-only and the decryptor reads it in place, rebuilding into a separate buffer.
+// Download time is then the time to map (and fault in) the file, so profiling runs measure
+// decrypt and inference without the copy and the transfer machinery in between.
+
+typedef struct LocalView {
+    const guint8* data; // read-only mapping of the whole file (NULL for an empty file)
+    size_t len;
+} LocalView;
+
+// Filesystem path of a file:// URL (file://localhost/... too) or of a URL without a scheme.
+// Returns 0 on success, -1 for other schemes or when path is too small.
+int local_path(const char* url, char* path, size_t n);
+
+// Map the frame at url with its pages populated. map_ms (optional) = time spent mapping.
+// NULL on failure (message printed).
+LocalView* local_map(const char* url, double* map_ms);
+void local_unmap(LocalView* v);
+
+// Ask the kernel to start reading url into the page cache (upcoming frames); errors are ignored.
+void local_readahead(const char* url);
+
+#endif
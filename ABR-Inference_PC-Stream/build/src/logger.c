@@ -14,6 +14,10 @@ Logger* logger_init(int frame_cap, int stall_cap) {
     l->stall_logs = calloc(stall_cap, sizeof(StallLog));
     l->player_event_cap = 128;
     l->player_events = calloc(l->player_event_cap, sizeof(char*));
+    l->abr_cap = 128;
+    l->abr_logs = calloc(l->abr_cap, sizeof(AbrLog));
+    l->deadline_cap = 64;
+    l->deadline_logs = calloc(l->deadline_cap, sizeof(DeadlineLog));
     return l;
 }
 
@@ -52,6 +56,28 @@ void logger_add_player_event(Logger* l, const char* event, int frame, int buf_co
     l->player_events[l->player_event_count++] = strdup(buf);
 }
 
+void logger_add_abr_decision(Logger* l, const AbrLog* entry) {
+    if (!l || !entry) return;
+    if (l->abr_size >= l->abr_cap) {
+        l->abr_cap *= 2;
+        l->abr_logs = realloc(l->abr_logs, l->abr_cap * sizeof(AbrLog));
+    }
+    AbrLog* al = &l->abr_logs[l->abr_size++];
+    *al = *entry;
+    al->timestamp_ms = now_ms_mono();
+}
+
+void logger_add_deadline_decision(Logger* l, const DeadlineLog* entry) {
+    if (!l || !entry) return;
+    if (l->deadline_size >= l->deadline_cap) {
+        l->deadline_cap *= 2;
+        l->deadline_logs = realloc(l->deadline_logs, l->deadline_cap * sizeof(DeadlineLog));
+    }
+    DeadlineLog* dl = &l->deadline_logs[l->deadline_size++];
+    *dl = *entry;
+    dl->timestamp_ms = now_ms_mono();
+}
+
 void logger_flush(Logger* l, const char* filename) {
     FILE* fp = fopen(filename, "w");
     if (!fp) return;
@@ -74,6 +100,14 @@ void logger_flush(Logger* l, const char* filename) {
         fprintf(fp, "%.2f,%.2f\n", sl->start_ms, sl->duration_ms);
     }
 
+    if (l->prefetch_fetched > 0 || l->prefetch_cancelled > 0) {
+        fprintf(fp, "\n# Prefetch\n");
+        fprintf(fp, "fetched,used,wasted,cancelled,fetched_bytes,wasted_bytes\n");
+        fprintf(fp, "%d,%d,%d,%d,%zu,%zu\n", l->prefetch_fetched, l->prefetch_hits,
+                l->prefetch_wasted, l->prefetch_cancelled,
+                l->prefetch_fetched_bytes, l->prefetch_wasted_bytes);
+    }
+
     fclose(fp);
 }
 
@@ -93,9 +127,40 @@ void logger_flush_player(Logger* l, const char* filename) {
     fclose(fp);
 }
 
+void logger_flush_abr(Logger* l, const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return;
+
+    fprintf(fp, "timestamp_ms,frame,estimator,phase,estimate_bps,samples,from_rep,to_rep,decision\n");
+    for (int i=0; i<l->abr_size; i++) {
+        AbrLog* al = &l->abr_logs[i];
+        fprintf(fp, "%.3f,%d,%s,%s,%.0f,%d,%d,%d,%s\n", al->timestamp_ms,
+                al->frame_no, al->estimator, al->phase,
+                al->estimate_bps, al->samples,
+                al->from_rep, al->to_rep, al->decision);
+    }
+    fclose(fp);
+}
+
+void logger_flush_deadline(Logger* l, const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return;
+
+    fprintf(fp, "timestamp_ms,frame,position,from_rep,to_rep,late_ms,aborted_bytes,decision\n");
+    for (int i=0; i<l->deadline_size; i++) {
+        DeadlineLog* dl = &l->deadline_logs[i];
+        fprintf(fp, "%.3f,%d,%d,%d,%d,%.1f,%zu,%s\n", dl->timestamp_ms,
+                dl->frame_no, dl->position, dl->from_rep, dl->to_rep,
+                dl->late_ms, dl->aborted_bytes, dl->decision);
+    }
+    fclose(fp);
+}
+
 void logger_free(Logger* l) {
     if (!l) return;
     free(l->frame_logs);
+    free(l->abr_logs);
+    free(l->deadline_logs);
     free(l->stall_logs);
     if (l->player_events) {
         for (int i=0; i<l->player_event_count; i++)
@@ -18,6 +18,29 @@ typedef struct {
     double duration_ms;
 } StallLog;
 
+typedef struct {
+    double timestamp_ms;
+    int frame_no;          // frame index the decision was made for
+    const char* estimator; // estimator name (static string)
+    const char* phase;     // "fast_start" or "steady"
+    double estimate_bps;   // throughput estimate used for the decision
+    int samples;           // samples available to the estimator
+    int from_rep;
+    int to_rep;
+    const char* decision;  // "up", "down", "hold" or "probe"
+} AbrLog;
+
+typedef struct {
+    double timestamp_ms;
+    int frame_no;
+    int position;          // play position the frame fills
+    int from_rep;          // rep of the aborted transfer
+    int to_rep;            // rep re-requested, -1 when skipped
+    double late_ms;        // projected lateness past the deadline when aborted
+    size_t aborted_bytes;  // bytes received before the abort
+    const char* decision;  // "down" or "skip"
+} DeadlineLog;
+
 typedef struct {
     int frame_capacity;
     int stall_capacity;
@@ -32,6 +55,20 @@ typedef struct {
     char** player_events;
     int player_event_count;
     int player_event_cap;
+
+    // --- ABR decisions (appended by the thread that calls abr_select_for_frame) ---
+    AbrLog* abr_logs;
+    int abr_size;
+    int abr_cap;
+
+    // --- Deadline decisions (appended by the downloading thread) ---
+    DeadlineLog* deadline_logs;
+    int deadline_size;
+    int deadline_cap;
+
+    // --- Prefetch totals (set at the end of the run by prefetch_report) ---
+    int prefetch_fetched, prefetch_hits, prefetch_wasted, prefetch_cancelled;
+    size_t prefetch_fetched_bytes, prefetch_wasted_bytes;
 } Logger;
 
 Logger* logger_init(int frame_cap, int stall_cap);
@@ -42,9 +79,17 @@ void logger_add_stall(Logger* l, double start, double dur);
 // --- Player events ---
 void logger_add_player_event(Logger* l, const char* event, int frame, int buf_count);
 
+// --- ABR decisions ---
+void logger_add_abr_decision(Logger* l, const AbrLog* entry);
+
+// --- Deadline aborts ---
+void logger_add_deadline_decision(Logger* l, const DeadlineLog* entry);
+
 // Flush logs to disk
 void logger_flush(Logger* l, const char* filename);
 void logger_flush_player(Logger* l, const char* filename);
+void logger_flush_abr(Logger* l, const char* filename);
+void logger_flush_deadline(Logger* l, const char* filename);
 
 void logger_free(Logger* l);
 
@@ -16,6 +16,17 @@
 #include "download_queue.h"
 #include "abr.h"
 #include "inference.h"
+#include "netem.h"
+#include "loadgen.h"
+#include "localfile.h"
+#include "telemetry.h"
+#include "utils.h"
+#include "prefetch.h"
+#include "deadline.h"
+#include "progressive.h"
+#include "framepool.h"
+#include "pipeline.h"
+#include "affinity.h"
 
 static void ensure_dir(const char* path) {
 #ifdef _WIN32
@@ -30,8 +41,16 @@ static void usage(const char* prog) {
         "Usage:\n"
         "  %s --url <mpd_path_or_url> --buffer <seconds>"
         " [--decrypt --pub <pub_key> --priv <priv_key> --pattern <pattern>]\n"
+        " [--download-queue <size>] [--decrypt-workers <N>]\n"
         " [--abr] [--abr-threshold <value>] [--abr-interval <seconds>]\n"
+        " [--abr-fast-start] [--abr-fast-start-samples <N>] [--abr-confidence <z>] [--abr-probe-interval <frames>]\n"
+        " [--abr-estimator <window|ewma|harmonic|percentile>] [--abr-percentile <p>]\n"
         " [--write-output]\n"
+        " [--live-duration <seconds>] [--live-delay <seconds>] [--live-max-lag <seconds>]\n"
+        " [--prefetch <frames>] [--frame-deadline <ms>] [--progressive] [--no-frame-pool] [--mmap]\n"
+        " [--telemetry-period <ms>] [--pin <auto|role=cpus>]\n"
+        " [--sessions <N>] [--session-workers <N>] [--session-stagger <ms>]\n"
+        " [--net-rate <Mbit/s>] [--net-rtt <ms>] [--net-jitter <ms>] [--net-loss <p>] [--net-trace <file>] [--net-seed <N>]\n"
         " [--inference] [--inference-threshold <ms>] [--inference-samples <N>]\n"
         "Notes:\n"
         "  • MPD is parsed before timing begins (excluded from measurements).\n"
@@ -39,9 +58,43 @@ static void usage(const char* prog) {
         "  • If --decrypt is omitted, frames enter buffer immediately after download.\n"
         "  • --write-output is optional; saves frames to disk if specified.\n"
         "  [--download-queue <size>]  (max frames in download queue for pipelined mode)\n"
+        "  [--decrypt-workers <N>]    (threads decrypting frames; buffering stays in frame order, default is 1)\n"
         "  [--abr]                    (enable simple ABR algorithm, default is off)\n"
         "  [--abr-threshold <value>]  (set ABR quality threshold, default is 1.2)\n"
         "  [--abr-interval <seconds>] (set ABR check interval, default is 24, (NOTE:need to fix this to be equal to FPS))\n"
+        "  [--abr-fast-start]         (decide from early samples with a confidence bound and allow multi-step up-switches)\n"
+        "  [--abr-fast-start-samples <N>] (samples needed before the first fast-start decision, default is 3)\n"
+        "  [--abr-confidence <z>]     (z multiplier of the fast-start lower confidence bound, default is 1.645)\n"
+        "  [--abr-probe-interval <frames>] (fetch one frame at the next higher rep every N frames, default is 0 = off)\n"
+        "  [--abr-estimator <name>]   (throughput estimator: window, ewma, harmonic, percentile; default is window)\n"
+        "  [--abr-percentile <p>]     (percentile for the percentile estimator, 0..1, default is 0.2)\n"
+        "  • ABR decision points are logged to ./logs/abr.csv.\n"
+        "  [--live-duration <seconds>] (dynamic MPD: seconds of live content to play, default is 60)\n"
+        "  [--live-delay <seconds>]   (dynamic MPD: start this far behind the live edge, default is 2)\n"
+        "  [--live-max-lag <seconds>] (dynamic MPD: skip ahead when further behind the edge, default is 10, 0 = never)\n"
+        "  [--prefetch <frames>]      (pipelined mode: while the download queue is full, fetch up to N frames of the\n"
+        "                              rep the ABR is about to switch to; default is 0 = off)\n"
+        "  [--frame-deadline <ms>]    (abort a frame download projected to miss its playback deadline by more than ms;\n"
+        "                              re-request it at a lower rep or skip it; default is off)\n"
+        "  • --frame-deadline decisions are logged to ./logs/deadline.csv.\n"
+        "  [--progressive]            (pipelined mode: fetch header and CP-ABE ciphertext first with HTTP Range and\n"
+        "                              unwrap the key while the rest of the frame downloads; default is off)\n"
+        "  [--no-frame-pool]          (allocate every frame buffer afresh instead of recycling them; default is pooled)\n"
+        "  [--mmap]                   (file:// MPD: map frame files instead of reading them through curl; decrypt reads the mapping)\n"
+        "  [--telemetry-period <ms>]  (per-stage busy/wait/queue rows to logs/stages.csv every <ms>, 0 = exit summary only; default is 1000)\n"
+        "  [--pin <auto|role=cpus>]   (pin threads to CPUs; role is download, decrypt, inference, buffer or player and cpus a\n"
+        "                              list like 2-5,8; repeatable, explicit roles override auto; default is off)\n"
+        "  [--sessions <N>]           (load generator: run N independent sessions in this process, default is off)\n"
+        "  [--session-workers <N>]    (decrypt/inference threads shared by all sessions, default is online CPUs)\n"
+        "  [--session-stagger <ms>]   (start offset between consecutive sessions, default is 0)\n"
+        "  • --sessions writes ./logs/sessions.csv, ./logs/loadgen.csv and ./logs/sessions/s<id>_*.csv.\n"
+        "  [--net-rate <Mbit/s>]      (emulated link rate shared by all downloads, default is 0 = unlimited)\n"
+        "  [--net-rtt <ms>]           (emulated round trip added before each frame's first byte, default is 0)\n"
+        "  [--net-jitter <ms>]        (uniform +/- jitter on the emulated RTT, default is 0)\n"
+        "  [--net-loss <p>]           (per-packet loss probability, each loss costs one RTT, default is 0)\n"
+        "  [--net-trace <file>]       (bandwidth trace, lines of '<time_s> <Mbit/s>', looped; overrides --net-rate)\n"
+        "  [--net-seed <N>]           (RNG seed for jitter/loss, default is 1)\n"
+        "  • --net-* emulates the network in-process (no tc/root needed); MPD fetch is not shaped.\n"
         "  [--inference]              (enable inference timing, default is off)\n"
         "  [--inference-buffer-threshold <N>] (set buffer threshold for inference, default is 24)\n"
         "  [--inference-threshold <ms>] (set inference time threshold for inference decisions, default is 200ms)\n"
@@ -51,47 +104,391 @@ static void usage(const char* prog) {
 }
 
 
-// --- Thread argument structs ---
+// --- Frame cursor: sequential for static MPDs, live-edge targeting for dynamic ones ---
 typedef struct {
     MPDInfo* mpd;
-    DownloadQueue* queue;
+    int next;            // next frame index to fetch (-1 before the first call)
+    int produced;        // frames handed out so far
+    int limit;           // frames to hand out in total
+    int delay_frames;    // live: start this many frames behind the edge
+    int max_lag_frames;  // live: jump back to edge - delay when further behind (0 = never)
+} FrameCursor;
+
+// Next frame to download, or -1 when the stream is over. For live manifests this blocks
+// until the frame is announced by the refresh thread.
+static int next_frame_index(FrameCursor* c) {
+    if (c->produced >= c->limit) return -1;
+    int avail = mpd_available_frames(c->mpd);
+    if (!mpd_is_dynamic(c->mpd) && c->next < 0) {
+        c->next = 0;
+    } else if (c->next < 0) {
+        c->next = avail - c->delay_frames;
+        if (c->next < 0) c->next = 0;
+        printf("[info] live: edge at frame %d, starting at frame %d\n", avail, c->next);
+    } else {
+        c->next++;
+        // delay < max lag is checked at startup; never jump backwards all the same
+        int to = avail - c->delay_frames;
+        if (c->max_lag_frames > 0 && avail - c->next > c->max_lag_frames && to > c->next) {
+            fprintf(stderr, "[warn] live: %d frames behind the edge, skipping %d -> %d\n",
+                    avail - c->next, c->next, to);
+            c->next = to;
+        }
+    }
+    for (;;) {
+        int rc = mpd_wait_for_frame(c->mpd, c->next, 1000);
+        if (rc == 1) break;
+        if (rc < 0) return -1; // live stream ended
+    }
+    c->produced++;
+    return c->next;
+}
+
+// ABR settings from the command line, shared by the single client and every --sessions session
+typedef struct {
+    double threshold;
+    int check_interval;
+    int fast_start;
+    int fast_start_samples;
+    double confidence_z;
+    int probe_interval;
+    AbrEstimator estimator;
+    double percentile;
+} AbrOptions;
+
+static ABR* make_abr(MPDInfo* mpd, Logger* logger, void* user) {
+    const AbrOptions* o = (const AbrOptions*)user;
+    ABR* abr = abr_init(mpd, o->threshold, o->check_interval);
+    if (!abr) return NULL;
+    if (o->fast_start) abr_set_fast_start(abr, o->fast_start_samples, o->confidence_z);
+    if (o->probe_interval > 0) abr_set_probe_interval(abr, o->probe_interval);
+    abr_set_estimator(abr, o->estimator, o->percentile);
+    abr_set_logger(abr, logger);
+    return abr;
+}
+
+// --- Download source: picks the representation and fetches (or maps) each frame ---
+typedef struct {
+    MPDInfo* mpd;
+    Pipeline* pipeline;     // frames wait in the input queue of its first stage ...
+    int queue_size;         // ... which holds this many
     struct ABR* abr;
+    Buffer* level;          // buffer level the ABR decides on, NULL = as if empty (queue ahead)
+    FrameCursor* cursor;
+    Prefetcher* prefetch;   // NULL unless --prefetch
+    DeadlineScheduler* deadline; // NULL unless --frame-deadline
+    int position;           // play position of the next frame pushed
+    int progressive;        // --progressive
+    int local;              // --mmap: frames are mapped, not downloaded
+    int local_ahead;        // --mmap: frames up to this index have been read ahead ...
+    int local_ahead_rep;    // ... for this representation
+    int decrypt;            // frames are decrypted downstream into frame->buffer
+    int to_disk;            // no decrypt + --write-output: download straight to stream-download/
+    int last;               // index of the frame just produced
+    ProgressiveFrame* pending; // --progressive: rest of the frame just queued, fetched from url
+    char url[1024];
 } DownloaderArgs;
 
+// Abort a speculative download once the next stage has nothing left to work on
+static int queue_drained(void* user, size_t dl_total, size_t dl_now) {
+    (void)dl_total; (void)dl_now;
+    return pipeline_queued(((DownloaderArgs*)user)->pipeline, 0) == 0;
+}
+
+// Fetch one frame of the representation the ABR is about to switch to. Returns 0 if a
+// download was attempted, -1 if there is nothing worth prefetching.
+static int prefetch_one(DownloaderArgs* d, int next_frame) {
+    Prefetcher* pf = d->prefetch;
+    if (!pf || !d->abr || prefetch_full(pf)) return -1;
+    int first = next_frame;
+    int rep = abr_prefetch_hint(d->abr, next_frame, &first);
+    if (rep < 0) return -1;
+    int avail = mpd_available_frames(d->mpd);
+    int j = first;
+    while (j < first + pf->window && j < avail && prefetch_has(pf, j, rep)) j++;
+    if (j >= first + pf->window || j >= avail) return -1;
+
+    char url[1024];
+    if (mpd_frame_url(d->mpd, rep, j, url, sizeof(url)) < 0) return -1;
+    GByteArray* buf = NULL;
+    double ms = 0.0;
+    int rc = download_file_mem_cancelable(url, rep, &buf, &ms, queue_drained, d);
+    if (rc == DOWNLOAD_CANCELLED) {
+        pf->cancelled++;
+    } else if (rc == 0 && buf) {
+        prefetch_store(pf, j, rep, buf, ms);
+    } else {
+        frame_pool_put(buf);
+        return -1;
+    }
+    return 0;
+}
+
+// --mmap: map frame i and hint the kernel to read the next `depth` frames of the same
+// representation (the ones that will fill the queue behind it). The mapping itself is
+// populated up front, so "download" time is the time to fault the frame in.
+static void map_local_frame(DownloaderArgs* d, Frame* frame, const char* url, int depth) {
+    frame->local = local_map(url, &frame->dl_ms);
+    if (!frame->local) return;
+    if (d->decrypt) frame->buffer = frame_pool_get(frame->rep, frame->local->len); // decrypt output
+    int i = frame->index;
+    if (d->local_ahead_rep != frame->rep || d->local_ahead < i) d->local_ahead = i;
+    d->local_ahead_rep = frame->rep;
+    int avail = mpd_available_frames(d->mpd);
+    for (int j = d->local_ahead + 1; j <= i + depth && j < avail; j++) {
+        char next[1024];
+        if (mpd_frame_url(d->mpd, frame->rep, j, next, sizeof(next)) >= 0) local_readahead(next);
+        d->local_ahead = j;
+    }
+}
+
+// Decrypt a --progressive frame: unwrap the key from the CP-ABE ciphertext while the downloader
+// is still fetching the rest of the frame, then wait for it and finish AES/rebuild.
+// dec_ms counts both decrypt steps but not the wait in between.
+static int decrypt_progressive(Frame* frame, double* dec_ms, int write_output, const char* outpath) {
+    ProgressiveFrame* pf = frame->progressive;
+    double key_ms = 0.0, finish_ms = 0.0;
+    DecryptKey* key = NULL;
+    if (pf->cph_off > 0) {
+        // only the ciphertext field: a .vvs bulk behind it may still be arriving
+        key = decrypt_unwrap_key(pf->buffer->data + pf->cph_off, pf->cph_end - pf->cph_off, &key_ms);
+    }
+    int rc = progressive_wait(pf, &frame->dl_ms);
+    if (rc == 0) {
+        if (key) rc = decrypt_file_buffer_with_key(frame->buffer, key, &finish_ms, write_output, outpath);
+        else rc = decrypt_file_buffer(frame->buffer, &finish_ms, write_output, outpath);
+    }
+    decrypt_key_free(key);
+    progressive_free(pf);
+    frame->progressive = NULL;
+    *dec_ms = key_ms + finish_ms;
+    return rc;
+}
+
+static Frame* download_next(void* user, double* busy_ms) {
+    DownloaderArgs* d = (DownloaderArgs*)user;
+    int i = next_frame_index(d->cursor);
+    if (i < 0) return NULL;
+    double t_busy = now_ms_mono();
+    Frame* frame = calloc(1, sizeof(Frame));
+    frame->index = i;
+    int rep = 0;
+    if (d->abr) {
+        rep = abr_select_for_frame(d->abr, i, d->level ? d->level->count : 0);
+    }
+    char* frame_url = d->url;
+    if (mpd_frame_url(d->mpd, rep, i, frame_url, sizeof(d->url)) < 0) {
+        fprintf(stderr, "[warn] no URL for frame %d (rep %d)\n", i, rep);
+        frame_url[0] = '\0';
+    }
+    frame->rep = rep;
+    frame->buffer = prefetch_take(d->prefetch, i, rep, &frame->dl_ms);
+    if (d->local) {
+        map_local_frame(d, frame, frame_url, d->queue_size);
+        if (!frame->local) fprintf(stderr, "[warn] map failed for %s\n", frame_url);
+    } else if (!frame->buffer && d->deadline) {
+        frame->rep = deadline_fetch(d->deadline, i, d->position, rep,
+                                    pipeline_queued(d->pipeline, 0), &frame->buffer, &frame->dl_ms);
+        if (frame->rep < 0) frame->skipped = 1;
+    } else if (!frame->buffer && d->to_disk) {
+        char outpath[512];
+        snprintf(outpath, sizeof(outpath), "stream-download/frame_%d.ply", i);
+        int rc = download_file(frame_url, outpath, &frame->dl_ms);
+        if (rc != 0) {
+            fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, frame_url);
+            frame->skipped = frame->failed = 1;
+        }
+        // cannot easily get size when written to disk; leave as 0
+    } else if (!frame->buffer) {
+        if (d->progressive) {
+            frame->progressive = progressive_fetch_head(frame_url, rep);
+            if (frame->progressive) frame->buffer = frame->progressive->buffer;
+        }
+        if (!frame->buffer) {
+            int rc = download_file_mem(frame_url, rep, &frame->buffer, &frame->dl_ms);
+            if (rc != 0 || !frame->buffer) {
+                fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, frame_url);
+            }
+        }
+    }
+    if (frame->local) frame->size_bytes = frame->local->len;
+    else if (frame->buffer) frame->size_bytes = frame->buffer->len;
+    else if (!d->to_disk && !frame->skipped) frame->skipped = frame->failed = 1; // no data: dropped by the buffer stage
+    if (!frame->failed) d->position++; // a dropped frame takes no play position
+    d->last = i;
+    d->pending = frame->progressive; // frame belongs to the next stage once queued
+    *busy_ms = now_ms_mono() - t_busy;
+    return frame;
+}
+
+// Queue full = decryptor behind = idle link: spend it on likely up-switch frames
+static int download_idle(void* user) {
+    DownloaderArgs* d = (DownloaderArgs*)user;
+    return prefetch_one(d, d->last + 1);
+}
+
+static void download_queued(void* user) {
+    DownloaderArgs* d = (DownloaderArgs*)user;
+    progressive_fetch_bulk(d->pending, d->url);
+    d->pending = NULL;
+}
+
+static void download_done(void* user) {
+    (void)user;
+    download_range_cleanup();
+}
+
+// --- Decrypt stage ---
+typedef struct {
+    int write_output;
+    DeadlineScheduler* deadline;
+} DecryptStage;
+
+static double decrypt_stage(void* user, Frame* frame) {
+    DecryptStage* st = (DecryptStage*)user;
+    frame->dec_ms = 0.0;
+    if (frame->skipped) {
+        // nothing to decrypt (deadline skip or failed download)
+    } else if (!frame->buffer) {
+        fprintf(stderr, "[error] frame->buffer is NULL at frame %d\n", frame->index);
+    } else {
+        char outpath[512] = {0};
+        if (st->write_output) {
+            snprintf(outpath, sizeof(outpath), "stream-download/frame_%d.ply", frame->index);
+        }
+        const char* out = st->write_output ? outpath : NULL;
+        int rc;
+        if (frame->progressive) {
+            rc = decrypt_progressive(frame, &frame->dec_ms, st->write_output, out);
+        } else if (frame->local) {
+            rc = decrypt_file_view(frame->local->data, frame->local->len, frame->buffer, &frame->dec_ms,
+                                   st->write_output, out);
+        } else {
+            rc = decrypt_file_buffer(frame->buffer, &frame->dec_ms, st->write_output, out);
+        }
+        if (rc != 0) {
+            fprintf(stderr, "[warn] decrypt failed (rc=%d) for frame %d\n", rc, frame->index);
+        }
+        // ensure size recorded
+        frame->size_bytes = frame->buffer ? frame->buffer->len : 0;
+        local_unmap(frame->local);
+        frame->local = NULL;
+        deadline_note_decode(st->deadline, frame->dec_ms);
+    }
+    return frame->dec_ms;
+}
+
+// --- Inference stage: decides per frame whether inference runs ---
 typedef struct {
-    DownloadQueue* queue;
+    MPDInfo* mpd;
+    Buffer* buffer;
+    int threshold_passed;   // --inference-threshold given: gate on average inference time
+    double threshold_ms;
+    int buffer_threshold;   // otherwise: gate on buffer level with hysteresis
+    int buffer_mode_active;
+    double* times;          // sliding window of inference timings
+    int samples, pos, filled;
+} InferenceStage;
+
+static double inference_stage(void* user, Frame* frame) {
+    InferenceStage* st = (InferenceStage*)user;
+    frame->inf_ms = 0.0;
+    if (!frame->buffer) return 0.0;
+    int is_highest = 0;
+    if (st->mpd && frame->rep >= 0 && frame->rep == st->mpd->n_reps - 1) is_highest = 1;
+
+    double avg_inf = 0.0;
+    if (st->filled > 0) {
+        double s = 0.0;
+        for (int k = 0; k < st->filled; k++) s += st->times[k];
+        avg_inf = s / (double)st->filled;
+    }
+
+    int should_run_inference = 0;
+    if (st->threshold_passed) {
+        // original behavior: gate by average inference time vs threshold
+        if (!is_highest && (st->filled == 0 || avg_inf < st->threshold_ms)) should_run_inference = 1;
+    } else {
+        // buffer-threshold gating with hysteresis
+        if (!st->buffer_mode_active && st->buffer->count >= st->buffer_threshold) {
+            st->buffer_mode_active = 1; // enable inference when buffer has enough frames
+        }
+        if (st->buffer_mode_active && st->buffer->count <= 12) {
+            st->buffer_mode_active = 0; // disable inference if buffer less than or equal to 12 frames (introduces hysteresis to prevent flapping around threshold)
+        }
+        if (st->buffer_mode_active && !is_highest) should_run_inference = 1;
+    }
+
+    if (should_run_inference) {
+        int rc = inference_run_buffer(frame->buffer, &frame->inf_ms);
+        if (rc != 0) {
+            fprintf(stderr, "[warn] inference_run_buffer failed (rc=%d) for frame %d\n", rc, frame->index);
+            frame->inf_ms = 0.0;
+        } else {
+            // update sliding window
+            st->times[st->pos] = frame->inf_ms;
+            st->pos = (st->pos + 1) % st->samples;
+            if (st->filled < st->samples) st->filled++;
+        }
+    }
+    return frame->inf_ms;
+}
+
+// --- Buffer stage (sink): wait for room, buffer, log, feed the ABR ---
+typedef struct {
+    MPDInfo* mpd;
     Buffer* buffer;
     Logger* logger;
-    int frame_rate;
-    const char* pub_key;
-    const char* priv_key;
-    const char* pattern;
-    int total_frames;
-} DecryptorArgs;
-
-// --- Downloader thread function ---
-void* downloader_thread_func(void* arg) {
-    DownloaderArgs* dargs = (DownloaderArgs*)arg;
-    for (int i = 0; i < dargs->mpd->total_frames; i++) {
-        Frame* frame = malloc(sizeof(Frame));
-        frame->index = i;
-        frame->dl_ms = 0.0;
-        int rep = 0;
-        if (dargs->abr) {
-            rep = abr_select_for_frame(dargs->abr, i, 0);
+    ABR* abr;
+    int dropped;    // failed downloads; read by main after the pipeline is joined
+} BufferStage;
+
+static double buffer_stage(void* user, Frame* frame) {
+    BufferStage* st = (BufferStage*)user;
+    Buffer* buffer = st->buffer;
+    Logger* logger = st->logger;
+    MPDInfo* mpd = st->mpd;
+    if (frame->failed) {
+        // no data: dropped (not buffered, logged or fed to the ABR) like the former sequential loop
+        st->dropped++;
+        local_unmap(frame->local);
+        free(frame);
+        return 0.0;
+    }
+    // Wait if buffer full
+    if (buffer->count >= buffer->max_frames) {
+        double t_wait = now_ms_mono();
+        while (buffer->count >= buffer->max_frames) {
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
         }
-        const char* frame_url = dargs->mpd->frame_urls[rep][i];
-        frame->buffer = NULL;
-        frame->rep = rep;
-        frame->size_bytes = 0;
-        int rc = download_file_mem(frame_url, &frame->buffer, &frame->dl_ms);
-        if (rc != 0 || !frame->buffer) {
-            fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, frame_url);
+        telemetry_enqueue_wait(STAGE_BUFFER, now_ms_mono() - t_wait);
+    }
+    double t_buf = now_ms_mono();
+
+    if (buffer_add(buffer) != 0) {
+        printf("[warn] buffer full, frame %d dropped.\n", frame->index);
+    }
+    telemetry_depth(STAGE_BUFFER, buffer->count);
+
+    logger_add_frame(logger, frame->index, frame->dl_ms, frame->dec_ms, buffer->count);
+    if (logger->frame_size > 0) {
+        int idx = logger->frame_size - 1;
+        logger->frame_logs[idx].rep = frame->rep;
+        if (mpd && frame->rep >= 0 && frame->rep < mpd->n_reps) {
+            logger->frame_logs[idx].bitrate = mpd->bitrates[frame->rep];
         }
-        if (frame->buffer) frame->size_bytes = frame->buffer->len;
-        download_queue_push(dargs->queue, frame);
+        logger->frame_logs[idx].size_bytes = frame->size_bytes;
+        logger->frame_logs[idx].inference_ms = frame->inf_ms;
+    }
+    if (st->abr && !frame->skipped) {
+        double total_ms = frame->dl_ms + frame->dec_ms;
+        abr_update_stats(st->abr, frame->size_bytes, total_ms);
     }
-    return NULL;
+    local_unmap(frame->local); // no decrypt: mapped only to be measured
+    frame_pool_put(frame->buffer);
+    free(frame);
+    return now_ms_mono() - t_buf;
 }
 
 
@@ -105,9 +502,31 @@ int main(int argc, char* argv[]) {
     int write_output = 0;
     const char *pub_key = NULL, *priv_key = NULL, *pattern = NULL;
     int download_queue_size = 1; // Default: 1 (no pipelining)
+    int decrypt_workers = 1;
     int abr_enabled = 1;
     double abr_threshold = 1.2;
     int abr_check_interval = 24; //also N samples to consider for ABR decision; default to 24 to match 24fps, so decision is based on last ~1 second of data
+    int abr_fast_start = 0;
+    int abr_fast_start_samples = 3;
+    double abr_confidence_z = 1.645;
+    int abr_probe_interval = 0;
+    const char* abr_estimator_name = "window";
+    double abr_percentile = 0.2;
+    int live_duration_sec = 60;
+    int live_delay_sec = 2;
+    int live_max_lag_sec = 10;
+    NetEmConfig net = {0};
+    int prefetch_window = 0;
+    double frame_deadline_slack_ms = -1.0;
+    int progressive = 0;
+    int n_sessions = 0;
+    int session_workers = 0;
+    int session_stagger_ms = 0;
+    int frame_pool = 1;
+    int local_mmap = 0;
+    int telemetry_period_ms = 1000;
+    int pin = 0;
+    int net_enabled = 0;
 
     int inference_enabled = 0;
     double inference_threshold_ms = 500.0;
@@ -132,12 +551,70 @@ int main(int argc, char* argv[]) {
             pattern = argv[++i];
         } else if (!strcmp(argv[i], "--download-queue") && i + 1 < argc) {
             download_queue_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--decrypt-workers") && i + 1 < argc) {
+            decrypt_workers = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "--abr")) {
             abr_enabled = 1;
         } else if (!strcmp(argv[i], "--abr-threshold") && i + 1 < argc) {
             abr_threshold = atof(argv[++i]);
         } else if (!strcmp(argv[i], "--abr-interval") && i + 1 < argc) {
             abr_check_interval = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--abr-fast-start")) {
+            abr_fast_start = 1;
+        } else if (!strcmp(argv[i], "--abr-fast-start-samples") && i + 1 < argc) {
+            abr_fast_start_samples = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--abr-confidence") && i + 1 < argc) {
+            abr_confidence_z = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--abr-probe-interval") && i + 1 < argc) {
+            abr_probe_interval = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--abr-estimator") && i + 1 < argc) {
+            abr_estimator_name = argv[++i];
+        } else if (!strcmp(argv[i], "--abr-percentile") && i + 1 < argc) {
+            abr_percentile = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--live-duration") && i + 1 < argc) {
+            live_duration_sec = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--live-delay") && i + 1 < argc) {
+            live_delay_sec = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--live-max-lag") && i + 1 < argc) {
+            live_max_lag_sec = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--prefetch") && i + 1 < argc) {
+            prefetch_window = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--frame-deadline") && i + 1 < argc) {
+            frame_deadline_slack_ms = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--progressive")) {
+            progressive = 1;
+        } else if (!strcmp(argv[i], "--telemetry-period") && i + 1 < argc) {
+            telemetry_period_ms = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--pin") && i + 1 < argc) {
+            if (affinity_parse(argv[++i]) != 0) return 1;
+            pin = 1;
+        } else if (!strcmp(argv[i], "--mmap")) {
+            local_mmap = 1;
+        } else if (!strcmp(argv[i], "--no-frame-pool")) {
+            frame_pool = 0;
+        } else if (!strcmp(argv[i], "--sessions") && i + 1 < argc) {
+            n_sessions = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--session-workers") && i + 1 < argc) {
+            session_workers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--session-stagger") && i + 1 < argc) {
+            session_stagger_ms = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--net-rate") && i + 1 < argc) {
+            net.rate_mbps = atof(argv[++i]);
+            net_enabled = 1;
+        } else if (!strcmp(argv[i], "--net-rtt") && i + 1 < argc) {
+            net.rtt_ms = atof(argv[++i]);
+            net_enabled = 1;
+        } else if (!strcmp(argv[i], "--net-jitter") && i + 1 < argc) {
+            net.jitter_ms = atof(argv[++i]);
+            net_enabled = 1;
+        } else if (!strcmp(argv[i], "--net-loss") && i + 1 < argc) {
+            net.loss = atof(argv[++i]);
+            net_enabled = 1;
+        } else if (!strcmp(argv[i], "--net-trace") && i + 1 < argc) {
+            net.trace = argv[++i];
+            net_enabled = 1;
+        } else if (!strcmp(argv[i], "--net-seed") && i + 1 < argc) {
+            net.seed = (unsigned)strtoul(argv[++i], NULL, 10);
         } else if (!strcmp(argv[i], "--inference")) {
             inference_enabled = 1;
         } else if (!strcmp(argv[i], "--inference-threshold") && i + 1 < argc) {
@@ -158,26 +635,96 @@ int main(int argc, char* argv[]) {
         usage(argv[0]);
         return 1;
     }
+    if (download_queue_size < 1 || decrypt_workers < 1) {
+        fprintf(stderr, "[error] --download-queue and --decrypt-workers must be at least 1.\n");
+        return 1;
+    }
     if (decrypt_enabled && (!pub_key || !priv_key || !pattern)) {
         fprintf(stderr, "[error] --decrypt requires --pub, --priv, and --pattern.\n");
         return 1;
     }
+    if (live_max_lag_sec > 0 && live_delay_sec >= live_max_lag_sec) {
+        // the catch-up jump lands on edge - delay, which must be closer than the lag that triggers it
+        fprintf(stderr, "[error] --live-delay (%d s) must be below --live-max-lag (%d s).\n",
+                live_delay_sec, live_max_lag_sec);
+        return 1;
+    }
+    AbrEstimator abr_estimator = ABR_EST_WINDOW;
+    if (abr_parse_estimator(abr_estimator_name, &abr_estimator) != 0) {
+        fprintf(stderr, "[error] unknown --abr-estimator '%s' (use window|ewma|harmonic|percentile).\n", abr_estimator_name);
+        return 1;
+    }
     
+    AbrOptions abr_opts = { abr_threshold, abr_check_interval, abr_fast_start, abr_fast_start_samples,
+                            abr_confidence_z, abr_probe_interval, abr_estimator, abr_percentile };
+
+    if (net_enabled && n_sessions > 0) {
+        // the emulator sleeps inside curl callbacks, which would stall every session's transfers
+        fprintf(stderr, "[warn] --net-* emulation is not applied in --sessions mode.\n");
+        net_enabled = 0;
+    }
+    if (pin && n_sessions > 0) {
+        fprintf(stderr, "[warn] --pin is not applied in --sessions mode.\n");
+        pin = 0;
+    }
+    if (pin && affinity_setup(decrypt_enabled ? decrypt_workers : 1) != 0) {
+        return 1;
+    }
+    if (local_mmap && n_sessions > 0) {
+        fprintf(stderr, "[warn] --mmap is not applied in --sessions mode.\n");
+        local_mmap = 0;
+    }
+    if (local_mmap && (progressive || prefetch_window > 0 || frame_deadline_slack_ms >= 0.0)) {
+        // all three are about scheduling network transfers; a mapped frame has none
+        fprintf(stderr, "[warn] --progressive, --prefetch and --frame-deadline are ignored with --mmap.\n");
+        progressive = 0;
+        prefetch_window = 0;
+        frame_deadline_slack_ms = -1.0;
+    }
+    if (local_mmap && net_enabled) {
+        fprintf(stderr, "[warn] --net-* emulation does not apply to --mmap frames.\n");
+    }
+    if (local_mmap) {
+        char path[1024];
+        if (local_path(mpd_url, path, sizeof(path)) != 0) {
+            fprintf(stderr, "[error] --mmap needs a file:// MPD (or a local path).\n");
+            return 1;
+        }
+    }
+    if (net_enabled && netem_configure(&net) != 0) {
+        fprintf(stderr, "[error] invalid network emulation settings.\n");
+        return 1;
+    }
+
     // --- Parse MPD (excluded from timing) ---
     MPDInfo* mpd = parse_mpd(mpd_url);
     if (!mpd) {
         fprintf(stderr, "[error] Failed to parse MPD: %s\n", mpd_url);
         return 1;
     }
-    if (mpd->frame_rate <= 0 || mpd->total_frames <= 0) {
+    if (mpd->frame_rate <= 0 || (mpd->total_frames <= 0 && !mpd->is_dynamic)) {
         fprintf(stderr, "[error] MPD missing/invalid frameRate or duration-derived total_frames.\n");
         free_mpd(mpd);
         return 1;
     }
+    // Static: play the whole manifest. Dynamic: play live_duration_sec of content from the live edge.
+    FrameCursor cursor = { mpd, -1, 0, mpd->total_frames, 0, 0 };
+    if (mpd->is_dynamic) {
+        cursor.limit = live_duration_sec * mpd->frame_rate;
+        cursor.delay_frames = live_delay_sec * mpd->frame_rate;
+        cursor.max_lag_frames = live_max_lag_sec * mpd->frame_rate;
+        if (mpd_refresh_start(mpd) != 0) {
+            fprintf(stderr, "[error] failed to start MPD refresh thread.\n");
+            free_mpd(mpd);
+            return 1;
+        }
+    }
+    int frames_to_play = cursor.limit;
     
     // --- Prepare output dirs ---
     ensure_dir("stream-download");
     ensure_dir("logs");
+    telemetry_start("logs/stages.csv", telemetry_period_ms);
 
     // --- Initialize modules ---
     Buffer* buffer = buffer_init(buffer_sec, mpd->frame_rate);
@@ -188,7 +735,7 @@ int main(int argc, char* argv[]) {
     }
     
 
-    Logger* logger = logger_init(mpd->total_frames, /*stall_cap*/ 10000);
+    Logger* logger = logger_init(frames_to_play, /*stall_cap*/ 10000);
     if (!logger) {
         fprintf(stderr, "[error] logger_init failed.\n");
         buffer_free(buffer);
@@ -211,198 +758,116 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Frame buffers in flight: each session has one download and at most one frame queued for
+    // or held by a worker; the pipelined client the download queue, the prefetch window, one
+    // frame per decrypt worker, the one being downloaded and one queued for and held by each
+    // later stage.
+    if (frame_pool) {
+        int later = 2 + (decrypt_enabled && inference_enabled ? 2 : 0);
+        int in_flight = n_sessions > 0 ? 2 * n_sessions
+                                       : download_queue_size + prefetch_window + decrypt_workers + 1 + later;
+        frame_pool_init(mpd->n_reps, in_flight);
+    }
+
+    // --- Load generation: N sessions share the MPD, keys and a worker pool ---
+    if (n_sessions > 0) {
+        LoadGenConfig lc = {
+            .n_sessions = n_sessions,
+            .buffer_sec = buffer_sec,
+            .decrypt = decrypt_enabled,
+            .workers = session_workers,
+            .stagger_ms = session_stagger_ms,
+            .inference = inference_enabled,
+            .inference_threshold_ms = inference_threshold_ms,
+            .log_dir = "logs",
+            .make_abr = abr_enabled ? make_abr : NULL,
+            .abr_user = &abr_opts,
+        };
+        int rc = loadgen_run(mpd, &lc);
+        telemetry_report();
+        telemetry_shutdown();
+        frame_pool_report();
+        frame_pool_shutdown();
+        decryptor_shutdown();
+        if (inference_enabled) inference_shutdown();
+        logger_free(logger);
+        buffer_free(buffer);
+        free_mpd(mpd);
+        return rc == 0 ? 0 : 2;
+    }
+
     // initialize Virtual Player thread 
     pthread_t player_thread;
-    struct PlayerArgs args = { buffer, mpd->frame_rate, logger, mpd->total_frames };
+    PlayerClock clock;
+    player_clock_init(&clock, mpd->frame_rate);
+    struct PlayerArgs args = { buffer, mpd->frame_rate, logger, frames_to_play, &clock };
     pthread_create(&player_thread, NULL, simulate_player, &args);
+    affinity_pin(player_thread, PIN_PLAYER, 0);
 
     // Initialize ABR
     ABR* abr = NULL;
-    if (abr_enabled) {
-        abr = abr_init(mpd, abr_threshold, abr_check_interval);
-    }
-
-    // --- Pipelined Download/Decrypt ---
-    if (decrypt_enabled) {
-        DownloadQueue* queue = download_queue_init(download_queue_size);
-        if (!queue) {
-            fprintf(stderr, "[error] download_queue_init failed.\n");
-            logger_free(logger);
-            buffer_free(buffer);
-            free_mpd(mpd);
-            return 2;
+    if (abr_enabled) abr = make_abr(mpd, logger, &abr_opts);
+    DeadlineScheduler* deadline = NULL;
+    if (frame_deadline_slack_ms >= 0.0) {
+        if (progressive && decrypt_enabled) {
+            fprintf(stderr, "[warn] --frame-deadline cannot abort --progressive fetches; ignored.\n");
+        } else if (write_output && !decrypt_enabled) {
+            fprintf(stderr, "[warn] --frame-deadline needs in-memory downloads; ignored with --write-output.\n");
+        } else {
+            deadline = deadline_init(&clock, mpd, abr, logger, frame_deadline_slack_ms);
         }
+    }
 
-        pthread_t downloader_thread;
-    DownloaderArgs dargs = { mpd, queue, abr };
-    pthread_create(&downloader_thread, NULL, downloader_thread_func, &dargs);
+    // --- Stage graph: download -> decrypt -> [inference] -> buffer, or download -> buffer
+    // without decryption (HTTPS or HTTP only) ---
+    DownloaderArgs dargs = { mpd, NULL, download_queue_size, abr, decrypt_enabled ? NULL : buffer, &cursor,
+                             abr && decrypt_enabled ? prefetch_init(prefetch_window) : NULL,
+                             deadline, 0, progressive && decrypt_enabled, local_mmap, -1, -1,
+                             decrypt_enabled, write_output && !decrypt_enabled, -1, NULL, {0} };
+    PipelineSource source = { STAGE_DOWNLOAD, download_next, dargs.prefetch ? download_idle : NULL,
+                              download_queued, download_done, &dargs, affinity_pin_self };
+    Pipeline* pipe = pipeline_create(&source);
+    if (!pipe) {
+        fprintf(stderr, "[error] pipeline_create failed.\n");
+        logger_free(logger);
+        buffer_free(buffer);
+        free_mpd(mpd);
+        return 2;
+    }
+    dargs.pipeline = pipe;
 
-        // Main thread: pop from queue, decrypt, optionally infer, buffer, log
-        // sliding window for inference timings
-        double *inf_times = NULL;
-        int inf_pos = 0, inf_filled = 0;
+    DecryptStage dec = { write_output, deadline };
+    InferenceStage inf = { mpd, buffer, inference_threshold_passed, inference_threshold_ms,
+                           inference_buffer_threshold, 0, NULL, inference_samples, 0, 0 };
+    BufferStage sink = { mpd, buffer, logger, abr, 0 };
+    int stage_err = 0;
+    if (decrypt_enabled) {
+        PipelineStageDef d = { "decrypt", STAGE_DECRYPT, decrypt_workers, download_queue_size, 0,
+                               decrypt_stage, decryptor_thread_exit, &dec, affinity_pin_self };
+        stage_err |= pipeline_add_stage(pipe, &d) < 0;
         if (inference_enabled) {
-            inf_times = calloc(inference_samples, sizeof(double));
-            inf_pos = 0; inf_filled = 0;
-        }
-
-    int inf_buffer_mode_active = 0; // for buffer-threshold gating hysteresis
-    for (int i = 0; i < mpd->total_frames; i++) {
-            Frame* frame = download_queue_pop(queue);
-            if (!frame) {
-                fprintf(stderr, "[error] download_queue_pop returned NULL at frame %d\n", i);
-                continue;
-            }
-            double dec_ms = 0.0;
-            double inf_ms = 0.0;
-            if (!frame->buffer) {
-                fprintf(stderr, "[error] frame->buffer is NULL at frame %d\n", frame->index);
-            } else {
-                char outpath[512] = {0};
-                if (write_output) {
-                    snprintf(outpath, sizeof(outpath), "stream-download/frame_%d.ply", frame->index);
-                }
-                int rc = decrypt_file_buffer(frame->buffer, &dec_ms, write_output, write_output ? outpath : NULL);
-                if (rc != 0) {
-                    fprintf(stderr, "[warn] decrypt failed (rc=%d) for frame %d\n", rc, frame->index);
-                }
-                // ensure size recorded
-                frame->size_bytes = frame->buffer ? frame->buffer->len : 0;
-            }
-
-            // Conditional inference after decryption
-            // printf("[debug] frame %d: dl=%.2fms dec=%.2fms buffer_count=%d\n", frame->index, frame->dl_ms, dec_ms, buffer->count);
-            if (inference_enabled && frame->buffer) {
-                int is_highest = 0;
-                if (mpd && frame->rep >= 0 && frame->rep == mpd->n_reps - 1) is_highest = 1;
-                
-                double avg_inf = 0.0;
-                if (inf_filled > 0) {
-                    double s = 0.0;
-                    for (int k = 0; k < inf_filled; k++) s += inf_times[k];
-                    avg_inf = s / (double)inf_filled;
-                    // printf("[debug] frame %d: avg_inf=%.2fms\n", frame->index, avg_inf);
-                }
-
-                // printf("[debug] buffer_count=%d, buffer size=%d\n", buffer->count, (int)buffer->max_frames/3);
-
-                int should_run_inference = 0;
-                if (inference_threshold_passed) {
-                    // original behavior: gate by average inference time vs threshold
-                    if (!is_highest && (inf_filled == 0 || avg_inf < inference_threshold_ms)) should_run_inference = 1;
-                } else {
-                    // buffer-threshold gating with hysteresis
-                    if (!inf_buffer_mode_active && buffer->count >= inference_buffer_threshold) {
-                        inf_buffer_mode_active = 1; // enable inference when buffer has enough frames
-                    }
-                    if (inf_buffer_mode_active && buffer->count <= 12) {
-                        inf_buffer_mode_active = 0; // disable inference if buffer less than or equal to 12 frames (introduces hysteresis to prevent flapping around threshold)
-                    }
-                    if (inf_buffer_mode_active && !is_highest) should_run_inference = 1;
-                }
-
-                if (should_run_inference) {
-                    // printf("[debug] Running inference for frame\n");
-                    int rc2 = inference_run_buffer(frame->buffer, &inf_ms);
-                    if (rc2 != 0) {
-                        fprintf(stderr, "[warn] inference_run_buffer failed (rc=%d) for frame %d\n", rc2, frame->index);
-                        inf_ms = 0.0;
-                    } else {
-                        // update sliding window
-                        inf_times[inf_pos] = inf_ms;
-                        inf_pos = (inf_pos + 1) % inference_samples;
-                        if (inf_filled < inference_samples) inf_filled++;
-                    }
-                } else {
-                    // skip inference
-                    inf_ms = 0.0;
-                }
-            }
-
-            // Wait if buffer full
-            while (buffer->count >= buffer->max_frames) {
-                struct timespec ts = {0, 1000000}; // 1ms
-                nanosleep(&ts, NULL);
-            }
-
-            if (buffer_add(buffer) != 0) {
-               printf("[warn] buffer full, frame %d dropped.\n", frame->index);
-            }
-
-            logger_add_frame(logger, frame->index, frame->dl_ms, dec_ms, buffer->count);
-            if (logger->frame_size > 0) {
-                int idx = logger->frame_size - 1;
-                logger->frame_logs[idx].rep = frame->rep;
-                if (mpd && frame->rep >= 0 && frame->rep < mpd->n_reps) {
-                    logger->frame_logs[idx].bitrate = mpd->bitrates[frame->rep];
-                }
-                logger->frame_logs[idx].size_bytes = frame->size_bytes;
-                logger->frame_logs[idx].inference_ms = inf_ms;
-            }
-            if (abr) {
-                double total_ms = frame->dl_ms + dec_ms;
-                abr_update_stats(abr, frame->size_bytes, total_ms);
-            }
-            if (frame->buffer) {
-                g_byte_array_free(frame->buffer, 1);
-            }
-            free(frame);
-        }
-
-        if (inf_times) free(inf_times);
-
-        pthread_join(downloader_thread, NULL);
-        download_queue_free(queue);
-    } else {
-        // --- sequential Download, then buffer for no decryption (HTTPS or HTTP only) ---
-        for (int i = 0; i < mpd->total_frames; i++) {
-            int rep = 0;
-            if (abr) rep = abr_select_for_frame(abr, i, buffer->count);
-            const char* frame_url = mpd->frame_urls[rep][i];
-            double dl_ms = 0.0, dec_ms = 0.0;
-            size_t size_bytes = 0;
-            if (!write_output) {
-                GByteArray* buffer_mem = NULL;
-                int rc = download_file_mem(frame_url, &buffer_mem, &dl_ms);
-                if (rc != 0 || !buffer_mem) {
-                    fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, frame_url);
-                }
-                if (!buffer_mem) {
-                    fprintf(stderr, "[error] buffer_mem is NULL at frame %d\n", i);
-                    continue;
-                }
-                size_bytes = buffer_mem->len;
-                g_byte_array_free(buffer_mem, 1);
-            }
-            else {
-                char outpath[512];
-                snprintf(outpath, sizeof(outpath), "stream-download/frame_%d.ply", i);
-                int rc = download_file(frame_url, outpath, &dl_ms);
-                if (rc != 0) {
-                    fprintf(stderr, "[warn] download failed (rc=%d) for %s\n", rc, frame_url);
-                }
-                // cannot easily get size when written to disk; leave as 0
-            }
-            while (buffer->count >= buffer->max_frames) {
-                struct timespec ts = {0, 1000000}; // 1ms
-                nanosleep(&ts, NULL);
-            }
-            if (buffer_add(buffer) != 0) {
-                printf("[warn] buffer full, frame dropped.\n");
-            }
-            logger_add_frame(logger, i, dl_ms, dec_ms, buffer->count);
-            if (logger->frame_size > 0) {
-                int idx = logger->frame_size - 1;
-                logger->frame_logs[idx].rep = rep;
-                if (mpd && rep >= 0 && rep < mpd->n_reps) logger->frame_logs[idx].bitrate = mpd->bitrates[rep];
-                logger->frame_logs[idx].size_bytes = size_bytes;
-            }
-            if (abr) {
-                double total_ms = dl_ms + dec_ms;
-                abr_update_stats(abr, size_bytes, total_ms);
-            }
+            inf.times = calloc(inference_samples, sizeof(double));
+            PipelineStageDef in = { "inference", STAGE_INFERENCE, 1, 1, 1, inference_stage, NULL, &inf,
+                                    affinity_pin_self };
+            stage_err |= pipeline_add_stage(pipe, &in) < 0;
         }
     }
+    PipelineStageDef b = { "buffer", STAGE_BUFFER, 1, decrypt_enabled ? 1 : download_queue_size, 1,
+                           buffer_stage, NULL, &sink, affinity_pin_self };
+    stage_err |= pipeline_add_stage(pipe, &b) < 0;
+    if (stage_err || pipeline_start(pipe) != 0) {
+        fprintf(stderr, "[error] pipeline_start failed.\n");
+        cursor.produced = 0; // nothing reaches the player
+    }
+    pipeline_join(pipe);
+    pipeline_free(pipe);
+    free(inf.times);
+    prefetch_report(dargs.prefetch, logger);
+    prefetch_free(dargs.prefetch);
+
+    // A live stream may end before frames_to_play; let the player stop at what was produced
+    mpd_refresh_stop(mpd);
+    atomic_store(&args.total_frames, cursor.produced - sink.dropped);
 
     // --- Join thread of virtual thread with main since download decrypts finished ---
     pthread_join(player_thread, NULL);
@@ -410,6 +875,13 @@ int main(int argc, char* argv[]) {
     // --- Finalize ---
     logger_flush(logger, "logs/stream.csv");
     logger_flush_player(logger, "logs/player.csv");
+    if (abr) logger_flush_abr(logger, "logs/abr.csv");
+    if (deadline) logger_flush_deadline(logger, "logs/deadline.csv");
+    deadline_report(deadline);
+    netem_report();
+    frame_pool_report();
+    telemetry_report();
+    telemetry_shutdown();
 
     decryptor_shutdown();
     if (inference_enabled) inference_shutdown();
@@ -417,6 +889,10 @@ int main(int argc, char* argv[]) {
     buffer_free(buffer);
     free_mpd(mpd);
     if (abr) abr_free(abr);
+    deadline_free(deadline);
+    player_clock_destroy(&clock);
+    netem_shutdown();
+    frame_pool_shutdown();
 
     return 0;
 }
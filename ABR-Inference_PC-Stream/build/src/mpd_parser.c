@@ -1,56 +1,15 @@
 #define _POSIX_C_SOURCE 200809L
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <libxml/SAX2.h>
 #include <curl/curl.h>
 #include "mpd_parser.h"
 
-// Helper for curl memory buffer
-struct mem_buf {
-    char *data;
-    size_t size;
-};
-
-static size_t curl_write(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    struct mem_buf *mb = (struct mem_buf*)userdata;
-    size_t add = size * nmemb;
-    char *newp = realloc(mb->data, mb->size + add + 1);
-    if (!newp) return 0; // OOM
-    mb->data = newp;
-    memcpy(mb->data + mb->size, ptr, add);
-    mb->size += add;
-    mb->data[mb->size] = '\0';
-    return add;
-}
-
-// Fetch MPD into memory via curl
-static int fetch_mpd(const char* url, char **out_data, size_t *out_size) {
-    CURL *curl = curl_easy_init();
-    if (!curl) return -1;
-
-    struct mem_buf mb = {0};
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // ignore cert
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &mb);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK) {
-        free(mb.data);
-        return -1;
-    }
-
-    *out_data = mb.data;
-    *out_size = mb.size;
-    return 0;
-}
-
 // Helper: extract base directory of MPD URL (keep trailing slash)
 static char* get_base_url(const char* mpd_url) {
     const char* slash = strrchr(mpd_url, '/');
@@ -65,163 +24,706 @@ static char* get_base_url(const char* mpd_url) {
     return base;
 }
 
-// Parse MPD into MPDInfo struct
-MPDInfo* parse_mpd(const char* url) {
-    char *mpd_data = NULL;
-    size_t mpd_size = 0;
-    if (fetch_mpd(url, &mpd_data, &mpd_size) != 0) {
-        fprintf(stderr, "[error] Failed to fetch MPD: %s\n", url);
-        return NULL;
+// Expand a media template for one frame number. Supports $Number$, $Number%0<w>d$ and $$.
+// Returns the written length, or -1 if out is too small or the template is malformed.
+static int expand_template(const char* tmpl, int number, char* out, size_t out_len) {
+    size_t o = 0;
+    for (const char* p = tmpl; *p; ) {
+        if (*p != '$') {
+            if (o + 1 >= out_len) return -1;
+            out[o++] = *p++;
+            continue;
+        }
+        const char* end = strchr(p + 1, '$');
+        if (!end) return -1;
+        size_t id_len = (size_t)(end - (p + 1));
+        int n = 0;
+        if (id_len == 0) {
+            n = snprintf(out + o, out_len - o, "$");
+        } else if (!strncmp(p + 1, "Number", 6)) {
+            int width = 0;
+            if (id_len > 6) {
+                // format tag: %0<w>d
+                if (sscanf(p + 7, "%%0%dd", &width) != 1) return -1;
+            }
+            n = snprintf(out + o, out_len - o, "%0*d", width, number);
+        } else {
+            return -1;
+        }
+        if (n < 0 || o + (size_t)n >= out_len) return -1;
+        o += (size_t)n;
+        p = end + 1;
     }
+    if (o >= out_len) return -1;
+    out[o] = '\0';
+    return (int)o;
+}
 
-    xmlDoc *doc = xmlReadMemory(mpd_data, mpd_size, url, NULL, 0);
-    free(mpd_data);
-    if (!doc) {
-        fprintf(stderr, "[error] Failed to parse MPD XML: %s\n", url);
-        return NULL;
+// Try to express an explicit name list as prefix + zero-padded counter + suffix.
+// Returns a newly allocated $Number%0<w>d$ template (and *start_number) or NULL.
+static char* detect_template(const char* names, const int* offsets, int count, int* start_number) {
+    if (count < 2) return NULL;
+    const char* first = names + offsets[0];
+    if (strchr(first, '$') || strchr(first, '%')) return NULL;
+    char tmpl[1024];
+    char expect[1024];
+    for (const char* p = first; *p; ) {
+        if (*p < '0' || *p > '9') { p++; continue; }
+        const char* run = p;
+        while (*p >= '0' && *p <= '9') p++;
+        int width = (int)(p - run);
+        if (width > 9) continue;
+        int n = snprintf(tmpl, sizeof(tmpl), "%.*s$Number%%0%dd$%s", (int)(run - first), first, width, p);
+        if (n < 0 || (size_t)n >= sizeof(tmpl)) continue;
+        int start = atoi(run);
+        int ok = 1;
+        for (int i = 0; i < count && ok; i++) {
+            if (expand_template(tmpl, start + i, expect, sizeof(expect)) < 0 ||
+                strcmp(expect, names + offsets[i]) != 0) ok = 0;
+        }
+        if (ok) {
+            *start_number = start;
+            return strdup(tmpl);
+        }
     }
+    return NULL;
+}
 
-    xmlNode *root = xmlDocGetRootElement(doc);
-    if (!root) {
-        xmlFreeDoc(doc);
-        return NULL;
+// Append one media name to the representation's string table
+static int rep_add_name(MPDRepresentation* rep, const char* name) {
+    size_t add = strlen(name) + 1;
+    if (rep->names_len + add > rep->names_cap) {
+        size_t cap = rep->names_cap ? rep->names_cap : 4096;
+        while (cap < rep->names_len + add) cap *= 2;
+        char* p = realloc(rep->names, cap);
+        if (!p) return -1;
+        rep->names = p;
+        rep->names_cap = cap;
     }
+    int slot = rep->n_frames - rep->first_frame;
+    if (slot == rep->offsets_cap) {
+        int cap = rep->offsets_cap ? rep->offsets_cap * 2 : 256;
+        int* p = realloc(rep->name_offsets, (size_t)cap * sizeof(int));
+        if (!p) return -1;
+        rep->name_offsets = p;
+        rep->offsets_cap = cap;
+    }
+    rep->name_offsets[slot] = (int)rep->names_len;
+    memcpy(rep->names + rep->names_len, name, add);
+    rep->names_len += add;
+    rep->n_frames++;
+    return 0;
+}
 
-    MPDInfo *info = calloc(1, sizeof(MPDInfo));
-    if (!info) {
-        xmlFreeDoc(doc);
-        return NULL;
+static void rep_free_table(MPDRepresentation* rep) {
+    free(rep->names);
+    free(rep->name_offsets);
+    rep->names = NULL;
+    rep->name_offsets = NULL;
+    rep->names_len = rep->names_cap = 0;
+    rep->offsets_cap = 0;
+}
+
+// Media name (without base URL) of an addressable frame
+static int rep_media_name(const MPDRepresentation* r, int frame_index, char* out, size_t out_len) {
+    if (r->media_template) {
+        return expand_template(r->media_template, r->start_number + frame_index, out, out_len);
     }
+    int m = snprintf(out, out_len, "%s", r->names + r->name_offsets[frame_index - r->first_frame]);
+    return (m < 0 || (size_t)m >= out_len) ? -1 : m;
+}
 
-    // Extract duration + compute total_frames from frameRate
-    xmlChar *dur = xmlGetProp(root, (const xmlChar*)"mediaPresentationDuration");
-    int minutes = 0, seconds = 0, total_seconds = 0;
-    if (dur) {
-        // Handles PT1M00S, PT0M30S, PT90S, etc.
-        if (strstr((char*)dur, "M")) {
-            sscanf((char*)dur, "PT%dM%dS", &minutes, &seconds);
-            total_seconds = minutes * 60 + seconds;
-        } else {
-            sscanf((char*)dur, "PT%dS", &seconds);
-            total_seconds = seconds;
+int mpd_frame_url(MPDInfo* info, int rep, int frame_index, char* out, size_t out_len) {
+    if (!info || !out || out_len == 0) return -1;
+    if (rep < 0 || rep >= info->n_reps || !info->reps) return -1;
+    pthread_mutex_lock(&info->lock);
+    const MPDRepresentation* r = &info->reps[rep];
+    int len = -1;
+    if (frame_index >= r->first_frame && frame_index < r->n_frames) {
+        int n = snprintf(out, out_len, "%s", r->base_url ? r->base_url : "");
+        if (n >= 0 && (size_t)n < out_len) {
+            int m = rep_media_name(r, frame_index, out + n, out_len - (size_t)n);
+            if (m >= 0) len = n + m;
         }
-        xmlFree(dur);
     }
+    pthread_mutex_unlock(&info->lock);
+    return len;
+}
 
-    // Walk down AdaptationSet -> Representation nodes to get frameRate and bitrates
-    // Collect all Representation nodes
-    xmlNode *adapt = NULL;
-    for (xmlNode *as = root->children; as; as = as->next) {
-        if (as->type == XML_ELEMENT_NODE && strcmp((char*)as->name, "AdaptationSet") == 0) {
-            adapt = as;
-            break;
+// ---- Streaming (SAX) parse state: MPDInfo is filled in one pass while curl delivers the body ----
+typedef struct {
+    MPDInfo* info;
+    const char* mpd_base;
+    int total_seconds;
+    int adapt_state;          // 0 = before first AdaptationSet, 1 = inside it, 2 = done with it
+    int rep_cap;
+    MPDRepresentation* cur;   // representation being filled (NULL outside one)
+    int in_frame_list;
+    int in_base_url;
+    char base_text[1024];     // BaseURL of the current representation
+    size_t base_len;
+    int found;
+    int failed;               // allocation failure
+} MpdSaxState;
+
+// Copy attribute `name` from SAX2 attribute tuples (localname, prefix, URI, value, end) into out
+static int sax_attr(const xmlChar** attrs, int nb_attrs, const char* name, char* out, size_t out_len) {
+    for (int i = 0; i < nb_attrs; i++) {
+        const xmlChar** a = attrs + i * 5;
+        if (strcmp((const char*)a[0], name) != 0) continue;
+        size_t len = (size_t)(a[4] - a[3]);
+        if (len >= out_len) len = out_len - 1;
+        memcpy(out, a[3], len);
+        out[len] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+static int sax_attr_int(const xmlChar** attrs, int nb_attrs, const char* name, int def) {
+    char buf[32];
+    if (sax_attr(attrs, nb_attrs, name, buf, sizeof(buf)) != 0) return def;
+    return atoi(buf);
+}
+
+// Parse an xs:duration such as PT1M00S, PT90S, PT0.5S or PT1H into milliseconds
+static double parse_duration_ms(const char* dur) {
+    const char* p = strchr(dur, 'T');
+    if (!p) return 0.0;
+    p++;
+    double ms = 0.0;
+    while (*p) {
+        char* end = NULL;
+        double v = strtod(p, &end);
+        if (end == p || !*end) break;
+        if (*end == 'H') ms += v * 3600000.0;
+        else if (*end == 'M') ms += v * 60000.0;
+        else if (*end == 'S') ms += v * 1000.0;
+        p = end + 1;
+    }
+    return ms;
+}
+
+static void sax_begin_representation(MpdSaxState* st, const xmlChar** attrs, int nb_attrs) {
+    MPDInfo* info = st->info;
+    if (info->n_reps == st->rep_cap) {
+        int cap = st->rep_cap ? st->rep_cap * 2 : 4;
+        MPDRepresentation* reps = realloc(info->reps, (size_t)cap * sizeof(MPDRepresentation));
+        int* br = realloc(info->bitrates, (size_t)cap * sizeof(int));
+        if (reps) info->reps = reps;
+        if (br) info->bitrates = br;
+        if (!reps || !br) { st->failed = 1; return; }
+        st->rep_cap = cap;
+    }
+    int idx = info->n_reps++;
+    st->cur = &info->reps[idx];
+    memset(st->cur, 0, sizeof(*st->cur));
+    // bitrate/bandwidth
+    info->bitrates[idx] = sax_attr_int(attrs, nb_attrs, "bandwidth", 0);
+    // frameRate from the first representation that has one; total_frames follows from it
+    if (info->frame_rate == 0) {
+        info->frame_rate = sax_attr_int(attrs, nb_attrs, "frameRate", 0);
+        if (info->frame_rate > 0 && st->total_seconds > 0) {
+            info->total_frames = info->frame_rate * st->total_seconds;
         }
     }
+    st->base_len = 0;
+    st->base_text[0] = '\0';
+}
 
-    // First pass: find frameRate (from any representation) and count representations
-    int rep_count = 0;
-    if (adapt) {
-        for (xmlNode *r = adapt->children; r; r = r->next) {
-            if (r->type == XML_ELEMENT_NODE && strcmp((char*)r->name, "Representation") == 0) {
-                rep_count++;
-                if (info->frame_rate == 0) {
-                    xmlChar *fr = xmlGetProp(r, (const xmlChar*)"frameRate");
-                    if (fr) {
-                        info->frame_rate = atoi((char*)fr);
-                        xmlFree(fr);
-                    }
-                }
-            }
+// Template form: <FrameTemplate media="...$Number%05d$..." startNumber="1" frameCount="1440"/>
+// media is required, startNumber ($Number$ of frame 0) defaults to 1 and frameCount to total_frames.
+// Live manifests raise frameCount on every update and may set firstFrame for a sliding window.
+static void sax_frame_template(MpdSaxState* st, const xmlChar** attrs, int nb_attrs) {
+    MPDRepresentation* rep = st->cur;
+    char media[1024], probe[1024];
+    if (sax_attr(attrs, nb_attrs, "media", media, sizeof(media)) != 0 ||
+        expand_template(media, 1, probe, sizeof(probe)) < 0) {
+        fprintf(stderr, "[warn] MPD: invalid FrameTemplate in Representation %d\n", st->info->n_reps - 1);
+        return;
+    }
+    free(rep->media_template);
+    rep->media_template = strdup(media);
+    rep->start_number = sax_attr_int(attrs, nb_attrs, "startNumber", 1);
+    int total = st->info->total_frames;
+    int count = sax_attr_int(attrs, nb_attrs, "frameCount", total);
+    if (!st->info->is_dynamic && total > 0 && count > total) count = total;
+    rep->n_frames = (count > 0) ? count : 0;
+    rep->first_frame = sax_attr_int(attrs, nb_attrs, "firstFrame", 0);
+    if (rep->first_frame < 0 || rep->first_frame > rep->n_frames) rep->first_frame = 0;
+}
+
+static void sax_end_representation(MpdSaxState* st) {
+    MPDRepresentation* rep = st->cur;
+    // Representation base: MPD directory, or the Representation's BaseURL (absolute or relative to it)
+    if (st->base_len > 0 && strstr(st->base_text, "://")) {
+        rep->base_url = strdup(st->base_text);
+    } else {
+        size_t len = strlen(st->mpd_base) + st->base_len + 1;
+        rep->base_url = malloc(len);
+        if (rep->base_url) snprintf(rep->base_url, len, "%s%s", st->mpd_base, st->base_text);
+    }
+    if (!rep->base_url) st->failed = 1;
+    // Consecutively numbered names collapse to a template: O(1) memory per representation
+    if (!rep->media_template && rep->names) {
+        int start = 0;
+        rep->media_template = detect_template(rep->names, rep->name_offsets,
+                                              rep->n_frames - rep->first_frame, &start);
+        if (rep->media_template) {
+            rep->start_number = start - rep->first_frame;
+            rep_free_table(rep);
+        }
+    }
+    if (rep->n_frames > 0) st->found += rep->n_frames;
+    st->cur = NULL;
+}
+
+static void sax_start_element(void* ctx, const xmlChar* localname, const xmlChar* prefix,
+                              const xmlChar* URI, int nb_namespaces, const xmlChar** namespaces,
+                              int nb_attributes, int nb_defaulted, const xmlChar** attrs) {
+    (void)prefix; (void)URI; (void)nb_namespaces; (void)namespaces; (void)nb_defaulted;
+    MpdSaxState* st = (MpdSaxState*)ctx;
+    const char* name = (const char*)localname;
+    if (st->failed) return;
+
+    if (!strcmp(name, "MPD")) {
+        char val[64];
+        if (sax_attr(attrs, nb_attributes, "mediaPresentationDuration", val, sizeof(val)) == 0) {
+            st->total_seconds = (int)(parse_duration_ms(val) / 1000.0);
+        }
+        if (sax_attr(attrs, nb_attributes, "type", val, sizeof(val)) == 0) {
+            st->info->is_dynamic = !strcmp(val, "dynamic");
+        }
+        if (sax_attr(attrs, nb_attributes, "minimumUpdatePeriod", val, sizeof(val)) == 0) {
+            int ms = (int)parse_duration_ms(val);
+            if (ms > 0) st->info->min_update_ms = ms;
+        }
+    } else if (!strcmp(name, "AdaptationSet")) {
+        // only the first AdaptationSet is used
+        if (st->adapt_state == 0) st->adapt_state = 1;
+    } else if (st->adapt_state != 1) {
+        return;
+    } else if (!strcmp(name, "Representation")) {
+        sax_begin_representation(st, attrs, nb_attributes);
+    } else if (!st->cur) {
+        return;
+    } else if (!strcmp(name, "BaseURL")) {
+        st->in_base_url = 1;
+    } else if (!strcmp(name, "FrameTemplate") || !strcmp(name, "SegmentTemplate")) {
+        sax_frame_template(st, attrs, nb_attributes);
+    } else if (!strcmp(name, "FrameList")) {
+        st->in_frame_list = 1;
+        // sliding live lists start at FrameList@firstFrame instead of frame 0
+        if (!st->cur->names && !st->cur->media_template) {
+            int first = sax_attr_int(attrs, nb_attributes, "firstFrame", 0);
+            st->cur->first_frame = (first > 0) ? first : 0;
+            st->cur->n_frames = st->cur->first_frame;
+        }
+    } else if (st->in_frame_list && !strcmp(name, "FrameURL")) {
+        MPDRepresentation* rep = st->cur;
+        char media[1024];
+        if (rep->media_template) return; // template wins over an explicit list
+        int cap = (st->info->is_dynamic || st->info->total_frames <= 0) ? INT_MAX : st->info->total_frames;
+        if (sax_attr(attrs, nb_attributes, "media", media, sizeof(media)) == 0 && rep->n_frames < cap) {
+            if (rep_add_name(rep, media) != 0) st->failed = 1;
         }
     }
+}
 
-    info->n_reps = (rep_count > 0) ? rep_count : 1;
-    info->bitrates = calloc(info->n_reps, sizeof(int));
-    info->frame_urls = calloc(info->n_reps, sizeof(char**));
+static void sax_end_element(void* ctx, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI) {
+    (void)prefix; (void)URI;
+    MpdSaxState* st = (MpdSaxState*)ctx;
+    const char* name = (const char*)localname;
+    if (st->failed) return;
+    if (!strcmp(name, "AdaptationSet")) {
+        if (st->adapt_state == 1) st->adapt_state = 2;
+    } else if (!st->cur) {
+        return;
+    } else if (!strcmp(name, "Representation")) {
+        sax_end_representation(st);
+    } else if (!strcmp(name, "FrameList")) {
+        st->in_frame_list = 0;
+    } else if (!strcmp(name, "BaseURL")) {
+        st->in_base_url = 0;
+    }
+}
 
-    if (info->frame_rate > 0 && total_seconds > 0) {
-        info->total_frames = info->frame_rate * total_seconds;
+static void sax_characters(void* ctx, const xmlChar* ch, int len) {
+    MpdSaxState* st = (MpdSaxState*)ctx;
+    if (!st->in_base_url || !st->cur) return;
+    for (int i = 0; i < len && st->base_len + 1 < sizeof(st->base_text); i++) {
+        char c = (char)ch[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') continue;
+        st->base_text[st->base_len++] = c;
     }
+    st->base_text[st->base_len] = '\0';
+}
 
-    // Collect FrameURLs per representation
-    char* base = get_base_url(url);
-    int found = 0;
-
-    if (adapt) {
-        int rep_idx = 0;
-        for (xmlNode *r = adapt->children; r; r = r->next) {
-            if (r->type == XML_ELEMENT_NODE && strcmp((char*)r->name, "Representation") == 0) {
-                // bitrate/bandwidth
-                xmlChar *bw = xmlGetProp(r, (const xmlChar*)"bandwidth");
-                if (bw) {
-                    info->bitrates[rep_idx] = atoi((char*)bw);
-                    xmlFree(bw);
-                } else {
-                    info->bitrates[rep_idx] = 0;
-                }
-
-                // allocate array for frames
-                info->frame_urls[rep_idx] = calloc(info->total_frames, sizeof(char*));
-                int idx = 0;
-                for (xmlNode *fl = r->children; fl; fl = fl->next) {
-                    if (fl->type == XML_ELEMENT_NODE && strcmp((char*)fl->name, "FrameList") == 0) {
-                        for (xmlNode *fu = fl->children; fu; fu = fu->next) {
-                            if (fu->type == XML_ELEMENT_NODE && strcmp((char*)fu->name, "FrameURL") == 0) {
-                                xmlChar *m = xmlGetProp(fu, (const xmlChar*)"media");
-                                if (m && idx < info->total_frames) {
-                                    char full[1024];
-                                    snprintf(full, sizeof(full), "%s%s", base, (char*)m);
-                                    info->frame_urls[rep_idx][idx++] = strdup(full);
-                                }
-                                xmlFree(m);
-                            }
-                        }
-                    }
-                }
-                if (idx > 0) found += idx;
-                rep_idx++;
-            }
+typedef struct {
+    xmlParserCtxtPtr ctxt;
+    CURL* curl;
+    char** etag;
+} MpdFetch;
+
+// Status of the response being received is a manifest: 200, or 0 for file:// and the like.
+// An error page (404, 5xx) can be well-formed XML too and must never be parsed as the MPD.
+static int response_is_mpd(CURL* curl) {
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    return code == 200 || code == 0;
+}
+
+// curl write callback: hand each received chunk straight to the push parser
+static size_t curl_write_sax(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    MpdFetch* f = (MpdFetch*)userdata;
+    size_t add = size * nmemb;
+    if (!response_is_mpd(f->curl)) return add; // body of an error or redirect: dropped
+    if (xmlParseChunk(f->ctxt, (const char*)ptr, (int)add, 0) != 0) return 0; // abort transfer on XML error
+    return add;
+}
+
+// curl header callback: remember the ETag of the manifest for conditional refreshes
+static size_t curl_header_etag(char *buffer, size_t size, size_t nitems, void *userdata) {
+    MpdFetch* f = (MpdFetch*)userdata;
+    char** etag = f->etag;
+    size_t len = size * nitems;
+    if (etag && len > 5 && !strncasecmp(buffer, "ETag:", 5) && response_is_mpd(f->curl)) {
+        const char* v = buffer + 5;
+        const char* end = buffer + len;
+        while (v < end && (*v == ' ' || *v == '\t')) v++;
+        while (end > v && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+        free(*etag);
+        *etag = strndup(v, (size_t)(end - v));
+    }
+    return len;
+}
+
+// Fetch MPD via curl and parse it while it arrives. With etag_in set, sends If-None-Match and
+// reports an unchanged manifest through *not_modified. The response ETag goes to *etag_out.
+static int fetch_and_parse_mpd(const char* url, MpdSaxState* st, const char* etag_in,
+                               char** etag_out, int* not_modified) {
+    xmlSAXHandler sax;
+    memset(&sax, 0, sizeof(sax));
+    sax.initialized = XML_SAX2_MAGIC;
+    sax.startElementNs = sax_start_element;
+    sax.endElementNs = sax_end_element;
+    sax.characters = sax_characters;
+    if (not_modified) *not_modified = 0;
+
+    xmlParserCtxtPtr ctxt = xmlCreatePushParserCtxt(&sax, st, NULL, 0, url);
+    if (!ctxt) return -1;
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        xmlFreeParserCtxt(ctxt);
+        return -1;
+    }
+    struct curl_slist* hdrs = NULL;
+    if (etag_in) {
+        char h[512];
+        snprintf(h, sizeof(h), "If-None-Match: %s", etag_in);
+        hdrs = curl_slist_append(hdrs, h);
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // ignore cert
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    MpdFetch f = { ctxt, curl, etag_out };
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_sax);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &f);
+    if (hdrs) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, hdrs);
+    if (etag_out) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_header_etag);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &f);
+    }
+
+    CURLcode res = curl_easy_perform(curl);
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(hdrs);
+
+    int rc = 0;
+    if (res == CURLE_OK && code == 304) {
+        if (not_modified) *not_modified = 1;
+    } else if (res == CURLE_OK && code != 200 && code != 0) {
+        fprintf(stderr, "[error] Failed to fetch MPD: %s (HTTP %ld)\n", url, code);
+        rc = -1;
+    } else if (res == CURLE_OK) {
+        xmlParseChunk(ctxt, NULL, 0, 1); // terminate
+        if (!ctxt->wellFormed) {
+            fprintf(stderr, "[error] Failed to parse MPD XML: %s\n", url);
+            rc = -2;
         }
+    } else {
+        fprintf(stderr, "[error] Failed to fetch MPD: %s\n", url);
+        rc = -1;
     }
+    xmlFreeParserCtxt(ctxt);
+    if (st->failed) rc = -3;
+    return rc;
+}
+
+static MPDInfo* mpd_alloc(void) {
+    MPDInfo *info = calloc(1, sizeof(MPDInfo));
+    if (!info) return NULL;
+    info->min_update_ms = 1000;
+    pthread_mutex_init(&info->lock, NULL);
+    pthread_cond_init(&info->grown, NULL);
+    return info;
+}
+
+// Fetch + parse url into a fresh MPDInfo and settle total_frames. *not_modified is set on HTTP 304.
+static MPDInfo* load_mpd(const char* url, const char* etag_in, int* not_modified) {
+    MPDInfo *info = mpd_alloc();
+    if (!info) return NULL;
+    info->url = strdup(url);
+
+    char* base = get_base_url(url);
+    MpdSaxState st;
+    memset(&st, 0, sizeof(st));
+    st.info = info;
+    st.mpd_base = base ? base : "./";
 
+    int rc = fetch_and_parse_mpd(url, &st, etag_in, &info->etag, not_modified);
+    if (st.cur) sax_end_representation(&st); // truncated document
     free(base);
-    xmlFreeDoc(doc);
+    if (rc != 0 || (not_modified && *not_modified)) {
+        free_mpd(info);
+        return NULL;
+    }
 
-    if (found == 0) {
+    // No Representation at all: keep one empty one so callers can index reps[0]
+    if (info->n_reps == 0) {
+        info->n_reps = 1;
+        info->bitrates = calloc(1, sizeof(int));
+        info->reps = calloc(1, sizeof(MPDRepresentation));
+    }
+
+    int found = st.found;
+    if (info->is_dynamic) {
+        // live: what every representation has announced so far
+        int min_frames = INT_MAX;
+        for (int r = 0; r < info->n_reps; r++) {
+            if (info->reps[r].n_frames < min_frames) min_frames = info->reps[r].n_frames;
+        }
+        info->total_frames = min_frames;
+    } else if (found == 0) {
         // fallback: no FrameURLs found
         fprintf(stderr, "[warn] MPD: no FrameURLs found in any Representation\n");
         info->total_frames = 0;
     } else if (found / info->n_reps != info->total_frames) {
         // Inconsistent counts: adjust total_frames to min found per-representation
-        int min_frames = info->total_frames;
+        // (templates may declare frameCount without a mediaPresentationDuration)
+        int min_frames = (info->total_frames > 0) ? info->total_frames : INT_MAX;
         for (int r = 0; r < info->n_reps; r++) {
-            int cnt = 0;
-            if (info->frame_urls[r]) {
-                for (int f = 0; f < info->total_frames; f++) if (info->frame_urls[r][f]) cnt++;
-            }
-            if (cnt < min_frames) min_frames = cnt;
+            if (info->reps[r].n_frames < min_frames) min_frames = info->reps[r].n_frames;
+        }
+        if (info->total_frames > 0) {
+            fprintf(stderr, "[warn] MPD declared %d frames, adjusting to %d frames found per representation\n",
+                    info->total_frames, min_frames);
         }
-        fprintf(stderr, "[warn] MPD declared %d frames, adjusting to %d frames found per representation\n",
-                info->total_frames, min_frames);
         info->total_frames = min_frames;
     }
-    printf("[info] MPD parsed: frame_rate=%d, total_frames=%d, n_reps=%d\n",
-           info->frame_rate, info->total_frames, info->n_reps);
     return info;
 }
 
+// Parse MPD into MPDInfo struct
+MPDInfo* parse_mpd(const char* url) {
+    MPDInfo* info = load_mpd(url, NULL, NULL);
+    if (!info) return NULL;
+    printf("[info] MPD parsed: frame_rate=%d, total_frames=%d, n_reps=%d%s\n",
+           info->frame_rate, info->total_frames, info->n_reps,
+           info->is_dynamic ? " (dynamic)" : "");
+    return info;
+}
+
+// ---- Live refresh ----
+
+// Append frames announced in `fresh` beyond what `old` already has (called with info->lock held).
+// Returns 1 if the representation grew.
+static int merge_rep(MPDRepresentation* old, const MPDRepresentation* fresh) {
+    if (fresh->n_frames <= old->n_frames) return 0;
+    // same template: just extend the frame range
+    if (old->media_template && fresh->media_template &&
+        !strcmp(old->media_template, fresh->media_template) &&
+        old->start_number == fresh->start_number) {
+        old->n_frames = fresh->n_frames;
+        return 1;
+    }
+    if (fresh->first_frame > old->n_frames) {
+        fprintf(stderr, "[warn] MPD refresh: gap before frame %d, waiting for a contiguous update\n",
+                fresh->first_frame);
+        return 0;
+    }
+    // otherwise keep an explicit table and append the new names to it
+    char name[1024];
+    if (old->media_template) {
+        char* tmpl = old->media_template;
+        int first = old->first_frame, end = old->n_frames;
+        old->media_template = NULL;
+        old->n_frames = old->first_frame;
+        for (int f = first; f < end; f++) {
+            if (expand_template(tmpl, old->start_number + f, name, sizeof(name)) < 0 ||
+                rep_add_name(old, name) != 0) break;
+        }
+        free(tmpl);
+    }
+    int grown = 0;
+    while (old->n_frames < fresh->n_frames) {
+        if (rep_media_name(fresh, old->n_frames, name, sizeof(name)) < 0 ||
+            rep_add_name(old, name) != 0) break;
+        grown = 1;
+    }
+    return grown;
+}
+
+int mpd_refresh(MPDInfo* info) {
+    if (!info || !info->url) return -1;
+    pthread_mutex_lock(&info->lock);
+    char* etag = info->etag ? strdup(info->etag) : NULL;
+    pthread_mutex_unlock(&info->lock);
+
+    // fetch + parse outside the lock so the downloader keeps going
+    int not_modified = 0;
+    MPDInfo* fresh = load_mpd(info->url, etag, &not_modified);
+    free(etag);
+    if (not_modified) return 0;
+    if (!fresh) return -1;
+
+    int grown = 0;
+    pthread_mutex_lock(&info->lock);
+    int n = (fresh->n_reps < info->n_reps) ? fresh->n_reps : info->n_reps;
+    int min_frames = INT_MAX;
+    for (int r = 0; r < info->n_reps; r++) {
+        if (r < n) grown |= merge_rep(&info->reps[r], &fresh->reps[r]);
+        if (info->reps[r].n_frames < min_frames) min_frames = info->reps[r].n_frames;
+    }
+    if (min_frames != INT_MAX && min_frames > info->total_frames) info->total_frames = min_frames;
+    info->is_dynamic = fresh->is_dynamic;  // a static update ends the live stream
+    info->min_update_ms = fresh->min_update_ms;
+    free(info->etag);
+    info->etag = fresh->etag;
+    fresh->etag = NULL;
+    pthread_cond_broadcast(&info->grown);
+    pthread_mutex_unlock(&info->lock);
+
+    free_mpd(fresh);
+    return grown;
+}
+
+int mpd_available_frames(MPDInfo* info) {
+    if (!info) return 0;
+    pthread_mutex_lock(&info->lock);
+    int n = info->total_frames;
+    pthread_mutex_unlock(&info->lock);
+    return n;
+}
+
+int mpd_is_dynamic(MPDInfo* info) {
+    if (!info) return 0;
+    pthread_mutex_lock(&info->lock);
+    int dynamic = info->is_dynamic;
+    pthread_mutex_unlock(&info->lock);
+    return dynamic;
+}
+
+static void abs_timeout(struct timespec* ts, int timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+int mpd_wait_for_frame(MPDInfo* info, int frame_index, int timeout_ms) {
+    if (!info) return -1;
+    struct timespec ts;
+    abs_timeout(&ts, timeout_ms);
+    int rc = 1;
+    pthread_mutex_lock(&info->lock);
+    while (frame_index >= info->total_frames) {
+        if (!info->is_dynamic || !info->refresh_running) { rc = -1; break; }
+        if (pthread_cond_timedwait(&info->grown, &info->lock, &ts) != 0) {
+            rc = (frame_index < info->total_frames) ? 1 : 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&info->lock);
+    return rc;
+}
+
+static void* refresh_thread_func(void* arg) {
+    MPDInfo* info = (MPDInfo*)arg;
+    for (;;) {
+        struct timespec ts;
+        pthread_mutex_lock(&info->lock);
+        abs_timeout(&ts, info->min_update_ms);
+        while (!info->refresh_stop) {
+            if (pthread_cond_timedwait(&info->grown, &info->lock, &ts) != 0) break;
+        }
+        int stop = info->refresh_stop;
+        pthread_mutex_unlock(&info->lock);
+        if (stop) break;
+
+        if (mpd_refresh(info) < 0) {
+            fprintf(stderr, "[warn] MPD refresh failed: %s\n", info->url);
+        }
+        pthread_mutex_lock(&info->lock);
+        int dynamic = info->is_dynamic;
+        pthread_mutex_unlock(&info->lock);
+        if (!dynamic) {
+            printf("[info] MPD is now static, live stream ends at %d frames\n", mpd_available_frames(info));
+            break;
+        }
+    }
+    pthread_mutex_lock(&info->lock);
+    info->refresh_running = 0;
+    pthread_cond_broadcast(&info->grown); // wake waiters so they see the end
+    pthread_mutex_unlock(&info->lock);
+    return NULL;
+}
+
+int mpd_refresh_start(MPDInfo* info) {
+    if (!info || !info->is_dynamic || info->refresh_running) return 0;
+    info->refresh_stop = 0;
+    info->refresh_running = 1;
+    if (pthread_create(&info->refresh_thread, NULL, refresh_thread_func, info) != 0) {
+        info->refresh_running = 0;
+        return -1;
+    }
+    info->refresh_started = 1;
+    return 0;
+}
+
+void mpd_refresh_stop(MPDInfo* info) {
+    if (!info || !info->refresh_started) return;
+    pthread_mutex_lock(&info->lock);
+    info->refresh_stop = 1;
+    pthread_cond_broadcast(&info->grown);
+    pthread_mutex_unlock(&info->lock);
+    pthread_join(info->refresh_thread, NULL);
+    info->refresh_started = 0;
+}
+
 void free_mpd(MPDInfo* info) {
     if (!info) return;
-    if (info->frame_urls) {
+    mpd_refresh_stop(info);
+    if (info->reps) {
         for (int r = 0; r < info->n_reps; r++) {
-            if (!info->frame_urls[r]) continue;
-            for (int i = 0; i < info->total_frames; i++) {
-                if (info->frame_urls[r][i]) free(info->frame_urls[r][i]);
-            }
-            free(info->frame_urls[r]);
+            free(info->reps[r].base_url);
+            free(info->reps[r].media_template);
+            free(info->reps[r].names);
+            free(info->reps[r].name_offsets);
         }
-        free(info->frame_urls);
+        free(info->reps);
     }
     if (info->bitrates) free(info->bitrates);
+    free(info->url);
+    free(info->etag);
+    pthread_mutex_destroy(&info->lock);
+    pthread_cond_destroy(&info->grown);
     free(info);
 }
@@ -1,15 +1,67 @@
 #ifndef MPD_PARSER_H
 #define MPD_PARSER_H
 
+#include <stddef.h>
+#include <pthread.h>
+
+// Per-representation frame addressing. Frame URLs are built on demand by mpd_frame_url():
+// either from a $Number$ media template or from a compact table of media names.
+typedef struct {
+    char *base_url;       // MPD directory (+ Representation BaseURL if present), trailing slash kept
+    char *media_template; // e.g. "office52-x-$Number%05d$-12.ply.cpabe", or NULL if a name table is used
+    int start_number;     // $Number$ of frame 0
+    char *names;          // NUL-separated media names (only when media_template == NULL)
+    int *name_offsets;    // name_offsets[frame - first_frame] into names
+    int first_frame;      // first addressable frame (FrameList@firstFrame for sliding live lists)
+    int n_frames;         // frames [first_frame, n_frames) are addressable in this representation
+    size_t names_len, names_cap; // string table fill/capacity (grows on live refresh)
+    int offsets_cap;
+} MPDRepresentation;
+
 typedef struct {
     int frame_rate;
     int total_frames;
     int n_reps;         // number of representations/qualities
     int *bitrates;      // bitrate (bits per second) for each representation
-    char ***frame_urls; // frame_urls[rep][frame_index]
+    MPDRepresentation *reps; // reps[rep]
+
+    // --- Live (type="dynamic") manifests ---
+    int is_dynamic;     // 1 while the manifest is dynamic; cleared when it turns static
+    int min_update_ms;  // refresh period from minimumUpdatePeriod (default 1000 ms)
+    char *url;          // manifest URL, re-fetched by the refresh thread
+    char *etag;         // ETag of the last fetched manifest (conditional GET)
+    // Guards reps and total_frames once a refresh thread runs; `grown` signals new frames
+    pthread_mutex_t lock;
+    pthread_cond_t grown;
+    pthread_t refresh_thread;
+    int refresh_started; // thread created and not yet joined
+    int refresh_running; // thread still refreshing (cleared when the manifest turns static)
+    int refresh_stop;
 } MPDInfo;
 
 MPDInfo* parse_mpd(const char* url);
 void free_mpd(MPDInfo* info);
 
+// Write the URL of frame_index in representation rep into out (out_len bytes).
+// Returns the URL length, or -1 if the frame does not exist or out is too small.
+int mpd_frame_url(MPDInfo* info, int rep, int frame_index, char* out, size_t out_len);
+
+// Frames currently announced in every representation.
+int mpd_available_frames(MPDInfo* info);
+
+// is_dynamic under the lock (the refresh thread clears it when the manifest turns static).
+int mpd_is_dynamic(MPDInfo* info);
+
+// Block until frame_index is announced. Returns 1 when available, 0 on timeout,
+// -1 if the stream ended (manifest static or refresh stopped) without announcing it.
+int mpd_wait_for_frame(MPDInfo* info, int frame_index, int timeout_ms);
+
+// Re-fetch the manifest (If-None-Match with the stored ETag) and append newly announced frames.
+// Returns 1 if frames were added, 0 if nothing changed, negative on error.
+int mpd_refresh(MPDInfo* info);
+
+// Start/stop the background refresh thread (only started for dynamic manifests).
+int mpd_refresh_start(MPDInfo* info);
+void mpd_refresh_stop(MPDInfo* info);
+
 #endif
@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "netem.h"
+#include "utils.h"
+
+#define NETEM_MAX_SLEEP_MS 10.0  // re-check the (possibly trace-driven) rate at least this often
+
+typedef struct {
+    double t_ms;   // step start, relative to trace start
+    double bps;    // bytes per second during the step
+} TraceStep;
+
+static struct {
+    int enabled;
+    NetEmConfig cfg;
+    double rate_Bps;       // constant rate in bytes/s (when no trace)
+    double burst_bytes;
+    TraceStep* steps;
+    int n_steps;
+    double period_ms;      // trace length; playback loops
+    double t0_ms;          // emulation start (trace time 0)
+    // token bucket shared by concurrent transfers
+    double tokens;
+    double last_refill_ms;
+    unsigned rng;
+    // totals
+    double bytes;
+    long lost_packets;
+    double delay_ms;       // RTT/jitter/loss delay added
+    double shaped_ms;      // time spent waiting for tokens
+    pthread_mutex_t lock;
+} g_net = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Trace lines: "<time_s> <Mbit/s>", time ascending from 0. The last step lasts as long as
+// the one before it, then the trace repeats. '#' starts a comment.
+static int load_trace(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "[error] netem: cannot open trace %s\n", path);
+        return -1;
+    }
+    int cap = 256;
+    g_net.steps = malloc((size_t)cap * sizeof(TraceStep));
+    g_net.n_steps = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        double t, mbps;
+        if (line[0] == '#' || sscanf(line, "%lf %lf", &t, &mbps) != 2) continue;
+        if (g_net.n_steps == cap) {
+            cap *= 2;
+            g_net.steps = realloc(g_net.steps, (size_t)cap * sizeof(TraceStep));
+        }
+        g_net.steps[g_net.n_steps].t_ms = t * 1000.0;
+        g_net.steps[g_net.n_steps].bps = (mbps > 0 ? mbps : 0) * 1e6 / 8.0;
+        g_net.n_steps++;
+    }
+    fclose(fp);
+    if (g_net.n_steps == 0) {
+        fprintf(stderr, "[error] netem: no '<time_s> <Mbit/s>' lines in %s\n", path);
+        free(g_net.steps);
+        g_net.steps = NULL;
+        return -1;
+    }
+    // rebase to 0 so traces cut from the middle of a capture work
+    double base = g_net.steps[0].t_ms;
+    for (int i = 0; i < g_net.n_steps; i++) g_net.steps[i].t_ms -= base;
+    int n = g_net.n_steps;
+    double last_len = (n > 1) ? g_net.steps[n - 1].t_ms - g_net.steps[n - 2].t_ms : 1000.0;
+    if (last_len <= 0) last_len = 1000.0;
+    g_net.period_ms = g_net.steps[n - 1].t_ms + last_len;
+    printf("[info] netem: trace %s, %d steps, period %.1f s\n", path, n, g_net.period_ms / 1000.0);
+    return 0;
+}
+
+// Current link rate in bytes/s (lock held)
+static double current_rate(double now) {
+    if (!g_net.steps) return g_net.rate_Bps;
+    double t = now - g_net.t0_ms;
+    t -= g_net.period_ms * (double)(long)(t / g_net.period_ms);
+    int lo = 0, hi = g_net.n_steps - 1;
+    while (lo < hi) { // last step starting at or before t
+        int mid = (lo + hi + 1) / 2;
+        if (g_net.steps[mid].t_ms <= t) lo = mid;
+        else hi = mid - 1;
+    }
+    return g_net.steps[lo].bps;
+}
+
+static void refill(double now) {
+    double dt = now - g_net.last_refill_ms;
+    g_net.last_refill_ms = now;
+    if (dt <= 0) return;
+    g_net.tokens += current_rate(now) * dt / 1000.0;
+    if (g_net.tokens > g_net.burst_bytes) g_net.tokens = g_net.burst_bytes;
+}
+
+// Uniform in [0, 1) from the shared seed (lock held)
+static double rand_unit(void) {
+    return (double)rand_r(&g_net.rng) / ((double)RAND_MAX + 1.0);
+}
+
+static void sleep_ms(double ms) {
+    if (ms > 0) sleep_until_deadline_ms(now_ms_mono() + ms);
+}
+
+int netem_configure(const NetEmConfig* cfg) {
+    g_net.cfg = *cfg;
+    if (g_net.cfg.mss <= 0) g_net.cfg.mss = 1448;
+    if (g_net.cfg.burst_kb <= 0) g_net.cfg.burst_kb = 64;
+    if (cfg->trace && load_trace(cfg->trace) != 0) return -1;
+    g_net.rate_Bps = cfg->rate_mbps * 1e6 / 8.0;
+    g_net.burst_bytes = g_net.cfg.burst_kb * 1024.0;
+    g_net.tokens = g_net.burst_bytes;
+    g_net.t0_ms = g_net.last_refill_ms = now_ms_mono();
+    g_net.rng = cfg->seed ? cfg->seed : 1;
+    g_net.enabled = 1;
+    printf("[info] netem: rate=%s%.1f Mbit/s, rtt=%.1f ms, jitter=%.1f ms, loss=%.4f, seed=%u\n",
+           g_net.steps ? "trace, fallback " : "", cfg->rate_mbps, cfg->rtt_ms, cfg->jitter_ms,
+           cfg->loss, g_net.rng);
+    return 0;
+}
+
+int netem_enabled(void) {
+    return g_net.enabled;
+}
+
+void netem_on_bytes(NetEmTransfer* t, size_t n) {
+    if (!g_net.enabled || !t) return;
+    double delay = 0.0;
+
+    pthread_mutex_lock(&g_net.lock);
+    // time to first byte: request/response round trip
+    if (!t->started) {
+        t->started = 1;
+        delay += g_net.cfg.rtt_ms;
+        if (g_net.cfg.jitter_ms > 0) delay += g_net.cfg.jitter_ms * (2.0 * rand_unit() - 1.0);
+        if (delay < 0) delay = 0;
+    }
+    // losses: one draw per full packet, each loss stalls delivery for a retransmit RTT
+    if (g_net.cfg.loss > 0) {
+        t->loss_carry += n;
+        while (t->loss_carry >= (size_t)g_net.cfg.mss) {
+            t->loss_carry -= (size_t)g_net.cfg.mss;
+            if (rand_unit() < g_net.cfg.loss) {
+                g_net.lost_packets++;
+                delay += g_net.cfg.rtt_ms > 0 ? g_net.cfg.rtt_ms : 1.0;
+            }
+        }
+    }
+    g_net.delay_ms += delay;
+    g_net.bytes += (double)n;
+    pthread_mutex_unlock(&g_net.lock);
+
+    sleep_ms(delay);
+
+    int shaping = g_net.steps != NULL || g_net.rate_Bps > 0;
+    if (!shaping) return;
+
+    // token bucket: take n bytes (may go negative), then wait until the debt is repaid
+    double start = now_ms_mono();
+    pthread_mutex_lock(&g_net.lock);
+    refill(start);
+    g_net.tokens -= (double)n;
+    for (;;) {
+        double now = now_ms_mono();
+        refill(now);
+        if (g_net.tokens >= 0) break;
+        double rate = current_rate(now);
+        double wait = rate > 0 ? -g_net.tokens * 1000.0 / rate : NETEM_MAX_SLEEP_MS;
+        if (wait > NETEM_MAX_SLEEP_MS) wait = NETEM_MAX_SLEEP_MS;
+        pthread_mutex_unlock(&g_net.lock);
+        sleep_ms(wait);
+        pthread_mutex_lock(&g_net.lock);
+    }
+    g_net.shaped_ms += now_ms_mono() - start;
+    pthread_mutex_unlock(&g_net.lock);
+}
+
+void netem_report(void) {
+    if (!g_net.enabled) return;
+    pthread_mutex_lock(&g_net.lock);
+    printf("[info] netem: %.1f MB delivered, %ld packets lost, %.1f ms latency/loss delay, %.1f ms rate shaping\n",
+           g_net.bytes / 1e6, g_net.lost_packets, g_net.delay_ms, g_net.shaped_ms);
+    pthread_mutex_unlock(&g_net.lock);
+}
+
+void netem_shutdown(void) {
+    free(g_net.steps);
+    g_net.steps = NULL;
+    g_net.n_steps = 0;
+    g_net.enabled = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef NETEM_H
+#define NETEM_H
+
+#include <stddef.h>
+
+// In-process network emulation for the downloader (replaces tc shaping on the server).
+// Applied from the curl write callback: the callback sleeps, curl stops reading the socket,
+// and TCP backpressure throttles the sender.
+typedef struct {
+    double rate_mbps;      // token bucket rate shared by all transfers (0 = unlimited unless a trace is set)
+    double burst_kb;       // bucket depth, default 64 KB
+    double rtt_ms;         // added before the first byte of every transfer
+    double jitter_ms;      // uniform +/- jitter on that delay
+    double loss;           // per-packet loss probability; each loss costs one RTT (fast retransmit)
+    int mss;               // packet size used for loss draws, default 1448
+    const char* trace;     // optional bandwidth trace: "<time_s> <Mbit/s>" per line, looped
+    unsigned seed;         // RNG seed for jitter/loss (reproducible runs)
+} NetEmConfig;
+
+// Enable emulation. Returns 0 on success, -1 if the trace cannot be loaded.
+int netem_configure(const NetEmConfig* cfg);
+int netem_enabled(void);
+
+// Per-transfer state owned by the downloader's write context
+typedef struct {
+    int started;           // first byte delay applied
+    size_t loss_carry;     // bytes not yet covered by a loss draw
+} NetEmTransfer;
+
+// Call from the write callback before accepting n bytes (blocks to enforce delay/rate/loss).
+void netem_on_bytes(NetEmTransfer* t, size_t n);
+
+// Print totals (bytes shaped, packets lost, delay added) and release the trace.
+void netem_report(void);
+void netem_shutdown(void);
+
+#endif
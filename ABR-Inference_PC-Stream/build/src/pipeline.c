@@ -0,0 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "telemetry.h"
+#include "utils.h"
+
+typedef struct {
+    PipelineStageDef def;
+    Pipeline* p;
+    int idx;
+    DownloadQueue* in;
+    pthread_t* threads;
+    int started;            // worker threads created
+    int n_init;             // workers that took their index (under p->lock)
+    int active;             // workers still running (under p->lock)
+    // reorder (def.ordered): frames that arrived ahead of next_seq, slot = seq % pending_cap
+    pthread_mutex_t order_lock;
+    Frame** pending;
+    int pending_cap;
+    int n_pending;
+    long next_seq;
+} PipeStage;
+
+struct Pipeline {
+    PipelineSource src;
+    PipeStage stages[PIPELINE_MAX_STAGES];
+    int n;
+    pthread_t src_thread;
+    int src_started;
+    pthread_mutex_t lock;
+    int stop;
+    long delivered;         // frames taken by the sink
+};
+
+Pipeline* pipeline_create(const PipelineSource* src) {
+    if (!src || !src->next) return NULL;
+    Pipeline* p = calloc(1, sizeof(Pipeline));
+    if (!p) return NULL;
+    p->src = *src;
+    pthread_mutex_init(&p->lock, NULL);
+    return p;
+}
+
+int pipeline_add_stage(Pipeline* p, const PipelineStageDef* def) {
+    if (!p || !def || !def->run || p->n >= PIPELINE_MAX_STAGES) return -1;
+    PipeStage* s = &p->stages[p->n];
+    memset(s, 0, sizeof(*s));
+    s->def = *def;
+    if (s->def.workers < 1) s->def.workers = 1;
+    if (s->def.queue < 1) s->def.queue = 1;
+    s->p = p;
+    s->idx = p->n;
+    // one thread on each side gets the cheaper SPSC ring; producers into an ordered stage push
+    // one at a time under its reorder lock, so they count as one
+    int one_producer = p->n == 0 || p->stages[p->n - 1].def.workers == 1 || s->def.ordered;
+    s->in = s->def.workers == 1 && one_producer ? download_queue_init_spsc(s->def.queue)
+                                                : download_queue_init(s->def.queue);
+    if (!s->in) return -1;
+    pthread_mutex_init(&s->order_lock, NULL);
+    return p->n++;
+}
+
+static void push_end_markers(PipeStage* s) {
+    for (int k = 0; k < s->def.workers; k++) {
+        Frame* end = calloc(1, sizeof(Frame));
+        end->index = -1;
+        download_queue_push(s->in, end);
+    }
+}
+
+// Park a frame that overtook the next expected one. Caller holds order_lock.
+static void park_frame(PipeStage* s, Frame* f) {
+    long ahead = f->seq - s->next_seq;
+    if (ahead >= s->pending_cap) {
+        int cap = s->pending_cap ? s->pending_cap : 8;
+        while (cap <= ahead) cap *= 2;
+        Frame** slots = calloc(cap, sizeof(Frame*));
+        for (int k = 0; k < s->pending_cap; k++) {
+            Frame* g = s->pending[k];
+            if (g) slots[g->seq % cap] = g;
+        }
+        free(s->pending);
+        s->pending = slots;
+        s->pending_cap = cap;
+    }
+    s->pending[f->seq % s->pending_cap] = f;
+    s->n_pending++;
+}
+
+// Hand a frame to stage s. Ordered stages queue frames in seq order; the push blocks while the
+// queue is full, which holds back every producer of the stage (backpressure).
+static void deliver(PipeStage* s, Frame* f) {
+    if (!s->def.ordered) {
+        download_queue_push(s->in, f);
+        return;
+    }
+    pthread_mutex_lock(&s->order_lock);
+    if (f->seq != s->next_seq) {
+        park_frame(s, f);
+        pthread_mutex_unlock(&s->order_lock);
+        return;
+    }
+    for (;;) {
+        download_queue_push(s->in, f);
+        s->next_seq++;
+        if (s->n_pending == 0) break;
+        Frame** slot = &s->pending[s->next_seq % s->pending_cap];
+        if (!*slot || (*slot)->seq != s->next_seq) break;
+        f = *slot;
+        *slot = NULL;
+        s->n_pending--;
+    }
+    pthread_mutex_unlock(&s->order_lock);
+}
+
+// End of stream for stage s: every frame for it has been delivered. Anything still parked
+// means a seq was lost upstream; pass those on in order rather than dropping them.
+static void finish_input(PipeStage* s) {
+    pthread_mutex_lock(&s->order_lock);
+    if (s->n_pending > 0) {
+        fprintf(stderr, "[warn] pipeline: stage %s missing frame seq %ld, releasing %d held frames\n",
+                s->def.name, s->next_seq, s->n_pending);
+        while (s->n_pending > 0) {
+            Frame** slot = &s->pending[s->next_seq % s->pending_cap];
+            if (*slot && (*slot)->seq == s->next_seq) {
+                download_queue_push(s->in, *slot);
+                *slot = NULL;
+                s->n_pending--;
+            }
+            s->next_seq++;
+        }
+    }
+    pthread_mutex_unlock(&s->order_lock);
+    push_end_markers(s);
+}
+
+static void* source_thread(void* arg) {
+    Pipeline* p = (Pipeline*)arg;
+    const PipelineSource* src = &p->src;
+    PipeStage* first = &p->stages[0];
+    if (src->thread_init) src->thread_init(src->stage, 0);
+    for (long seq = 0; ; seq++) {
+        pthread_mutex_lock(&p->lock);
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop) break;
+        double busy = 0.0;
+        Frame* f = src->next(src->user, &busy);
+        if (!f) break;
+        f->seq = seq;
+        telemetry_busy(src->stage, busy);
+        // the source is the only producer of the first queue, so frames enter it in seq order
+        while (src->idle && download_queue_try_push(first->in, f) != 0) {
+            double t_idle = now_ms_mono();
+            if (src->idle(src->user) != 0) {
+                download_queue_push(first->in, f);
+                break;
+            }
+            telemetry_busy(src->stage, now_ms_mono() - t_idle);
+        }
+        if (!src->idle) download_queue_push(first->in, f);
+        if (src->queued) src->queued(src->user);
+    }
+    if (src->done) src->done(src->user);
+    finish_input(first);
+    return NULL;
+}
+
+static void* stage_worker(void* arg) {
+    PipeStage* s = (PipeStage*)arg;
+    Pipeline* p = s->p;
+    PipeStage* next = s->idx + 1 < p->n ? &p->stages[s->idx + 1] : NULL;
+    if (s->def.thread_init) {
+        pthread_mutex_lock(&p->lock);
+        int worker = s->n_init++;
+        pthread_mutex_unlock(&p->lock);
+        s->def.thread_init(s->def.stage, worker);
+    }
+    for (;;) {
+        Frame* f = download_queue_pop(s->in);
+        if (!f) continue;
+        if (f->index < 0) { // end of stream
+            free(f);
+            break;
+        }
+        telemetry_busy(s->def.stage, s->def.run(s->def.user, f));
+        if (next) {
+            deliver(next, f);
+        } else {
+            pthread_mutex_lock(&p->lock);
+            p->delivered++;
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    if (s->def.thread_exit) s->def.thread_exit();
+    pthread_mutex_lock(&p->lock);
+    int last = --s->active == 0;
+    pthread_mutex_unlock(&p->lock);
+    if (last && next) finish_input(next);
+    return NULL;
+}
+
+int pipeline_start(Pipeline* p) {
+    if (!p || p->n == 0) return -1;
+    for (int k = 0; k < p->n; k++) {
+        PipeStage* s = &p->stages[k];
+        int producer = k == 0 ? p->src.stage : p->stages[k - 1].def.stage;
+        download_queue_set_stages(s->in, producer, s->def.stage);
+        if (s->def.stage >= 0) telemetry_set_threads((PipelineStage)s->def.stage, s->def.workers);
+        s->threads = calloc(s->def.workers, sizeof(pthread_t));
+        s->active = s->def.workers;
+    }
+    // sink first: if a thread cannot be created, everything downstream of it is already running
+    // and the end of stream can be started at the stage that failed
+    for (int k = p->n - 1; k >= 0; k--) {
+        PipeStage* s = &p->stages[k];
+        for (int w = 0; w < s->def.workers; w++) {
+            if (pthread_create(&s->threads[w], NULL, stage_worker, s) != 0) {
+                fprintf(stderr, "[error] pipeline: cannot start %s worker %d\n", s->def.name, w);
+                s->def.workers = w;
+                s->active = w;
+                int from = w > 0 ? k : k + 1;
+                if (from < p->n) finish_input(&p->stages[from]);
+                pipeline_join(p);
+                return -1;
+            }
+            s->started++;
+        }
+    }
+    if (pthread_create(&p->src_thread, NULL, source_thread, p) != 0) {
+        fprintf(stderr, "[error] pipeline: cannot start the source\n");
+        finish_input(&p->stages[0]);
+        pipeline_join(p);
+        return -1;
+    }
+    p->src_started = 1;
+    return 0;
+}
+
+int pipeline_queued(Pipeline* p, int stage) {
+    if (!p || stage < 0 || stage >= p->n) return 0;
+    return download_queue_count(p->stages[stage].in);
+}
+
+void pipeline_stop(Pipeline* p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_mutex_unlock(&p->lock);
+}
+
+long pipeline_join(Pipeline* p) {
+    if (!p) return 0;
+    if (p->src_started) {
+        pthread_join(p->src_thread, NULL);
+        p->src_started = 0;
+    }
+    for (int k = 0; k < p->n; k++) {
+        PipeStage* s = &p->stages[k];
+        for (int w = 0; w < s->started; w++) pthread_join(s->threads[w], NULL);
+        s->started = 0;
+    }
+    pthread_mutex_lock(&p->lock);
+    long n = p->delivered;
+    pthread_mutex_unlock(&p->lock);
+    return n;
+}
+
+void pipeline_free(Pipeline* p) {
+    if (!p) return;
+    for (int k = 0; k < p->n; k++) {
+        PipeStage* s = &p->stages[k];
+        Frame* f;
+        while ((f = download_queue_try_pop(s->in)) != NULL) free(f); // leftover end markers
+        download_queue_free(s->in);
+        free(s->threads);
+        free(s->pending);
+        pthread_mutex_destroy(&s->order_lock);
+    }
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
@@ -0,0 +1,68 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <glib.h>
+#include "download_queue.h"
+
+// Stage graph for the client: a source thread produces frames and a chain of stages processes
+// them. Each stage has its own bounded input queue (DownloadQueue) and a configurable number of
+// worker threads; a full queue blocks the stage feeding it, so backpressure reaches the source.
+// The source numbers frames (Frame.seq); an ordered stage takes its input strictly in that
+// order, holding back frames that overtook each other in a multi-worker stage before it.
+// Frames are never dropped between stages: a stage that cannot process one marks it
+// (e.g. skipped, buffer NULL) and passes it on. The last stage is the sink and owns the frames
+// it receives. End of stream (the source returning NULL or pipeline_stop()) travels as
+// index -1 markers: a stage forwards them once its last worker has finished, so every frame
+// produced before the end reaches the sink.
+
+#define PIPELINE_MAX_STAGES 8
+
+typedef struct {
+    int stage;      // telemetry stage (PipelineStage) or STAGE_NONE
+    // Next frame (seq is filled in by the pipeline) or NULL at end of stream.
+    // *busy_ms = time spent producing it (excluding e.g. waiting for a live frame).
+    Frame* (*next)(void* user, double* busy_ms);
+    // Optional: called while the first queue is full. Return 0 after doing useful work
+    // (the push is retried), -1 to block until there is room.
+    int (*idle)(void* user);
+    // Optional: called after each frame is queued; it may already be in use downstream.
+    void (*queued)(void* user);
+    // Optional: called on the source thread before it exits.
+    void (*done)(void* user);
+    void* user;
+    // Optional: called first on the source thread with (stage, 0), e.g. to pin it to CPUs.
+    void (*thread_init)(int stage, int worker);
+} PipelineSource;
+
+typedef struct {
+    const char* name;
+    int stage;      // telemetry stage (PipelineStage) or STAGE_NONE
+    int workers;    // threads running the stage (>= 1)
+    int queue;      // capacity of the stage's input queue (>= 1)
+    int ordered;    // take input in seq order (needed after a stage with workers > 1; the
+                    // first stage always does, the source is its only producer)
+    // Process one frame; returns the stage's busy time for it in ms. A sink must free the frame.
+    double (*run)(void* user, Frame* frame);
+    // Optional: called on each worker thread before it exits (per-thread cleanup).
+    void (*thread_exit)(void);
+    void* user;
+    // Optional: called first on each worker thread with (stage, worker index 0..workers-1).
+    void (*thread_init)(int stage, int worker);
+} PipelineStageDef;
+
+typedef struct Pipeline Pipeline;
+
+Pipeline* pipeline_create(const PipelineSource* src);
+// Append a stage; the last one added is the sink. Returns its index or -1.
+int pipeline_add_stage(Pipeline* p, const PipelineStageDef* def);
+// Start the source and all workers. Returns 0 on success, -1 on error (nothing left running).
+int pipeline_start(Pipeline* p);
+// Frames waiting in a stage's input queue.
+int pipeline_queued(Pipeline* p, int stage);
+// Ask the source to end the stream; frames already produced still reach the sink.
+void pipeline_stop(Pipeline* p);
+// Wait until the end of stream has passed the sink. Returns the number of frames the sink took.
+long pipeline_join(Pipeline* p);
+void pipeline_free(Pipeline* p);
+
+#endif // PIPELINE_H
@@ -6,6 +6,34 @@
 #include "utils.h"
 #include "logger.h"
 
+void player_clock_init(PlayerClock* c, int fps) {
+    pthread_mutex_init(&c->lock, NULL);
+    c->started = 0;
+    c->start_ms = 0.0;
+    c->frame_interval_ms = 1000.0 / (double)(fps > 0 ? fps : 1);
+}
+
+void player_clock_destroy(PlayerClock* c) {
+    pthread_mutex_destroy(&c->lock);
+}
+
+double player_clock_due_ms(PlayerClock* c, int position) {
+    if (!c) return 0.0;
+    pthread_mutex_lock(&c->lock);
+    // the player consumes position p and then sleeps until frame_deadline_ms(start, p)
+    double due = c->started ? frame_deadline_ms(c->start_ms, position - 1, c->frame_interval_ms) : 0.0;
+    pthread_mutex_unlock(&c->lock);
+    return due;
+}
+
+static void clock_set_start(PlayerClock* c, double start_ms) {
+    if (!c) return;
+    pthread_mutex_lock(&c->lock);
+    c->start_ms = start_ms;
+    c->started = 1;
+    pthread_mutex_unlock(&c->lock);
+}
+
 void* simulate_player(void* arg) {
     struct PlayerArgs* pa = (struct PlayerArgs*)arg;
     if (!pa) {
@@ -15,7 +43,6 @@ void* simulate_player(void* arg) {
     Buffer* b     = pa->buffer;
     int fps       = pa->fps;
     Logger* log   = pa->logger;
-    int total     = pa->total_frames;
     if (!b) {
         fprintf(stderr, "[error] simulate_player: Buffer pointer is NULL\n");
         return NULL;
@@ -31,7 +58,8 @@ void* simulate_player(void* arg) {
 
     // Initial buffer fill threshold = max_frames
     int threshold = b->max_frames;
-    while (b->count < threshold) {
+    // (total_frames may shrink when the stream ends early; never wait for more than that)
+    while (b->count < threshold && b->count < atomic_load(&pa->total_frames)) {
         struct timespec ts = {0, 1000000}; // 1 ms
         nanosleep(&ts, NULL);
         logger_add_player_event(log, "waiting_for_initial_buffer",0, b->count);
@@ -39,10 +67,11 @@ void* simulate_player(void* arg) {
 
     double start_ms = now_ms_mono();
     const double frame_interval_ms = 1000.0 / (double)fps;
+    clock_set_start(pa->clock, start_ms);
     logger_add_player_event(log, "playback_start",0, b->count);
 
     // Playback loop
-    while (played_frames < total) {
+    while (played_frames < atomic_load(&pa->total_frames)) {
         if (b->count == 0) {
             // Stall
             if (!in_stall) {
@@ -67,6 +96,7 @@ void* simulate_player(void* arg) {
             // New start_ms is chosen so the next deadline becomes "now + frame_interval_ms".
             double now = now_ms_mono();
             start_ms = now - ((double)played_frames * frame_interval_ms);
+            clock_set_start(pa->clock, start_ms);
         }
 
         // Consume a frame
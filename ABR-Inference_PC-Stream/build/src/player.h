@@ -1,14 +1,33 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include "buffer.h"
 #include "logger.h"
 
+// Playback timeline published by the player for deadline-aware downloading.
+// Frames are consumed in buffer order; the frame at play position p (0-based) is due at
+// start_ms + p * frame_interval_ms. start_ms is rebased after every stall, as the player does.
+typedef struct {
+    pthread_mutex_t lock;
+    int started;              // 0 during the initial buffer fill (no deadlines yet)
+    double start_ms;
+    double frame_interval_ms;
+} PlayerClock;
+
+void player_clock_init(PlayerClock* c, int fps);
+void player_clock_destroy(PlayerClock* c);
+
+// Monotonic time at which play position p is consumed, or 0 before playback starts.
+double player_clock_due_ms(PlayerClock* c, int position);
+
 struct PlayerArgs {
     Buffer* buffer;
     int fps;
     Logger* logger;
-    int total_frames;
+    atomic_int total_frames; // re-read every loop: main lowers it when the stream ends early
+    PlayerClock* clock; // optional, updated on playback start and stall recovery
 };
 
 // Thread entrypoint
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "prefetch.h"
+#include "framepool.h"
+
+Prefetcher* prefetch_init(int window) {
+    if (window <= 0) return NULL;
+    Prefetcher* p = calloc(1, sizeof(Prefetcher));
+    if (!p) return NULL;
+    p->slots = calloc((size_t)window, sizeof(PrefetchEntry));
+    if (!p->slots) { free(p); return NULL; }
+    p->window = window;
+    return p;
+}
+
+static void drop_slot(Prefetcher* p, int k, int wasted) {
+    if (wasted) {
+        p->wasted++;
+        p->wasted_bytes += p->slots[k].buf ? p->slots[k].buf->len : 0;
+    }
+    if (p->slots[k].buf && wasted) frame_pool_put(p->slots[k].buf);
+    p->slots[k] = p->slots[--p->n];
+}
+
+GByteArray* prefetch_take(Prefetcher* p, int index, int rep, double* dl_ms) {
+    if (!p) return NULL;
+    GByteArray* hit = NULL;
+    for (int k = 0; k < p->n; ) {
+        PrefetchEntry* e = &p->slots[k];
+        if (e->index == index && e->rep == rep && !hit) {
+            hit = e->buf;
+            if (dl_ms) *dl_ms = e->dl_ms;
+            p->hits++;
+            drop_slot(p, k, 0);
+        } else if (e->index <= index) {
+            drop_slot(p, k, 1); // switch did not happen (or happened elsewhere)
+        } else {
+            k++;
+        }
+    }
+    return hit;
+}
+
+int prefetch_has(Prefetcher* p, int index, int rep) {
+    if (!p) return 0;
+    for (int k = 0; k < p->n; k++) {
+        if (p->slots[k].index == index && p->slots[k].rep == rep) return 1;
+    }
+    return 0;
+}
+
+int prefetch_full(Prefetcher* p) {
+    return !p || p->n >= p->window;
+}
+
+void prefetch_store(Prefetcher* p, int index, int rep, GByteArray* buf, double dl_ms) {
+    if (!p || !buf) return;
+    if (p->n >= p->window) {
+        p->wasted++;
+        p->wasted_bytes += buf->len;
+        frame_pool_put(buf);
+        return;
+    }
+    p->slots[p->n].index = index;
+    p->slots[p->n].rep = rep;
+    p->slots[p->n].buf = buf;
+    p->slots[p->n].dl_ms = dl_ms;
+    p->n++;
+    p->fetched++;
+    p->fetched_bytes += buf->len;
+}
+
+void prefetch_report(Prefetcher* p, Logger* logger) {
+    if (!p) return;
+    while (p->n > 0) drop_slot(p, p->n - 1, 1);
+    printf("[info] prefetch: %d fetched (%.1f MB), %d used, %d wasted (%.1f MB), %d cancelled\n",
+           p->fetched, p->fetched_bytes / 1e6, p->hits, p->wasted, p->wasted_bytes / 1e6, p->cancelled);
+    if (!logger) return;
+    logger->prefetch_fetched = p->fetched;
+    logger->prefetch_hits = p->hits;
+    logger->prefetch_wasted = p->wasted;
+    logger->prefetch_cancelled = p->cancelled;
+    logger->prefetch_fetched_bytes = p->fetched_bytes;
+    logger->prefetch_wasted_bytes = p->wasted_bytes;
+}
+
+void prefetch_free(Prefetcher* p) {
+    if (!p) return;
+    for (int k = 0; k < p->n; k++) {
+        if (p->slots[k].buf) frame_pool_put(p->slots[k].buf);
+    }
+    free(p->slots);
+    free(p);
+}
@@ -0,0 +1,39 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <glib.h>
+#include "logger.h"
+
+// Speculative frames of a likely next representation, fetched by the downloader thread while
+// the download queue is full (the link would otherwise sit idle). Only that thread uses it.
+typedef struct {
+    int index;
+    int rep;
+    GByteArray* buf;
+    double dl_ms;
+} PrefetchEntry;
+
+typedef struct {
+    PrefetchEntry* slots;
+    int window;            // max frames held
+    int n;
+    // totals, copied to the logger by prefetch_report()
+    int fetched, hits, wasted, cancelled;
+    size_t fetched_bytes, wasted_bytes;
+} Prefetcher;
+
+Prefetcher* prefetch_init(int window);
+
+// Take the cached (index, rep) frame, or NULL. Entries for earlier frames, and for this frame
+// at another rep, can no longer be used: they are freed and counted as wasted.
+GByteArray* prefetch_take(Prefetcher* p, int index, int rep, double* dl_ms);
+
+int prefetch_has(Prefetcher* p, int index, int rep);
+int prefetch_full(Prefetcher* p);
+void prefetch_store(Prefetcher* p, int index, int rep, GByteArray* buf, double dl_ms);
+
+// Count leftovers as wasted and copy totals to the logger.
+void prefetch_report(Prefetcher* p, Logger* logger);
+void prefetch_free(Prefetcher* p);
+
+#endif
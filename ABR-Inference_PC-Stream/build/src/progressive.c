@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "progressive.h"
+#include "downloader.h"
+#include "decryptor.h"
+#include "framepool.h"
+
+#define PROGRESSIVE_PROBE_BYTES 4096     // first request; PLY headers are a few hundred bytes
+#define PROGRESSIVE_MAX_HEADER  65536
+#define PROGRESSIVE_LEN_FIELDS  64       // covers the trailer marker and its length fields
+
+static ProgressiveFrame* progressive_alloc(GByteArray* buf) {
+    ProgressiveFrame* pf = calloc(1, sizeof(ProgressiveFrame));
+    if (!pf) return NULL;
+    pf->buffer = buf;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->arrived, NULL);
+    return pf;
+}
+
+// Absolute offset of [cph_len][cph] in the first len bytes of buf: 0 ok, 1 need more, -1 bad
+static int locate_cph(GByteArray* buf, size_t len, size_t* cph_off) {
+    size_t trailer_off = 0, rel = 0;
+    int rc = decryptor_locate_trailer(buf->data, len, NULL, &trailer_off);
+    if (rc != 0) return rc;
+    if (trailer_off >= len) return 1;
+    rc = decryptor_locate_cph(buf->data + trailer_off, len - trailer_off, &rel);
+    if (rc != 0) return rc;
+    *cph_off = trailer_off + rel;
+    return 0;
+}
+
+// Fetch [first, last] (last = DOWNLOAD_TO_END for the rest). Returns 0 or an error.
+static int fetch(const char* url, size_t first, size_t last, GByteArray* buf, size_t* total, double* dl_ms) {
+    double ms = 0.0;
+    int rc = download_range_mem(url, first, last, buf, total, &ms);
+    *dl_ms += ms;
+    if (rc != 0 && rc != DOWNLOAD_FULL_BODY) {
+        fprintf(stderr, "[warn] progressive: range %zu- failed (rc=%d) for %s\n", first, rc, url);
+    }
+    return rc;
+}
+
+// Finish the head of a .vvs frame whose ciphertext field [cph_off, cph_end) the prologue in the
+// first have bytes gave. The ciphertext follows the PLY header, so everything after it is bulk.
+static ProgressiveFrame* vvs_head(const char* url, GByteArray* buf, size_t have, size_t total,
+                                  size_t cph_off, size_t cph_end, size_t size, double dl_ms) {
+    if (size != total || cph_end > total || cph_end <= cph_off) {
+        fprintf(stderr, "[warn] progressive: .vvs prologue does not match %s\n", url);
+        return NULL;
+    }
+    g_byte_array_set_size(buf, (guint)total);
+    if (cph_end > have && fetch(url, have, cph_end - 1, buf, NULL, &dl_ms) != 0) return NULL;
+
+    ProgressiveFrame* pf = progressive_alloc(buf);
+    if (!pf) return NULL;
+    pf->cph_off = cph_off;
+    pf->cph_end = cph_end;
+    pf->bulk_off = have > cph_end ? have : cph_end;
+    pf->bulk_end = total;
+    pf->dl_ms = dl_ms;
+    pf->done = pf->bulk_off >= pf->bulk_end;
+    return pf;
+}
+
+ProgressiveFrame* progressive_fetch_head(const char* url, int size_class) {
+    GByteArray* buf = frame_pool_get(size_class, 0);
+    size_t total = 0, have = 0, trailer_off = 0, cph_off = 0;
+    double dl_ms = 0.0;
+    ProgressiveFrame* pf = NULL;
+
+    // header: grow the probe until end_header is in
+    for (size_t probe = PROGRESSIVE_PROBE_BYTES; ; probe *= 2) {
+        int rc = fetch(url, have, probe - 1, buf, &total, &dl_ms);
+        if (rc == DOWNLOAD_FULL_BODY) {
+            // no Range support: the whole frame is already here
+            pf = progressive_alloc(buf);
+            if (!pf) goto fail;
+            size_t size = 0;
+            if (decryptor_vvs_locate_cph(buf->data, buf->len, &pf->cph_off, &pf->cph_end, &size) != 0) {
+                pf->cph_end = buf->len;
+                if (locate_cph(buf, buf->len, &pf->cph_off) != 0) pf->cph_off = 0;
+            }
+            if (pf->cph_off >= buf->len || pf->cph_end > buf->len) pf->cph_off = 0;
+            pf->bulk_off = pf->bulk_end = buf->len;
+            pf->dl_ms = dl_ms;
+            pf->done = 1;
+            return pf;
+        }
+        if (rc != 0) goto fail;
+        have = buf->len;
+        size_t cph_end = 0, size = 0;
+        if (decryptor_vvs_locate_cph(buf->data, have, &cph_off, &cph_end, &size) == 0) {
+            pf = vvs_head(url, buf, have, total, cph_off, cph_end, size, dl_ms);
+            if (!pf) goto fail;
+            return pf;
+        }
+        rc = decryptor_locate_trailer(buf->data, have, NULL, &trailer_off);
+        if (rc == 0) break;
+        if (rc < 0 || have >= total || probe >= PROGRESSIVE_MAX_HEADER) {
+            fprintf(stderr, "[warn] progressive: no .ply.cpabe header in the first %zu bytes of %s\n", have, url);
+            goto fail;
+        }
+    }
+    if (trailer_off >= total) goto fail;
+    g_byte_array_set_size(buf, (guint)total);
+
+    // trailer length fields (already in the probe when the vertex rows are fully encrypted)
+    if (locate_cph(buf, have, &cph_off) != 0) {
+        size_t last = trailer_off + PROGRESSIVE_LEN_FIELDS - 1;
+        if (last >= total) last = total - 1;
+        if (fetch(url, trailer_off, last, buf, NULL, &dl_ms) != 0) goto fail;
+        if (locate_cph(buf, last + 1, &cph_off) != 0) {
+            fprintf(stderr, "[warn] progressive: bad trailer in %s\n", url);
+            goto fail;
+        }
+    }
+    if (cph_off >= total) goto fail;
+
+    // CP-ABE ciphertext: a few KB at the end of the file
+    if (cph_off >= have && fetch(url, cph_off, DOWNLOAD_TO_END, buf, NULL, &dl_ms) != 0) goto fail;
+
+    pf = progressive_alloc(buf);
+    if (!pf) goto fail;
+    pf->cph_off = cph_off;
+    pf->cph_end = total;
+    pf->bulk_off = have < cph_off ? have : cph_off;
+    pf->bulk_end = cph_off;
+    pf->dl_ms = dl_ms;
+    pf->done = pf->bulk_off >= pf->bulk_end; // small frame: the probe already covered it
+    return pf;
+
+fail:
+    frame_pool_put(buf);
+    return NULL;
+}
+
+void progressive_fetch_bulk(ProgressiveFrame* pf, const char* url) {
+    if (!pf) return;
+    pthread_mutex_lock(&pf->lock);
+    int done = pf->done;
+    pthread_mutex_unlock(&pf->lock);
+    if (done) return;
+
+    double ms = 0.0;
+    int rc = fetch(url, pf->bulk_off, pf->bulk_end - 1, pf->buffer, NULL, &ms);
+    if (rc == DOWNLOAD_FULL_BODY) rc = 0; // whole file rewritten in place, same bytes
+    pthread_mutex_lock(&pf->lock);
+    pf->dl_ms += ms;
+    pf->rc = rc;
+    pf->done = 1;
+    pthread_cond_signal(&pf->arrived);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+int progressive_wait(ProgressiveFrame* pf, double* dl_ms) {
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->done) pthread_cond_wait(&pf->arrived, &pf->lock);
+    int rc = pf->rc;
+    if (dl_ms) *dl_ms = pf->dl_ms;
+    pthread_mutex_unlock(&pf->lock);
+    return rc;
+}
+
+void progressive_free(ProgressiveFrame* pf) {
+    if (!pf) return;
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->arrived);
+    free(pf);
+}
@@ -0,0 +1,42 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <pthread.h>
+#include <glib.h>
+
+// --progressive: fetch a .ply.cpabe frame out of order with HTTP Range requests on one
+// connection: the PLY header (which gives the trailer offset), the trailer's length fields,
+// the CP-ABE ciphertext at the very end, and finally the bulk in between (reduced vertex rows
+// and the AES buffer). The frame is queued as soon as the ciphertext is in, so the decrypting
+// thread runs the expensive key unwrap (bswabe_dec) while the bulk is still downloading.
+// A .vvs container needs no parsing: its prologue (in the first probe) gives the ciphertext
+// range directly, and the ciphertext sits right behind the header, so the bulk is the tail.
+typedef struct ProgressiveFrame {
+    GByteArray* buffer;      // the whole frame, sized up front; the bulk is written in place
+    size_t cph_off;          // [cph_len][cph] starts here (0 = unknown, decrypt the plain way)
+    size_t cph_end;          // and ends here: the file size for .ply.cpabe, the bulk follows in .vvs
+    size_t bulk_off;         // bytes still missing: [bulk_off, bulk_end)
+    size_t bulk_end;         // cph_off for .ply.cpabe, the file size for .vvs
+    double dl_ms;            // requests so far; all of them once done
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    int done;
+    int rc;                  // 0, or the error of the bulk request
+} ProgressiveFrame;
+
+// Fetch the header and the ciphertext. NULL if the server or the frame does not allow it;
+// the caller then falls back to a plain GET. The buffer comes from the frame pool (size_class =
+// representation) and goes back with frame_pool_put() like any downloaded frame.
+ProgressiveFrame* progressive_fetch_head(const char* url, int size_class);
+
+// Fetch the bulk into pf->buffer and wake progressive_wait(). pf must not be touched after
+// this returns: the waiting thread owns it from then on.
+void progressive_fetch_bulk(ProgressiveFrame* pf, const char* url);
+
+// Block until the bulk is in. Returns 0 or the download error; *dl_ms gets the total download time.
+int progressive_wait(ProgressiveFrame* pf, double* dl_ms);
+
+// Free the tracking state (not the buffer, which belongs to the Frame).
+void progressive_free(ProgressiveFrame* pf);
+
+#endif
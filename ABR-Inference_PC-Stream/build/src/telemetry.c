@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "telemetry.h"
+#include "utils.h"
+
+// wait histogram buckets: < 0.1, < 1, < 10, < 100, < 1000, >= 1000 ms
+#define WAIT_BUCKETS 6
+static const double k_wait_edges[WAIT_BUCKETS - 1] = { 0.1, 1.0, 10.0, 100.0, 1000.0 };
+static const char* k_wait_labels[WAIT_BUCKETS] = { "<0.1", "<1", "<10", "<100", "<1000", ">=1000" };
+static const char* k_stage_names[STAGE_COUNT] = { "download", "decrypt", "inference", "buffer" };
+
+// The recording calls run on every queue push/pop, so the counters are relaxed atomics and
+// never take g_lock; times are kept in ns. A CSV period is the difference of two snapshots.
+typedef struct {
+    atomic_long n;
+    atomic_llong total_ns;
+    atomic_long hist[WAIT_BUCKETS];
+} WaitStat;
+
+typedef struct {
+    atomic_long items;
+    atomic_llong busy_ns;
+    WaitStat enq, deq;
+    atomic_long depth_n;
+    atomic_llong depth_sum;
+    atomic_int depth_max;
+    atomic_int period_depth_max;  // since the last CSV row
+} StageCounters;
+
+// Plain copy of a stage's counters, for reports and period deltas.
+typedef struct {
+    long items;
+    double busy_ms;
+    long enq_n, deq_n;
+    double enq_ms, deq_ms;
+    long enq_hist[WAIT_BUCKETS], deq_hist[WAIT_BUCKETS];
+    long depth_n;
+    long long depth_sum;
+} StageSnapshot;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;  // CSV, thread counts, start/stop
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+static atomic_int g_on = 0;
+static double g_t0 = 0.0;
+static int g_threads[STAGE_COUNT];
+static StageCounters g_count[STAGE_COUNT];
+static StageSnapshot g_last[STAGE_COUNT]; // at the last CSV row
+static double g_period_t0 = 0.0;
+// CSV
+static FILE* g_csv = NULL;
+static int g_period_ms = 0;
+static pthread_t g_thread;
+static int g_thread_started = 0;
+static int g_stop = 0;
+
+static int valid(int s) {
+    return s >= 0 && s < STAGE_COUNT;
+}
+
+static int recording(int s) {
+    return valid(s) && atomic_load_explicit(&g_on, memory_order_relaxed);
+}
+
+static void add_long(atomic_long* c, long v) {
+    atomic_fetch_add_explicit(c, v, memory_order_relaxed);
+}
+
+static void add_llong(atomic_llong* c, long long v) {
+    atomic_fetch_add_explicit(c, v, memory_order_relaxed);
+}
+
+static void raise_max(atomic_int* m, int v) {
+    int cur = atomic_load_explicit(m, memory_order_relaxed);
+    while (v > cur && !atomic_compare_exchange_weak_explicit(m, &cur, v, memory_order_relaxed,
+                                                             memory_order_relaxed)) {}
+}
+
+static void wait_add(WaitStat* w, double ms) {
+    int b = 0;
+    while (b < WAIT_BUCKETS - 1 && ms >= k_wait_edges[b]) b++;
+    add_long(&w->n, 1);
+    add_llong(&w->total_ns, (long long)(ms * 1e6));
+    add_long(&w->hist[b], 1);
+}
+
+static void snapshot(int s, StageSnapshot* out) {
+    const StageCounters* c = &g_count[s];
+    out->items = atomic_load_explicit(&c->items, memory_order_relaxed);
+    out->busy_ms = atomic_load_explicit(&c->busy_ns, memory_order_relaxed) / 1e6;
+    out->enq_n = atomic_load_explicit(&c->enq.n, memory_order_relaxed);
+    out->deq_n = atomic_load_explicit(&c->deq.n, memory_order_relaxed);
+    out->enq_ms = atomic_load_explicit(&c->enq.total_ns, memory_order_relaxed) / 1e6;
+    out->deq_ms = atomic_load_explicit(&c->deq.total_ns, memory_order_relaxed) / 1e6;
+    for (int b = 0; b < WAIT_BUCKETS; b++) {
+        out->enq_hist[b] = atomic_load_explicit(&c->enq.hist[b], memory_order_relaxed);
+        out->deq_hist[b] = atomic_load_explicit(&c->deq.hist[b], memory_order_relaxed);
+    }
+    out->depth_n = atomic_load_explicit(&c->depth_n, memory_order_relaxed);
+    out->depth_sum = atomic_load_explicit(&c->depth_sum, memory_order_relaxed);
+}
+
+// Write one row per stage with the counters of the period that just ended. Caller holds g_lock.
+static void write_rows_locked(double now) {
+    double len = now - g_period_t0;
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        StageSnapshot cur, *last = &g_last[s];
+        snapshot(s, &cur);
+        int depth_max = atomic_exchange_explicit(&g_count[s].period_depth_max, 0, memory_order_relaxed);
+        long items = cur.items - last->items;
+        double busy_ms = cur.busy_ms - last->busy_ms;
+        long depth_n = cur.depth_n - last->depth_n;
+        int threads = g_threads[s];
+        double util = len > 0.0 ? busy_ms / (len * threads) : 0.0;
+        fprintf(g_csv, "%.1f,%s,%d,%ld,%.3f,%.3f,%ld,%.3f,%ld,%.3f,%.2f,%d\n",
+                now - g_t0, k_stage_names[s], threads, items, busy_ms, util,
+                cur.enq_n - last->enq_n, cur.enq_ms - last->enq_ms,
+                cur.deq_n - last->deq_n, cur.deq_ms - last->deq_ms,
+                depth_n ? (double)(cur.depth_sum - last->depth_sum) / depth_n : 0.0, depth_max);
+        *last = cur;
+    }
+    fflush(g_csv);
+    g_period_t0 = now;
+}
+
+static void* csv_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_lock);
+    while (!g_stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += g_period_ms / 1000;
+        ts.tv_nsec += (long)(g_period_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        int rc = 0;
+        while (!g_stop && rc != ETIMEDOUT) rc = pthread_cond_timedwait(&g_wake, &g_lock, &ts);
+        if (g_stop) break;
+        write_rows_locked(now_ms_mono());
+    }
+    pthread_mutex_unlock(&g_lock);
+    return NULL;
+}
+
+int telemetry_start(const char* csv_path, int period_ms) {
+    pthread_mutex_lock(&g_lock);
+    // before any stage thread runs, so plain resets are fine
+    memset(g_count, 0, sizeof(g_count));
+    memset(g_last, 0, sizeof(g_last));
+    for (int s = 0; s < STAGE_COUNT; s++) g_threads[s] = 1;
+    g_t0 = g_period_t0 = now_ms_mono();
+    atomic_store(&g_on, 1);
+    g_stop = 0;
+    int rc = 0;
+    if (csv_path && period_ms > 0) {
+        g_csv = fopen(csv_path, "w");
+        if (!g_csv) {
+            fprintf(stderr, "[warn] telemetry: cannot write %s\n", csv_path);
+            rc = -1;
+        } else {
+            fprintf(g_csv, "time_ms,stage,threads,items,busy_ms,utilization,enq_waits,enq_wait_ms,"
+                           "deq_waits,deq_wait_ms,depth_mean,depth_max\n");
+            g_period_ms = period_ms;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (g_csv && pthread_create(&g_thread, NULL, csv_thread, NULL) == 0) g_thread_started = 1;
+    return rc;
+}
+
+void telemetry_set_threads(PipelineStage s, int n) {
+    if (!valid(s)) return;
+    pthread_mutex_lock(&g_lock);
+    g_threads[s] = n > 0 ? n : 1;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void telemetry_busy(int stage, double ms) {
+    if (!recording(stage)) return;
+    add_llong(&g_count[stage].busy_ns, (long long)(ms * 1e6));
+    add_long(&g_count[stage].items, 1);
+}
+
+void telemetry_enqueue_wait(int stage, double ms) {
+    if (!recording(stage)) return;
+    wait_add(&g_count[stage].enq, ms);
+}
+
+void telemetry_dequeue_wait(int stage, double ms) {
+    if (!recording(stage)) return;
+    wait_add(&g_count[stage].deq, ms);
+}
+
+void telemetry_depth(int stage, int depth) {
+    if (!recording(stage)) return;
+    StageCounters* c = &g_count[stage];
+    add_long(&c->depth_n, 1);
+    add_llong(&c->depth_sum, depth);
+    raise_max(&c->depth_max, depth);
+    raise_max(&c->period_depth_max, depth);
+}
+
+static void print_waits(const char* name, long n, double total_ms, const long* hist) {
+    if (n == 0) return;
+    printf("         %s wait: %ld, %.1f ms total [", name, n, total_ms);
+    for (int b = 0; b < WAIT_BUCKETS; b++) {
+        printf("%s%s ms %.0f%%", b ? ", " : "", k_wait_labels[b], 100.0 * hist[b] / n);
+    }
+    printf("]\n");
+}
+
+void telemetry_report(void) {
+    pthread_mutex_lock(&g_lock);
+    if (!atomic_load(&g_on)) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    double elapsed = now_ms_mono() - g_t0;
+    printf("[info] stage telemetry over %.1f s:\n", elapsed / 1000.0);
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        StageSnapshot c;
+        snapshot(s, &c);
+        if (c.items == 0 && c.enq_n == 0 && c.deq_n == 0) continue;
+        int threads = g_threads[s];
+        double util = elapsed > 0.0 ? c.busy_ms / (elapsed * threads) : 0.0;
+        printf("  %-9s %d thread%s, %ld items, busy %.1f%% idle %.1f%% (%.2f ms/item)",
+               k_stage_names[s], threads, threads == 1 ? "" : "s", c.items,
+               100.0 * util, 100.0 * (1.0 - util), c.items ? c.busy_ms / c.items : 0.0);
+        if (c.depth_n) {
+            printf(", input queue mean %.1f max %d", (double)c.depth_sum / c.depth_n,
+                   atomic_load_explicit(&g_count[s].depth_max, memory_order_relaxed));
+        }
+        printf("\n");
+        print_waits("enqueue", c.enq_n, c.enq_ms, c.enq_hist);
+        print_waits("dequeue", c.deq_n, c.deq_ms, c.deq_hist);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+void telemetry_shutdown(void) {
+    pthread_mutex_lock(&g_lock);
+    g_stop = 1;
+    pthread_cond_broadcast(&g_wake);
+    pthread_mutex_unlock(&g_lock);
+    if (g_thread_started) pthread_join(g_thread, NULL);
+    g_thread_started = 0;
+    pthread_mutex_lock(&g_lock);
+    if (g_csv) {
+        write_rows_locked(now_ms_mono());
+        fclose(g_csv);
+        g_csv = NULL;
+    }
+    atomic_store(&g_on, 0);
+    pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,40 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Per-stage pipeline counters: how long each stage works, how long it blocks handing a frame
+// on (enqueue wait: the next stage's queue is full) or waiting for one (dequeue wait: its input
+// queue is empty), and how deep its input queue runs. Busy time is summed over the stage's
+// threads, so utilization = busy / (elapsed * threads) and idle is the rest.
+// Rows with the deltas of every period go to a CSV while the client runs; the totals and the
+// wait histograms are printed at exit. Calls before telemetry_start() are ignored.
+
+typedef enum {
+    STAGE_DOWNLOAD,
+    STAGE_DECRYPT,
+    STAGE_INFERENCE,
+    STAGE_BUFFER,      // buffering + logging; enqueue wait = waiting for the player to make room
+    STAGE_COUNT
+} PipelineStage;
+
+#define STAGE_NONE (-1) // untracked queue end
+
+// csv_path gets one row per stage every period_ms (period_ms <= 0 or NULL path: summary only).
+// Returns 0 on success, -1 if the CSV cannot be opened (counters still run).
+int telemetry_start(const char* csv_path, int period_ms);
+
+// Threads working in a stage (default 1).
+void telemetry_set_threads(PipelineStage s, int n);
+
+void telemetry_busy(int stage, double ms);
+// One wait of ms that actually blocked; a push or pop that went through at once is not a wait.
+void telemetry_enqueue_wait(int stage, double ms);
+void telemetry_dequeue_wait(int stage, double ms);
+// Depth of the stage's input queue after a push or pop.
+void telemetry_depth(int stage, int depth);
+
+// Print per-stage totals (busy/idle, waits with histograms, queue depth).
+void telemetry_report(void);
+// Stop the CSV thread (writing the last partial period) and close the file.
+void telemetry_shutdown(void);
+
+#endif
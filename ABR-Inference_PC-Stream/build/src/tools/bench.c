@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bench.h"
+
+void bench_add(BenchSamples* s, double ms) {
+    if (s->n == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        double* v = realloc(s->v, (size_t)cap * sizeof(double));
+        if (!v) return;
+        s->v = v;
+        s->cap = cap;
+    }
+    s->v[s->n++] = ms;
+}
+
+void bench_reset(BenchSamples* s) {
+    s->n = 0;
+}
+
+void bench_free(BenchSamples* s) {
+    free(s->v);
+    s->v = NULL;
+    s->n = s->cap = 0;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double rank(const double* sorted, int n, double p) {
+    int k = (int)(p * n + 0.999999); // nearest rank, 1-based
+    if (k < 1) k = 1;
+    if (k > n) k = n;
+    return sorted[k - 1];
+}
+
+BenchSummary bench_summarize(BenchSamples* s) {
+    BenchSummary r;
+    memset(&r, 0, sizeof(r));
+    if (s->n == 0) return r;
+    qsort(s->v, (size_t)s->n, sizeof(double), cmp_double);
+    double sum = 0.0;
+    for (int i = 0; i < s->n; i++) sum += s->v[i];
+    r.n = s->n;
+    r.min = s->v[0];
+    r.max = s->v[s->n - 1];
+    r.mean = sum / s->n;
+    r.p50 = rank(s->v, s->n, 0.50);
+    r.p90 = rank(s->v, s->n, 0.90);
+    r.p99 = rank(s->v, s->n, 0.99);
+    return r;
+}
+
+void bench_json_summary(FILE* f, const BenchSummary* s) {
+    fprintf(f, "{\"n\": %d, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f}",
+            s->n, s->min, s->p50, s->p90, s->p99, s->max, s->mean);
+}
+
+void bench_print_summary(const char* name, const BenchSummary* s) {
+    printf("  %-18s n=%-5d min %9.3f  p50 %9.3f  p90 %9.3f  p99 %9.3f  max %9.3f  mean %9.3f ms\n",
+           name, s->n, s->min, s->p50, s->p90, s->p99, s->max, s->mean);
+}
+
+long bench_peak_rss_kb(void) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f)) {
+            if (!strncmp(line, "VmHWM:", 6)) {
+                kb = atol(line + 6);
+                break;
+            }
+        }
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return ru.ru_maxrss; // kB on Linux
+}
+
+void bench_reset_peak_rss(void) {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f); // 5 = reset the peak RSS (VmHWM) to the current RSS
+    fclose(f);
+}
+
+void bench_timestamp(char* out, size_t n) {
+    time_t t = time(NULL);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, n, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
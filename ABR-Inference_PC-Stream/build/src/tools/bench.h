@@ -0,0 +1,41 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+// Shared helpers for the benchmark tools (bench_decrypt, bench_pipeline): timing samples,
+// percentile summaries and the JSON fragments both reports are made of.
+
+typedef struct {
+    double* v;     // samples in ms, in arrival order until summarized (then sorted)
+    int n, cap;
+} BenchSamples;
+
+typedef struct {
+    int n;
+    double min, p50, p90, p99, max, mean;
+} BenchSummary;
+
+void bench_add(BenchSamples* s, double ms);
+void bench_reset(BenchSamples* s);
+void bench_free(BenchSamples* s);
+
+// Sorts the samples. Percentiles are nearest-rank; all fields 0 when there are no samples.
+BenchSummary bench_summarize(BenchSamples* s);
+
+// {"n":..,"min":..,"p50":..,"p90":..,"p99":..,"max":..,"mean":..}
+void bench_json_summary(FILE* f, const BenchSummary* s);
+
+// One aligned text line: name, n, then the summary in ms.
+void bench_print_summary(const char* name, const BenchSummary* s);
+
+// Peak resident set size of this process in kB (VmHWM, getrusage if /proc is unavailable).
+// bench_reset_peak_rss() restarts the peak from the current RSS so it can be taken per run
+// (Linux; a no-op elsewhere).
+long bench_peak_rss_kb(void);
+void bench_reset_peak_rss(void);
+
+// UTC time as ISO 8601 for report headers.
+void bench_timestamp(char* out, size_t n);
+
+#endif
@@ -0,0 +1,334 @@
+// bench_decrypt: micro-benchmark of the CP-ABE decrypt stages on real dataset frames.
+// Gives a baseline to compare before and after a decrypt optimization.
+//
+//   bench_decrypt [--dataset <dir>] [--pub <pub_key>] [--priv <priv_key>] [--frame <n>]
+//                 [--patterns x,xyz] [--levels 12,25,50,100] [--warmup <n>] [--iters <n>]
+//                 [--json <file>] [<file.ply.cpabe> ... --pattern <p>]
+//
+// Each frame is decrypted once to get the inputs of every stage, then each stage is timed on
+// its own, iters times after warmup untimed runs:
+//   parse_cpabe_buffer -> bswabe_cph_unserialize -> bswabe_dec -> aes_128_cbc_decrypt
+//   -> restore_ply_with_coords, plus the whole chain as frame_total.
+// Stages that use the scratch arena run inside a scratch bracket, as they do in the client.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <pbc.h>
+#include "bswabe.h"
+#include "cpabe/common.h"
+#include "utils.h"
+#include "bench.h"
+
+char* pattern_arg = NULL; // read by parse_cpabe_buffer() to find the trailer
+
+enum { ST_PARSE, ST_CPH, ST_DEC, ST_AES, ST_RESTORE, ST_FRAME, N_STAGES };
+static const char* k_stage[N_STAGES] = {
+    "parse_cpabe_buffer", "cph_unserialize", "bswabe_dec", "aes_decrypt", "restore_ply", "frame_total"
+};
+
+typedef struct {
+    char path[1024];
+    char pattern[8];
+    int level;              // representation (% of points), 0 if unknown
+    GByteArray* data;
+    BenchSamples st[N_STAGES];
+} BenchFrame;
+
+static bswabe_pub_t* g_pub;
+static bswabe_prv_t* g_prv;
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s [--dataset <dir>] [--pub <pub_key>] [--priv <priv_key>] [--frame <n>]\n"
+        " [--patterns x,xyz] [--levels 12,25,50,100] [--warmup <n>] [--iters <n>] [--json <file>]\n"
+        " [<file.ply.cpabe> ... --pattern <p>]\n"
+        "Notes:\n"
+        "  [--dataset <dir>]   (PointCloud-dataset root, default is ../../PointCloud-dataset)\n"
+        "  [--pub/--priv]      (keys, default is pub_key and user_key)\n"
+        "  [--frame <n>]       (frame number in the sequence, default is 1)\n"
+        "  [--patterns]        (encrypted coordinates, one dataset sequence each, default is x,xyz)\n"
+        "  [--levels]          (representations in %% of points, default is 12,25,50,100)\n"
+        "  [--warmup <n>]      (untimed runs per stage, default is 3)\n"
+        "  [--iters <n>]       (timed runs per stage, default is 20)\n"
+        "  [--json <file>]     (machine-readable report)\n"
+        "  • Files given explicitly replace the dataset set and need --pattern.\n"
+        "  • Example: %s --iters 50 --json logs/bench_decrypt.json\n",
+        prog, prog);
+}
+
+static int load_frame(BenchFrame* f) {
+    f->data = NULL;
+    FILE* fp = fopen(f->path, "rb");
+    if (!fp) {
+        fprintf(stderr, "[warn] cannot open %s\n", f->path);
+        return -1;
+    }
+    fclose(fp);
+    f->data = suck_file(f->path);
+    return f->data ? 0 : -1;
+}
+
+static double run_parse(BenchFrame* f) {
+    GByteArray *cph = NULL, *aes = NULL;
+    int file_len = 0;
+    scratch_begin();
+    double t0 = now_ms_mono();
+    parse_cpabe_buffer(f->data, &cph, &file_len, &aes);
+    double ms = now_ms_mono() - t0;
+    scratch_end();
+    return ms;
+}
+
+static double run_cph(GByteArray* cph_buf) {
+    double t0 = now_ms_mono();
+    bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 0);
+    double ms = now_ms_mono() - t0;
+    bswabe_cph_free(cph);
+    return ms;
+}
+
+static double run_dec(bswabe_cph_t* cph) {
+    element_t m;
+    double t0 = now_ms_mono();
+    bswabe_dec(g_pub, g_prv, cph, m);
+    double ms = now_ms_mono() - t0;
+    element_clear(m);
+    return ms;
+}
+
+static double run_aes(GByteArray* aes, element_t m) {
+    scratch_begin();
+    double t0 = now_ms_mono();
+    aes_128_cbc_decrypt(aes, m);
+    double ms = now_ms_mono() - t0;
+    scratch_end();
+    return ms;
+}
+
+static double run_restore(BenchFrame* f, GByteArray* pt, EncryptPattern pat) {
+    scratch_begin();
+    double t0 = now_ms_mono();
+    restore_ply_with_coords(f->data, NULL, pt, pat);
+    double ms = now_ms_mono() - t0;
+    scratch_end();
+    return ms;
+}
+
+static double run_frame(BenchFrame* f, EncryptPattern pat) {
+    GByteArray *cph_buf = NULL, *aes = NULL;
+    int file_len = 0;
+    scratch_begin();
+    double t0 = now_ms_mono();
+    parse_cpabe_buffer(f->data, &cph_buf, &file_len, &aes);
+    bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 0);
+    element_t m;
+    bswabe_dec(g_pub, g_prv, cph, m);
+    bswabe_cph_free(cph);
+    GByteArray* pt = aes_128_cbc_decrypt(aes, m);
+    restore_ply_with_coords(f->data, NULL, pt, pat);
+    double ms = now_ms_mono() - t0;
+    element_clear(m);
+    scratch_end();
+    return ms;
+}
+
+// Decrypt once outside any bracket to get every stage's input, then time the stages.
+static int bench_frame(BenchFrame* f, int warmup, int iters) {
+    pattern_arg = f->pattern;
+    EncryptPattern pat = parse_pattern(f->pattern);
+    GByteArray *cph_buf = NULL, *aes = NULL;
+    int file_len = 0;
+    parse_cpabe_buffer(f->data, &cph_buf, &file_len, &aes);
+    bswabe_cph_t* cph = bswabe_cph_unserialize(g_pub, cph_buf, 0);
+    if (!cph) {
+        fprintf(stderr, "[warn] %s: cph unserialize failed\n", f->path);
+        g_byte_array_free(cph_buf, 1);
+        g_byte_array_free(aes, 1);
+        return -1;
+    }
+    element_t m;
+    if (!bswabe_dec(g_pub, g_prv, cph, m)) {
+        const char* err = bswabe_error();
+        fprintf(stderr, "[warn] %s: bswabe_dec failed: %s\n", f->path, err ? err : "(unknown)");
+        bswabe_cph_free(cph);
+        g_byte_array_free(cph_buf, 1);
+        g_byte_array_free(aes, 1);
+        return -1;
+    }
+    GByteArray* pt = aes_128_cbc_decrypt(aes, m);
+    GByteArray* ply = restore_ply_with_coords(f->data, NULL, pt, pat);
+    int rc = ply ? 0 : -1;
+    if (!ply) fprintf(stderr, "[warn] %s: restore failed\n", f->path);
+
+    for (int it = 0; rc == 0 && it < warmup + iters; it++) {
+        double ms[N_STAGES];
+        ms[ST_PARSE] = run_parse(f);
+        ms[ST_CPH] = run_cph(cph_buf);
+        ms[ST_DEC] = run_dec(cph);
+        ms[ST_AES] = run_aes(aes, m);
+        ms[ST_RESTORE] = run_restore(f, pt, pat);
+        ms[ST_FRAME] = run_frame(f, pat);
+        if (it < warmup) continue;
+        for (int s = 0; s < N_STAGES; s++) bench_add(&f->st[s], ms[s]);
+    }
+
+    if (ply) g_byte_array_free(ply, 1);
+    g_byte_array_free(pt, 1);
+    element_clear(m);
+    bswabe_cph_free(cph);
+    g_byte_array_free(cph_buf, 1);
+    g_byte_array_free(aes, 1);
+    return rc;
+}
+
+static void write_json(const char* file, BenchFrame* frames, int n, int warmup, int iters) {
+    FILE* f = fopen(file, "w");
+    if (!f) {
+        fprintf(stderr, "[warn] cannot write %s\n", file);
+        return;
+    }
+    char ts[32];
+    bench_timestamp(ts, sizeof(ts));
+    fprintf(f, "{\n  \"bench\": \"decrypt\",\n  \"timestamp\": \"%s\",\n", ts);
+    fprintf(f, "  \"warmup\": %d,\n  \"iters\": %d,\n  \"unit\": \"ms\",\n", warmup, iters);
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n  \"frames\": [", bench_peak_rss_kb());
+    int first = 1;
+    for (int i = 0; i < n; i++) {
+        if (!frames[i].data || frames[i].st[ST_FRAME].n == 0) continue;
+        fprintf(f, "%s\n    {\"file\": \"%s\", \"pattern\": \"%s\", \"level\": %d, \"bytes\": %u,\n",
+                first ? "" : ",", frames[i].path, frames[i].pattern, frames[i].level, frames[i].data->len);
+        fprintf(f, "     \"stages\": {");
+        for (int s = 0; s < N_STAGES; s++) {
+            BenchSummary sum = bench_summarize(&frames[i].st[s]);
+            fprintf(f, "%s\n       \"%s\": ", s ? "," : "", k_stage[s]);
+            bench_json_summary(f, &sum);
+        }
+        fprintf(f, "}}");
+        first = 0;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+    printf("[info] JSON report written to %s\n", file);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dataset = "../../PointCloud-dataset";
+    const char* pub_file = "pub_key";
+    const char* prv_file = "user_key";
+    const char* patterns = "x,xyz";
+    const char* levels = "12,25,50,100";
+    const char* explicit_pattern = NULL;
+    const char* json = NULL;
+    int frame_no = 1, warmup = 3, iters = 20;
+    const char** files = calloc((size_t)argc, sizeof(char*));
+    int n_files = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--dataset") && i + 1 < argc) {
+            dataset = argv[++i];
+        } else if (!strcmp(argv[i], "--pub") && i + 1 < argc) {
+            pub_file = argv[++i];
+        } else if (!strcmp(argv[i], "--priv") && i + 1 < argc) {
+            prv_file = argv[++i];
+        } else if (!strcmp(argv[i], "--frame") && i + 1 < argc) {
+            frame_no = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--patterns") && i + 1 < argc) {
+            patterns = argv[++i];
+        } else if (!strcmp(argv[i], "--levels") && i + 1 < argc) {
+            levels = argv[++i];
+        } else if (!strcmp(argv[i], "--pattern") && i + 1 < argc) {
+            explicit_pattern = argv[++i];
+        } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--iters") && i + 1 < argc) {
+            iters = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json = argv[++i];
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-') {
+            files[n_files++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (warmup < 0 || iters < 1 || (n_files > 0 && !explicit_pattern)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Frame set: explicit files, or <dataset>/office52-enc-<p>-24fps-noattr/office52-<p>-<n>-<level>.ply.cpabe
+    BenchFrame* frames = NULL;
+    int n = 0;
+    if (n_files > 0) {
+        frames = calloc((size_t)n_files, sizeof(BenchFrame));
+        for (int i = 0; i < n_files; i++, n++) {
+            snprintf(frames[n].path, sizeof(frames[n].path), "%s", files[i]);
+            snprintf(frames[n].pattern, sizeof(frames[n].pattern), "%s", explicit_pattern);
+        }
+    } else {
+        gchar** pv = g_strsplit(patterns, ",", -1);
+        gchar** lv = g_strsplit(levels, ",", -1);
+        int np = (int)g_strv_length(pv), nl = (int)g_strv_length(lv);
+        frames = calloc((size_t)(np * nl), sizeof(BenchFrame));
+        for (int p = 0; p < np; p++) {
+            for (int l = 0; l < nl; l++, n++) {
+                BenchFrame* f = &frames[n];
+                snprintf(f->pattern, sizeof(f->pattern), "%s", pv[p]);
+                f->level = atoi(lv[l]);
+                snprintf(f->path, sizeof(f->path), "%s/office52-enc-%s-24fps-noattr/office52-%s-%05d-%d.ply.cpabe",
+                         dataset, pv[p], pv[p], frame_no, f->level);
+            }
+        }
+        g_strfreev(pv);
+        g_strfreev(lv);
+    }
+    free(files);
+
+    GByteArray* pub_bytes = suck_file((char*)pub_file);
+    g_pub = pub_bytes ? bswabe_pub_unserialize(pub_bytes, 1) : NULL;
+    GByteArray* prv_bytes = g_pub ? suck_file((char*)prv_file) : NULL;
+    g_prv = prv_bytes ? bswabe_prv_unserialize(g_pub, prv_bytes, 1) : NULL;
+    if (!g_pub || !g_prv) {
+        fprintf(stderr, "[error] cannot load keys %s / %s\n", pub_file, prv_file);
+        return 1;
+    }
+
+    printf("[info] bench_decrypt: %d frames, %d warmup + %d timed runs per stage\n", n, warmup, iters);
+    int done = 0;
+    for (int i = 0; i < n; i++) {
+        BenchFrame* f = &frames[i];
+        if (load_frame(f) != 0) continue;
+        if (bench_frame(f, warmup, iters) != 0) continue;
+        done++;
+        printf("%s (pattern %s, %u bytes)\n", f->path, f->pattern, f->data->len);
+        for (int s = 0; s < N_STAGES; s++) {
+            BenchSummary sum = bench_summarize(&f->st[s]);
+            bench_print_summary(k_stage[s], &sum);
+        }
+    }
+    size_t peak = 0;
+    int grows = 0;
+    scratch_stats(&peak, &grows);
+    printf("[info] peak RSS %.1f MB, scratch peak %.1f MB per frame\n", bench_peak_rss_kb() / 1024.0, peak / 1e6);
+    if (json) write_json(json, frames, n, warmup, iters);
+
+    for (int i = 0; i < n; i++) {
+        if (frames[i].data) g_byte_array_free(frames[i].data, 1);
+        for (int s = 0; s < N_STAGES; s++) bench_free(&frames[i].st[s]);
+    }
+    free(frames);
+    scratch_release();
+    bswabe_prv_free(g_prv);
+    bswabe_pub_free(g_pub);
+    if (done == 0) {
+        fprintf(stderr, "[error] no frame could be benchmarked\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,562 @@
+// bench_pipeline: end-to-end throughput of download -> decrypt -> (inference) -> buffer -> player
+// against a local dataset, as fast as the pipeline goes.
+//
+//   bench_pipeline --url <file:// MPD> [--decrypt --pub <pub_key> --priv <priv_key> --pattern <p>]
+//                  [--inference] [--mmap] [--frames <n>] [--reps 0,1,2,3] [--workers 1,2,4]
+//                  [--queue <n>] [--json <file>] [--ref <file>] [--tolerance <frac>] [--save-ref]
+//
+// The stages are the client's own modules (downloader or localfile, decryptor, inference,
+// buffer) on the client's stage graph (pipeline.[ch]): a fetch source, a stage of N
+// decrypt/inference workers and an ordered player sink. The player runs on a synthetic clock:
+// a frame is played as soon as it and every frame before it are done, and the clock advances
+// one frame interval per frame instead of waiting for 1/fps.
+// Each (representation, worker count) run reports sustained frames/s, the busy share of each
+// stage, the occupancy histogram of both queues, fetch-to-play latency and peak RSS.
+//
+// Reference numbers live in a text file (default src/tools/bench_pipeline.ref, one line per
+// run configuration). A run slower than reference * (1 - tolerance) is a regression and the
+// tool exits with status 3; --save-ref records the current runs, replacing their lines and
+// keeping those of other configurations.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <glib.h>
+#include "mpd_parser.h"
+#include "downloader.h"
+#include "decryptor.h"
+#include "inference.h"
+#include "download_queue.h"
+#include "pipeline.h"
+#include "telemetry.h"
+#include "framepool.h"
+#include "localfile.h"
+#include "buffer.h"
+#include "utils.h"
+#include "bench.h"
+
+#define EXIT_REGRESSION 3
+
+typedef struct {
+    pthread_mutex_t lock;
+    double busy_ms;       // summed over the stage's threads
+    long items;
+    int threads;
+} StageStat;
+
+typedef struct {
+    long* hist;           // hist[k] = frames taken with k more still queued
+    int cap;
+    long samples;
+} QueueHist;
+
+typedef struct {
+    // configuration
+    MPDInfo* mpd;
+    int rep, workers, n_frames;
+    int decrypt, inference, use_mmap;
+    // pipeline
+    Pipeline* pipe;       // stage 0 = workers, stage 1 = player
+    Buffer* buffer;
+    int next;             // next frame to fetch
+    double* t_fetch;      // fetch start per frame, for latency
+    // results
+    StageStat fetch, dec, inf, play;
+    QueueHist in_hist, out_hist;
+    BenchSamples latency;
+    pthread_mutex_t lock; // in_hist
+    long failed;
+    double wall_ms, fps, realtime;
+    long peak_rss_kb;
+} Run;
+
+static void stage_init(StageStat* s, int threads) {
+    pthread_mutex_init(&s->lock, NULL);
+    s->busy_ms = 0.0;
+    s->items = 0;
+    s->threads = threads;
+}
+
+static void stage_add(StageStat* s, double ms) {
+    pthread_mutex_lock(&s->lock);
+    s->busy_ms += ms;
+    s->items++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+static double stage_util(const StageStat* s, double wall_ms) {
+    return wall_ms > 0.0 && s->threads > 0 ? s->busy_ms / (wall_ms * s->threads) : 0.0;
+}
+
+static void hist_init(QueueHist* h, int cap) {
+    h->cap = cap;
+    h->hist = calloc((size_t)cap + 1, sizeof(long));
+    h->samples = 0;
+}
+
+static void hist_add(QueueHist* h, int count) {
+    if (count < 0) count = 0;
+    if (count > h->cap) count = h->cap;
+    h->hist[count]++;
+    h->samples++;
+}
+
+// --- fetch source: one frame at a time, in order, at the run's representation ---
+static Frame* fetch_next(void* user, double* busy_ms) {
+    Run* r = (Run*)user;
+    if (r->next >= r->n_frames) return NULL;
+    int i = r->next++;
+    int avail = mpd_available_frames(r->mpd);
+    char url[1024];
+    Frame* f = calloc(1, sizeof(Frame));
+    f->index = i;
+    f->rep = r->rep;
+    double t0 = now_ms_mono();
+    r->t_fetch[i] = t0;
+    // the sequence repeats when more frames are asked for than the MPD has
+    if (avail > 0 && mpd_frame_url(r->mpd, r->rep, i % avail, url, sizeof(url)) >= 0) {
+        if (r->use_mmap) {
+            f->local = local_map(url, &f->dl_ms);
+            if (f->local) f->buffer = frame_pool_get(r->rep, f->local->len);
+        } else if (download_file_mem(url, r->rep, &f->buffer, &f->dl_ms) != 0) {
+            frame_pool_put(f->buffer);
+            f->buffer = NULL;
+        }
+    }
+    if (!f->buffer) {
+        r->failed++;
+    } else {
+        f->size_bytes = f->local ? f->local->len : f->buffer->len;
+    }
+    *busy_ms = now_ms_mono() - t0;
+    stage_add(&r->fetch, *busy_ms);
+    return f;
+}
+
+static void fetch_done(void* user) {
+    (void)user;
+    download_range_cleanup();
+}
+
+// --- workers: decrypt (and infer) in whatever order frames come off the queue ---
+static double work_frame(void* user, Frame* f) {
+    Run* r = (Run*)user;
+    pthread_mutex_lock(&r->lock);
+    hist_add(&r->in_hist, pipeline_queued(r->pipe, 0));
+    pthread_mutex_unlock(&r->lock);
+    if (!f->buffer) return 0.0;
+    double t0 = now_ms_mono();
+    int rc = 0;
+    if (f->local) {
+        rc = decrypt_file_view(f->local->data, f->local->len, f->buffer, &f->dec_ms, 0, NULL);
+        local_unmap(f->local);
+        f->local = NULL;
+    } else if (r->decrypt) {
+        rc = decrypt_file_buffer(f->buffer, &f->dec_ms, 0, NULL);
+    }
+    if (rc != 0) fprintf(stderr, "[warn] decrypt failed (rc=%d) for frame %d\n", rc, f->index);
+    double busy = now_ms_mono() - t0;
+    stage_add(&r->dec, busy);
+    if (r->inference && rc == 0) {
+        t0 = now_ms_mono();
+        if (inference_run_buffer(f->buffer, &f->inf_ms) != 0) f->inf_ms = 0.0;
+        double inf = now_ms_mono() - t0;
+        stage_add(&r->inf, inf);
+        busy += inf;
+    }
+    return busy;
+}
+
+// --- player (ordered sink): plays in frame order on a synthetic clock (no pacing) ---
+static double play_frame(void* user, Frame* f) {
+    Run* r = (Run*)user;
+    hist_add(&r->out_hist, pipeline_queued(r->pipe, 1));
+    double t0 = now_ms_mono();
+    buffer_add(r->buffer);
+    buffer_consume(r->buffer);
+    bench_add(&r->latency, now_ms_mono() - r->t_fetch[f->index]);
+    frame_pool_put(f->buffer);
+    free(f);
+    double busy = now_ms_mono() - t0;
+    stage_add(&r->play, busy);
+    return busy;
+}
+
+static int run_pipeline(Run* r, int queue_size) {
+    r->next = 0;
+    r->t_fetch = calloc((size_t)r->n_frames, sizeof(double));
+    r->buffer = buffer_init(1, r->mpd->frame_rate);
+    PipelineSource src = { STAGE_NONE, fetch_next, NULL, NULL, fetch_done, r, NULL };
+    PipelineStageDef work = { "work", STAGE_NONE, r->workers, queue_size, 0, work_frame,
+                              decryptor_thread_exit, r, NULL };
+    PipelineStageDef play = { "player", STAGE_NONE, 1, queue_size + r->workers, 1, play_frame,
+                              NULL, r, NULL };
+    r->pipe = pipeline_create(&src);
+    if (!r->t_fetch || !r->buffer || !r->pipe || pipeline_add_stage(r->pipe, &work) < 0 ||
+        pipeline_add_stage(r->pipe, &play) < 0) {
+        fprintf(stderr, "[error] out of memory\n");
+        return -1;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    stage_init(&r->fetch, 1);
+    stage_init(&r->dec, r->workers);
+    stage_init(&r->inf, r->workers);
+    stage_init(&r->play, 1);
+    hist_init(&r->in_hist, queue_size);
+    hist_init(&r->out_hist, queue_size + r->workers);
+
+    bench_reset_peak_rss();
+    double t0 = now_ms_mono();
+    if (pipeline_start(r->pipe) != 0) {
+        fprintf(stderr, "[error] pipeline_start failed.\n");
+        return -1;
+    }
+    pipeline_join(r->pipe);
+    r->wall_ms = now_ms_mono() - t0;
+    r->peak_rss_kb = bench_peak_rss_kb();
+    r->fps = r->wall_ms > 0.0 ? r->n_frames * 1000.0 / r->wall_ms : 0.0;
+    r->realtime = r->mpd->frame_rate > 0 ? r->fps / r->mpd->frame_rate : 0.0;
+
+    pipeline_free(r->pipe);
+    r->pipe = NULL;
+    buffer_free(r->buffer);
+    free(r->t_fetch);
+    return 0;
+}
+
+static void run_free(Run* r) {
+    free(r->in_hist.hist);
+    free(r->out_hist.hist);
+    bench_free(&r->latency);
+}
+
+static void print_hist(const char* name, const QueueHist* h) {
+    printf("  %-9s occupancy:", name);
+    for (int k = 0; k <= h->cap; k++) {
+        printf(" %d:%.0f%%", k, h->samples ? 100.0 * h->hist[k] / h->samples : 0.0);
+    }
+    printf("\n");
+}
+
+static void print_run(Run* r) {
+    printf("[run] rep %d, %d worker%s: %.1f frames/s (%.2fx realtime), %ld failed, peak RSS %.1f MB\n",
+           r->rep, r->workers, r->workers == 1 ? "" : "s", r->fps, r->realtime, r->failed,
+           r->peak_rss_kb / 1024.0);
+    printf("  busy      fetch %.0f%%  decrypt %.0f%%  inference %.0f%%  player %.0f%%\n",
+           100.0 * stage_util(&r->fetch, r->wall_ms), 100.0 * stage_util(&r->dec, r->wall_ms),
+           100.0 * stage_util(&r->inf, r->wall_ms), 100.0 * stage_util(&r->play, r->wall_ms));
+    print_hist("in-queue", &r->in_hist);
+    print_hist("out-queue", &r->out_hist);
+    BenchSummary lat = bench_summarize(&r->latency);
+    bench_print_summary("latency", &lat);
+}
+
+// Configuration key of a run in the reference file: <mpd> <rep> <workers> <mode>
+static void run_key(const Run* r, const char* mpd_name, char* out, size_t n) {
+    snprintf(out, n, "%s %d %d %s%s%s", mpd_name, r->rep, r->workers,
+             r->decrypt ? "dec" : "copy", r->inference ? "+inf" : "", r->use_mmap ? "+mmap" : "");
+}
+
+static void write_json(const char* file, Run* runs, int n, const char* mpd_url) {
+    FILE* f = fopen(file, "w");
+    if (!f) {
+        fprintf(stderr, "[warn] cannot write %s\n", file);
+        return;
+    }
+    char ts[32];
+    bench_timestamp(ts, sizeof(ts));
+    fprintf(f, "{\n  \"bench\": \"pipeline\",\n  \"timestamp\": \"%s\",\n  \"mpd\": \"%s\",\n  \"runs\": [",
+            ts, mpd_url);
+    for (int i = 0; i < n; i++) {
+        Run* r = &runs[i];
+        fprintf(f, "%s\n    {\"rep\": %d, \"workers\": %d, \"decrypt\": %d, \"inference\": %d, \"mmap\": %d,\n",
+                i ? "," : "", r->rep, r->workers, r->decrypt, r->inference, r->use_mmap);
+        fprintf(f, "     \"frames\": %d, \"failed\": %ld, \"wall_ms\": %.1f, \"fps\": %.2f, \"realtime\": %.3f, \"peak_rss_kb\": %ld,\n",
+                r->n_frames, r->failed, r->wall_ms, r->fps, r->realtime, r->peak_rss_kb);
+        fprintf(f, "     \"utilization\": {\"fetch\": %.3f, \"decrypt\": %.3f, \"inference\": %.3f, \"player\": %.3f},\n",
+                stage_util(&r->fetch, r->wall_ms), stage_util(&r->dec, r->wall_ms),
+                stage_util(&r->inf, r->wall_ms), stage_util(&r->play, r->wall_ms));
+        const QueueHist* hs[2] = { &r->in_hist, &r->out_hist };
+        const char* names[2] = { "in_queue", "out_queue" };
+        for (int q = 0; q < 2; q++) {
+            fprintf(f, "     \"%s\": [", names[q]);
+            for (int k = 0; k <= hs[q]->cap; k++) fprintf(f, "%s%ld", k ? ", " : "", hs[q]->hist[k]);
+            fprintf(f, "],\n");
+        }
+        BenchSummary lat = bench_summarize(&r->latency);
+        fprintf(f, "     \"latency_ms\": ");
+        bench_json_summary(f, &lat);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+    printf("[info] JSON report written to %s\n", file);
+}
+
+// Reference fps for key, or -1 when the file has no line for it.
+static double ref_lookup(const char* file, const char* key) {
+    FILE* f = fopen(file, "r");
+    if (!f) return -1.0;
+    char line[1024];
+    double fps = -1.0;
+    size_t klen = strlen(key);
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || strncmp(line, key, klen) || line[klen] != ' ') continue;
+        fps = atof(line + klen + 1);
+    }
+    fclose(f);
+    return fps;
+}
+
+// Is line the reference of one of the runs (those get replaced by save_ref)?
+static int ref_line_replaced(const char* line, Run* runs, int n, const char* mpd_name) {
+    if (line[0] == '#') return 0;
+    for (int i = 0; i < n; i++) {
+        char key[512];
+        run_key(&runs[i], mpd_name, key, sizeof(key));
+        size_t klen = strlen(key);
+        if (!strncmp(line, key, klen) && line[klen] == ' ') return 1;
+    }
+    return 0;
+}
+
+// Record the runs' numbers: their lines are replaced, comments and other configurations kept
+static int save_ref(const char* file, Run* runs, int n, const char* mpd_name) {
+    char** kept = NULL;
+    int n_kept = 0, cap = 0;
+    FILE* f = fopen(file, "r");
+    if (f) {
+        char line[1024];
+        while (fgets(line, sizeof(line), f)) {
+            if (ref_line_replaced(line, runs, n, mpd_name)) continue;
+            if (n_kept == cap) {
+                cap = cap ? 2 * cap : 64;
+                kept = realloc(kept, (size_t)cap * sizeof(char*));
+            }
+            kept[n_kept++] = strdup(line);
+        }
+        fclose(f);
+    }
+    f = fopen(file, "w");
+    if (!f) {
+        fprintf(stderr, "[error] cannot write %s\n", file);
+        for (int i = 0; i < n_kept; i++) free(kept[i]);
+        free(kept);
+        return -1;
+    }
+    char ts[32];
+    bench_timestamp(ts, sizeof(ts));
+    if (n_kept == 0) {
+        fprintf(f, "# bench_pipeline reference throughput\n");
+        fprintf(f, "# <mpd> <rep> <workers> <mode> <frames/s>; mode = dec|copy [+inf] [+mmap]\n");
+    }
+    for (int i = 0; i < n_kept; i++) {
+        size_t len = strlen(kept[i]);
+        fprintf(f, "%s%s", kept[i], len && kept[i][len - 1] == '\n' ? "" : "\n");
+        free(kept[i]);
+    }
+    free(kept);
+    for (int i = 0; i < n; i++) {
+        char key[512];
+        run_key(&runs[i], mpd_name, key, sizeof(key));
+        fprintf(f, "%s %.2f  # %s\n", key, runs[i].fps, ts);
+    }
+    fclose(f);
+    printf("[info] reference written to %s\n", file);
+    return 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s --url <file:// MPD> [--decrypt --pub <pub_key> --priv <priv_key> --pattern <scheme>]\n"
+        " [--inference] [--mmap] [--frames <n>] [--reps <list>] [--workers <list>] [--queue <n>]\n"
+        " [--json <file>] [--ref <file>] [--tolerance <frac>] [--save-ref]\n"
+        "Notes:\n"
+        "  [--frames <n>]       (frames per run, the sequence repeats if shorter; default is 240)\n"
+        "  [--reps <list>]      (representation indices, default is every representation)\n"
+        "  [--workers <list>]   (decrypt/inference threads per run, default is 1,2,4)\n"
+        "  [--queue <n>]        (download queue size, default is 8)\n"
+        "  [--mmap]             (map frame files instead of reading them through curl)\n"
+        "  [--ref <file>]       (reference numbers, default is src/tools/bench_pipeline.ref)\n"
+        "  [--tolerance <frac>] (allowed throughput drop before failing, default is 0.10)\n"
+        "  [--save-ref]         (record this run's numbers in the reference file instead of checking)\n"
+        "  • Exit status %d when a run is slower than its reference beyond the tolerance.\n"
+        "  • Example: %s --url file://$PWD/../../PointCloud-dataset/office52-enc-x-24fps-noattr/office52-enc-x-24fps-noattr.mpd \\\n"
+        "      --decrypt --pub pub_key --priv user_key --pattern x --mmap --json logs/bench_pipeline.json\n",
+        prog, EXIT_REGRESSION, prog);
+}
+
+static int parse_list(const char* s, int* out, int max) {
+    int n = 0;
+    gchar** v = g_strsplit(s, ",", -1);
+    for (int i = 0; v[i] && n < max; i++) {
+        if (*v[i]) out[n++] = atoi(v[i]);
+    }
+    g_strfreev(v);
+    return n;
+}
+
+int main(int argc, char* argv[]) {
+    const char* mpd_url = NULL;
+    const char *pub_key = NULL, *priv_key = NULL, *pattern = NULL;
+    const char* json = NULL;
+    const char* ref_file = "src/tools/bench_pipeline.ref";
+    const char* reps_arg = NULL;
+    const char* workers_arg = "1,2,4";
+    double tolerance = 0.10;
+    int decrypt = 0, inference = 0, use_mmap = 0, save = 0;
+    int n_frames = 240, queue_size = 8;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--url") && i + 1 < argc) {
+            mpd_url = argv[++i];
+        } else if (!strcmp(argv[i], "--decrypt")) {
+            decrypt = 1;
+        } else if (!strcmp(argv[i], "--pub") && i + 1 < argc) {
+            pub_key = argv[++i];
+        } else if (!strcmp(argv[i], "--priv") && i + 1 < argc) {
+            priv_key = argv[++i];
+        } else if (!strcmp(argv[i], "--pattern") && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if (!strcmp(argv[i], "--inference")) {
+            inference = 1;
+        } else if (!strcmp(argv[i], "--mmap")) {
+            use_mmap = 1;
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            n_frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+            reps_arg = argv[++i];
+        } else if (!strcmp(argv[i], "--workers") && i + 1 < argc) {
+            workers_arg = argv[++i];
+        } else if (!strcmp(argv[i], "--queue") && i + 1 < argc) {
+            queue_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json = argv[++i];
+        } else if (!strcmp(argv[i], "--ref") && i + 1 < argc) {
+            ref_file = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--save-ref")) {
+            save = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!mpd_url || n_frames < 1 || queue_size < 1 || tolerance < 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (decrypt && (!pub_key || !priv_key || !pattern)) {
+        fprintf(stderr, "[error] --decrypt requires --pub, --priv, and --pattern.\n");
+        return 1;
+    }
+    if (use_mmap) {
+        char path[1024];
+        if (local_path(mpd_url, path, sizeof(path)) != 0) {
+            fprintf(stderr, "[error] --mmap needs a file:// MPD (or a local path).\n");
+            return 1;
+        }
+    }
+
+    MPDInfo* mpd = parse_mpd(mpd_url);
+    if (!mpd || mpd->frame_rate <= 0 || mpd->is_dynamic) {
+        fprintf(stderr, "[error] need a static MPD with a frame rate: %s\n", mpd_url);
+        if (mpd) free_mpd(mpd);
+        return 1;
+    }
+    const char* mpd_name = strrchr(mpd_url, '/') ? strrchr(mpd_url, '/') + 1 : mpd_url;
+
+    int reps[16], workers[16];
+    int n_reps = 0, n_workers = parse_list(workers_arg, workers, 16);
+    if (reps_arg) {
+        n_reps = parse_list(reps_arg, reps, 16);
+    } else {
+        for (int k = 0; k < mpd->n_reps && k < 16; k++) reps[n_reps++] = k;
+    }
+    for (int k = 0; k < n_reps; k++) {
+        if (reps[k] < 0 || reps[k] >= mpd->n_reps) {
+            fprintf(stderr, "[error] representation %d not in the MPD (0..%d)\n", reps[k], mpd->n_reps - 1);
+            free_mpd(mpd);
+            return 1;
+        }
+    }
+    for (int k = 0; k < n_workers; k++) {
+        if (workers[k] < 1) {
+            usage(argv[0]);
+            free_mpd(mpd);
+            return 1;
+        }
+    }
+
+    if (decryptor_init(pub_key, priv_key, pattern, decrypt) != 0) {
+        fprintf(stderr, "[error] decryptor_init failed.\n");
+        free_mpd(mpd);
+        return 2;
+    }
+    if (inference && inference_init(NULL) != 0) {
+        fprintf(stderr, "[warn] inference_init failed, disabling inference.\n");
+        inference = 0;
+    }
+    int max_workers = 1;
+    for (int k = 0; k < n_workers; k++) if (workers[k] > max_workers) max_workers = workers[k];
+    frame_pool_init(mpd->n_reps, 2 * queue_size + 2 * max_workers + 2);
+
+    int n_runs = n_reps * n_workers;
+    Run* runs = calloc((size_t)n_runs, sizeof(Run));
+    printf("[info] bench_pipeline: %d runs of %d frames, queue %d, %s%s%s\n", n_runs, n_frames, queue_size,
+           decrypt ? "decrypt" : "no decrypt", inference ? " + inference" : "", use_mmap ? ", mmap" : "");
+    for (int a = 0; a < n_reps; a++) {
+        for (int b = 0; b < n_workers; b++) {
+            Run* r = &runs[a * n_workers + b];
+            r->mpd = mpd;
+            r->rep = reps[a];
+            r->workers = workers[b];
+            r->n_frames = n_frames;
+            r->decrypt = decrypt;
+            r->inference = inference;
+            r->use_mmap = use_mmap;
+            if (run_pipeline(r, queue_size) != 0) return 2;
+            print_run(r);
+        }
+    }
+    frame_pool_report();
+    if (json) write_json(json, runs, n_runs, mpd_url);
+
+    // Regression check against the stored reference numbers
+    int rc = 0;
+    if (save) {
+        if (save_ref(ref_file, runs, n_runs, mpd_name) != 0) rc = 1;
+    } else {
+        int checked = 0;
+        for (int i = 0; i < n_runs; i++) {
+            char key[512];
+            run_key(&runs[i], mpd_name, key, sizeof(key));
+            double ref = ref_lookup(ref_file, key);
+            if (ref <= 0.0) continue;
+            checked++;
+            double change = (runs[i].fps - ref) / ref;
+            if (runs[i].fps < ref * (1.0 - tolerance)) {
+                fprintf(stderr, "[regress] %s: %.1f frames/s vs reference %.1f (%+.1f%%, tolerance %.0f%%)\n",
+                        key, runs[i].fps, ref, 100.0 * change, 100.0 * tolerance);
+                rc = EXIT_REGRESSION;
+            } else {
+                printf("[ok] %s: %.1f frames/s vs reference %.1f (%+.1f%%)\n", key, runs[i].fps, ref, 100.0 * change);
+            }
+        }
+        if (checked < n_runs) {
+            printf("[info] %d of %d runs have no reference in %s (record them with --save-ref)\n",
+                   n_runs - checked, n_runs, ref_file);
+        }
+    }
+
+    for (int i = 0; i < n_runs; i++) run_free(&runs[i]);
+    free(runs);
+    frame_pool_shutdown();
+    decryptor_shutdown();
+    if (inference) inference_shutdown();
+    free_mpd(mpd);
+    return rc;
+}
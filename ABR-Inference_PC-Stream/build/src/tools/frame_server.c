@@ -0,0 +1,583 @@
+// frame_server: minimal HTTP/1.1 server for a point cloud dataset directory.
+// Lets stream_client run end-to-end benchmarks on one machine without Apache/Varnish.
+//
+//   frame_server --root <dataset_dir> [--port 8080] [--bind 127.0.0.1]
+//                [--rate <Mbit/s per connection>] [--latency <ms>] [--preload] [--verbose]
+//
+// Files are mmap'ed once and kept in a cache (pages stay resident between requests); the fd
+// is closed right after mapping, so the cache never holds descriptors. Every request re-stats
+// the file and maps it again if it changed (a live MPD rewritten on disk). Bodies are sent from
+// the mapping, throttled ones paced in chunks.
+// Supports GET/HEAD, keep-alive, single byte ranges and If-None-Match against a size/mtime ETag.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define REQ_BUF_SIZE   8192
+#define CHUNK_BYTES    (16 * 1024)   // pacing granularity when rate limited
+#define CACHE_BUCKETS  4096
+
+typedef struct CachedFile {
+    char* path;            // path relative to root, as requested
+    size_t size;
+    struct timespec mtime;
+    ino_t ino;
+    unsigned char* data;   // read-only mapping (NULL for empty files)
+    int refs;              // the cache's own + requests using it (under g_cache_lock)
+    struct CachedFile* next;
+} CachedFile;
+
+typedef struct {
+    const char* root;
+    double rate_bps;       // bytes per second per connection, 0 = unlimited
+    int latency_ms;        // added before every response
+    int verbose;
+} ServerConfig;
+
+static ServerConfig g_cfg;
+static CachedFile* g_cache[CACHE_BUCKETS];
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t g_stop = 0;
+
+// totals for the exit summary
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long g_requests = 0, g_connections = 0;
+static unsigned long long g_bytes = 0;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void sleep_ms(double ms) {
+    if (ms <= 0) return;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ms / 1000.0);
+    ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1e6);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+}
+
+static unsigned hash_path(const char* s) {
+    unsigned h = 2166136261u; // FNV-1a
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h % CACHE_BUCKETS;
+}
+
+static int same_file(const CachedFile* f, const struct stat* st) {
+    return f->size == (size_t)st->st_size && f->ino == st->st_ino &&
+           f->mtime.tv_sec == st->st_mtim.tv_sec && f->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void free_entry(CachedFile* f) {
+    if (f->data) munmap(f->data, f->size);
+    free(f->path);
+    free(f);
+}
+
+// Drop one reference; the last one unmaps an entry that was replaced or removed.
+static void cache_release(CachedFile* f) {
+    pthread_mutex_lock(&g_cache_lock);
+    int last = --f->refs == 0;
+    pthread_mutex_unlock(&g_cache_lock);
+    if (last) free_entry(f);
+}
+
+// Take the entry for rel out of its bucket (caller holds g_cache_lock). Returns it, still
+// holding the cache's reference, or NULL.
+static CachedFile* cache_unlink(unsigned h, const char* rel) {
+    for (CachedFile** pf = &g_cache[h]; *pf; pf = &(*pf)->next) {
+        if (!strcmp((*pf)->path, rel)) {
+            CachedFile* f = *pf;
+            *pf = f->next;
+            return f;
+        }
+    }
+    return NULL;
+}
+
+// Look up (or open + map) a file under root; the caller gives it back with cache_release().
+// An entry whose file changed size, mtime or inode since it was mapped is replaced.
+// Returns NULL if missing or not a regular file (errno is EMFILE/ENFILE when out of fds).
+static CachedFile* cache_get(const char* rel) {
+    char full[4096];
+    snprintf(full, sizeof(full), "%s/%s", g_cfg.root, rel);
+    unsigned h = hash_path(rel);
+    struct stat st;
+    int found = stat(full, &st) == 0 && S_ISREG(st.st_mode);
+
+    pthread_mutex_lock(&g_cache_lock);
+    CachedFile* stale = NULL;
+    for (CachedFile* f = g_cache[h]; f; f = f->next) {
+        if (strcmp(f->path, rel)) continue;
+        if (found && same_file(f, &st)) {
+            f->refs++;
+            pthread_mutex_unlock(&g_cache_lock);
+            return f;
+        }
+        stale = cache_unlink(h, rel);
+        break;
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+    if (stale) cache_release(stale);
+    if (!found) return NULL;
+
+    int fd = open(full, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    CachedFile* nf = calloc(1, sizeof(CachedFile));
+    nf->path = strdup(rel);
+    nf->size = (size_t)st.st_size;
+    nf->mtime = st.st_mtim;
+    nf->ino = st.st_ino;
+    if (nf->size > 0) {
+        void* p = mmap(NULL, nf->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "[warn] mmap %s: %s\n", rel, strerror(errno));
+            close(fd);
+            free(nf->path);
+            free(nf);
+            return NULL;
+        }
+        madvise(p, nf->size, MADV_WILLNEED);
+        nf->data = p;
+    }
+    close(fd); // the mapping stays valid
+
+    pthread_mutex_lock(&g_cache_lock);
+    for (CachedFile* f = g_cache[h]; f; f = f->next) {
+        if (!strcmp(f->path, rel) && same_file(f, &st)) { // another connection mapped it first
+            f->refs++;
+            pthread_mutex_unlock(&g_cache_lock);
+            free_entry(nf);
+            return f;
+        }
+    }
+    stale = cache_unlink(h, rel);
+    nf->refs = 2; // the cache's and the caller's
+    nf->next = g_cache[h];
+    g_cache[h] = nf;
+    pthread_mutex_unlock(&g_cache_lock);
+    if (stale) cache_release(stale);
+    return nf;
+}
+
+// Map every regular file below root up front so first requests are not disk bound
+static int preload_dir(const char* rel) {
+    char full[4096];
+    snprintf(full, sizeof(full), "%s/%s", g_cfg.root, rel);
+    DIR* d = opendir(full);
+    if (!d) return 0;
+    int n = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char child[4096];
+        snprintf(child, sizeof(child), "%s%s%s", rel, rel[0] ? "/" : "", e->d_name);
+        CachedFile* f = cache_get(child);
+        if (f) {
+            cache_release(f);
+            n++;
+        } else {
+            n += preload_dir(child);
+        }
+    }
+    closedir(d);
+    return n;
+}
+
+static int write_all(int fd, const void* buf, size_t len) {
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Body [off, off+len) of f, from the mapping. Rate limiting paces chunks so that bytes sent
+// never run ahead of rate * elapsed.
+static int send_body(int fd, CachedFile* f, size_t off, size_t len) {
+    if (g_cfg.rate_bps <= 0) return write_all(fd, f->data + off, len);
+    double start = now_ms();
+    size_t sent = 0;
+    while (sent < len) {
+        size_t chunk = len - sent < CHUNK_BYTES ? len - sent : CHUNK_BYTES;
+        if (write_all(fd, f->data + off + sent, chunk) != 0) return -1;
+        sent += chunk;
+        double due = start + (double)sent * 1000.0 / g_cfg.rate_bps;
+        sleep_ms(due - now_ms());
+    }
+    return 0;
+}
+
+static const char* content_type(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if (dot && !strcmp(dot, ".mpd")) return "application/dash+xml";
+    if (dot && !strcmp(dot, ".xml")) return "application/xml";
+    return "application/octet-stream";
+}
+
+static void send_status(int fd, int code, const char* reason, int keep_alive) {
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                     code, reason, keep_alive ? "keep-alive" : "close");
+    write_all(fd, hdr, (size_t)n);
+}
+
+// Decode %XX escapes and strip the query string. Rejects paths escaping the root.
+static int sanitize_path(const char* target, char* out, size_t out_len) {
+    size_t o = 0;
+    const char* p = target;
+    while (*p == '/') p++;
+    for (; *p && *p != '?' && *p != '#'; p++) {
+        char c = *p;
+        if (c == '%' && p[1] && p[2]) {
+            char hex[3] = { p[1], p[2], 0 };
+            c = (char)strtol(hex, NULL, 16);
+            p += 2;
+        }
+        if (o + 1 >= out_len) return -1;
+        out[o++] = c;
+    }
+    out[o] = '\0';
+    if (strstr(out, "..") || o == 0) return -1;
+    return 0;
+}
+
+// Parse "bytes=a-b", "bytes=a-" or "bytes=-n". Returns 0 and sets [*start, *end] on success,
+// -1 if unsatisfiable, 1 if the header is not a single range we understand (serve whole file).
+static int parse_range(const char* v, size_t size, size_t* start, size_t* end) {
+    if (strncmp(v, "bytes=", 6) != 0 || strchr(v, ',')) return 1;
+    v += 6;
+    char* dash = strchr(v, '-');
+    if (!dash) return 1;
+    if (dash == v) {
+        unsigned long long n = strtoull(dash + 1, NULL, 10);
+        if (n == 0 || size == 0) return -1;
+        if (n > size) n = size;
+        *start = size - (size_t)n;
+        *end = size - 1;
+        return 0;
+    }
+    unsigned long long a = strtoull(v, NULL, 10);
+    unsigned long long b = (dash[1] >= '0' && dash[1] <= '9') ? strtoull(dash + 1, NULL, 10) : size - 1;
+    if (a >= size || b < a) return -1;
+    if (b >= size) b = size - 1;
+    *start = (size_t)a;
+    *end = (size_t)b;
+    return 0;
+}
+
+static int send_file(int fd, CachedFile* f, const char* method, const char* rel, int head,
+                     const char* range, const char* inm, int keep_alive);
+
+// Handle one request whose header block is req (NUL-terminated). Returns 1 to keep the
+// connection open, 0 to close it.
+static int handle_request(int fd, char* req) {
+    char method[16], target[2048], version[16];
+    if (sscanf(req, "%15s %2047s %15s", method, target, version) != 3) {
+        send_status(fd, 400, "Bad Request", 0);
+        return 0;
+    }
+    int keep_alive = strcmp(version, "HTTP/1.0") != 0;
+    const char* range = NULL;
+    const char* inm = NULL;
+    char* h = strstr(req, "\r\n");
+    while (h) {
+        h += 2;
+        char* eol = strstr(h, "\r\n");
+        if (!eol || eol == h) break;
+        *eol = '\0';
+        if (!strncasecmp(h, "Connection:", 11)) {
+            const char* v = h + 11;
+            while (*v == ' ') v++;
+            if (!strncasecmp(v, "close", 5)) keep_alive = 0;
+            else if (!strncasecmp(v, "keep-alive", 10)) keep_alive = 1;
+        } else if (!strncasecmp(h, "Range:", 6)) {
+            range = h + 6;
+            while (*range == ' ') range++;
+        } else if (!strncasecmp(h, "If-None-Match:", 14)) {
+            inm = h + 14;
+            while (*inm == ' ') inm++;
+        }
+        h = eol;
+    }
+
+    int head = !strcmp(method, "HEAD");
+    if (!head && strcmp(method, "GET") != 0) {
+        send_status(fd, 405, "Method Not Allowed", keep_alive);
+        return keep_alive;
+    }
+    char rel[2048];
+    CachedFile* f = NULL;
+    errno = 0;
+    if (sanitize_path(target, rel, sizeof(rel)) == 0) f = cache_get(rel);
+
+    sleep_ms(g_cfg.latency_ms);
+    if (!f) {
+        if (errno == EMFILE || errno == ENFILE) {
+            fprintf(stderr, "[error] out of file descriptors opening %s (raise ulimit -n)\n", rel);
+            send_status(fd, 503, "Service Unavailable", 0);
+            return 0;
+        }
+        if (g_cfg.verbose) fprintf(stderr, "[warn] 404 %s\n", target);
+        send_status(fd, 404, "Not Found", keep_alive);
+        return keep_alive;
+    }
+    int keep = send_file(fd, f, method, rel, head, range, inm, keep_alive);
+    cache_release(f);
+    return keep;
+}
+
+// Response for an existing file: 304, 416, 206 or 200 with the body unless HEAD.
+static int send_file(int fd, CachedFile* f, const char* method, const char* rel, int head,
+                     const char* range, const char* inm, int keep_alive) {
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%zx-%lx.%lx\"", f->size, (unsigned long)f->mtime.tv_sec,
+             (unsigned long)f->mtime.tv_nsec);
+    if (inm && strstr(inm, etag)) {
+        char hdr[256];
+        int n = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: %s\r\n\r\n",
+                         etag, keep_alive ? "keep-alive" : "close");
+        write_all(fd, hdr, (size_t)n);
+        return keep_alive;
+    }
+
+    size_t start = 0, end = f->size ? f->size - 1 : 0;
+    int partial = 0;
+    if (range) {
+        int rc = parse_range(range, f->size, &start, &end);
+        if (rc < 0) {
+            char hdr[256];
+            int n = snprintf(hdr, sizeof(hdr),
+                             "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%zu\r\n"
+                             "Content-Length: 0\r\nConnection: %s\r\n\r\n",
+                             f->size, keep_alive ? "keep-alive" : "close");
+            write_all(fd, hdr, (size_t)n);
+            return keep_alive;
+        }
+        partial = (rc == 0);
+    }
+    size_t len = f->size ? end - start + 1 : 0;
+
+    char hdr[512];
+    int n;
+    if (partial) {
+        n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Content-Range: bytes %zu-%zu/%zu\r\nAccept-Ranges: bytes\r\nETag: %s\r\n"
+                     "Connection: %s\r\n\r\n",
+                     content_type(rel), len, start, end, f->size, etag,
+                     keep_alive ? "keep-alive" : "close");
+    } else {
+        n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Accept-Ranges: bytes\r\nETag: %s\r\nConnection: %s\r\n\r\n",
+                     content_type(rel), len, etag, keep_alive ? "keep-alive" : "close");
+    }
+    if (write_all(fd, hdr, (size_t)n) != 0) return 0;
+    if (!head && len > 0 && send_body(fd, f, start, len) != 0) return 0;
+
+    pthread_mutex_lock(&g_stats_lock);
+    g_requests++;
+    if (!head) g_bytes += len;
+    pthread_mutex_unlock(&g_stats_lock);
+    if (g_cfg.verbose) {
+        printf("[info] %s %s %d %zu bytes\n", method, rel, partial ? 206 : 200, head ? 0 : len);
+    }
+    return keep_alive;
+}
+
+static void* connection_thread(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    char buf[REQ_BUF_SIZE + 1];
+    size_t have = 0;
+    for (;;) {
+        // pipelined requests may already sit in buf
+        char* end = NULL;
+        while (!(end = (have ? strstr(buf, "\r\n\r\n") : NULL))) {
+            if (have >= REQ_BUF_SIZE) {
+                send_status(fd, 431, "Request Header Fields Too Large", 0);
+                goto done;
+            }
+            ssize_t n = recv(fd, buf + have, REQ_BUF_SIZE - have, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) goto done;
+            have += (size_t)n;
+            buf[have] = '\0';
+        }
+        size_t req_len = (size_t)(end - buf) + 4;
+        char saved = buf[req_len];
+        buf[req_len] = '\0';
+        int keep = handle_request(fd, buf);
+        buf[req_len] = saved;
+        memmove(buf, buf + req_len, have - req_len);
+        have -= req_len;
+        buf[have] = '\0';
+        if (!keep) break;
+    }
+done:
+    close(fd);
+    return NULL;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s --root <dataset_dir> [--port <port>] [--bind <addr>]\n"
+        " [--rate <Mbit/s>] [--latency <ms>] [--preload] [--verbose]\n"
+        "Notes:\n"
+        "  [--port <port>]     (listen port, default is 8080)\n"
+        "  [--bind <addr>]     (listen address, default is 127.0.0.1)\n"
+        "  [--rate <Mbit/s>]   (per-connection throughput limit, default is 0 = unlimited)\n"
+        "  [--latency <ms>]    (delay added before every response, default is 0)\n"
+        "  [--preload]         (map every file under root at startup)\n"
+        "  [--verbose]         (log each request)\n"
+        "  • Example: %s --root ../../PointCloud-dataset --rate 200 --latency 20\n"
+        "    then stream_client --url http://127.0.0.1:8080/<dir>/<name>.mpd ...\n",
+        prog, prog);
+}
+
+int main(int argc, char* argv[]) {
+    const char* bind_addr = "127.0.0.1";
+    int port = 8080;
+    double rate_mbps = 0.0;
+    int preload = 0;
+    memset(&g_cfg, 0, sizeof(g_cfg));
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--root") && i + 1 < argc) {
+            g_cfg.root = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bind") && i + 1 < argc) {
+            bind_addr = argv[++i];
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate_mbps = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--latency") && i + 1 < argc) {
+            g_cfg.latency_ms = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--preload")) {
+            preload = 1;
+        } else if (!strcmp(argv[i], "--verbose")) {
+            g_cfg.verbose = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!g_cfg.root) {
+        usage(argv[0]);
+        return 1;
+    }
+    g_cfg.rate_bps = rate_mbps * 1e6 / 8.0;
+
+    // one fd per connection (the cache keeps none): allow as many as the hard limit does
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) != 0) perror("[warn] setrlimit(RLIMIT_NOFILE)");
+    }
+
+    int ls = socket(AF_INET, SOCK_STREAM, 0);
+    if (ls < 0) {
+        perror("[error] socket");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
+        fprintf(stderr, "[error] invalid --bind address: %s\n", bind_addr);
+        close(ls);
+        return 1;
+    }
+    if (bind(ls, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(ls, 128) != 0) {
+        perror("[error] bind/listen");
+        close(ls);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal; // no SA_RESTART: accept() returns EINTR on Ctrl-C
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (preload) printf("[info] preloaded %d files\n", preload_dir(""));
+    printf("[info] frame_server: serving %s on http://%s:%d (rate=%.1f Mbit/s, 0 = unlimited; latency=%d ms)\n",
+           g_cfg.root, bind_addr, port, rate_mbps, g_cfg.latency_ms);
+    fflush(stdout);
+
+    while (!g_stop) {
+        int cfd = accept(ls, NULL, NULL);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // the pending connection stays queued; retry once a connection has closed
+                if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+                    fprintf(stderr, "[error] accept: out of file descriptors (ulimit -n %llu), "
+                            "too many open connections\n", (unsigned long long)rl.rlim_cur);
+                }
+                sleep_ms(100);
+                continue;
+            }
+            perror("[warn] accept");
+            continue;
+        }
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t t;
+        if (pthread_create(&t, NULL, connection_thread, (void*)(intptr_t)cfd) != 0) {
+            close(cfd);
+            continue;
+        }
+        pthread_detach(t);
+        pthread_mutex_lock(&g_stats_lock);
+        g_connections++;
+        pthread_mutex_unlock(&g_stats_lock);
+    }
+
+    close(ls);
+    pthread_mutex_lock(&g_stats_lock);
+    printf("[info] frame_server: %lu connections, %lu requests, %.1f MB sent\n",
+           g_connections, g_requests, (double)g_bytes / 1e6);
+    pthread_mutex_unlock(&g_stats_lock);
+    // mappings are left to process exit: detached connection threads may still use them
+    return 0;
+}